@@ -17,6 +17,15 @@ int disk_main(int argc, char *argv[]);				// disk.c
 int test_main(int argc, char *argv[]);				// test.c
 int kill_main(int argc, char *argv[]);				// kill.c
 int ts_main(int argc, char *argv[]);				// ts.c
+int sched_main(int argc, char *argv[]);				// sched.c
+int cswitch_main(int argc, char *argv[]);			// cswitch.c
+int fibers_main(int argc, char *argv[]);			// fibers.c
+int pingpong_main(int argc, char *argv[]);			// pingpong.c
+int locks_main(int argc, char *argv[]);				// locks.c
 int lspci_main(int argc, char *argv[]);             // lspci.c
+int stack_main(int argc, char *argv[]);				// stack.c
+int caches_main(int argc, char *argv[]);			// caches.c
+int mem_main(int argc, char *argv[]);				// mem.c
+int mtrace_main(int argc, char *argv[]);			// mtrace.c
 
 #endif
@@ -1,9 +1,17 @@
 // Segmentos de MTask (inicializados en gdt_idt.c)
 #define MT_CS 0x08				// segmento de código
 #define MT_DS 0x10				// segmento de datos
+#define MT_UCS 0x1B				// segmento de código de usuario (ring 3)
+#define MT_UDS 0x23				// segmento de datos de usuario (ring 3)
+#define MT_TSS 0x28				// TSS
+#define MT_PFTSS 0x30			// TSS del manejador de fallos de página
+#define MT_TLS 0x38				// TLS de la tarea actual, en GS (ver tls.c)
 
-// Offset de esp en la estructura Task_t (definida en kernel.h)
-#define Task_t_ESP 24
+// Bit de habilitación de interrupciones en los flags
+#define INTFL 0x200
+
+// Tamaño de una línea de cache (ver cache.c y Task_t)
+#define CACHE_LINE 64
 
 // Stubs de interrupción (definidos en interrupts.S)
 // Excepciones 0-31, interrupciones de HW 32-47
@@ -11,7 +19,21 @@
 #define NUM_INTS 48				// total de stubs
 #define NUM_EXCEPT 32			// cantidad de excepciones
 
+// Interrupción de software para system calls (definida en sysentry.S)
+#define SYSCALL_INT 0x80
+
 // Tamaños de stack
 #define MAIN_STKSIZE 0x4000		// tarea inicial y shells iniciales
 #define INT_STKSIZE 0x4000		// interrupciones
-#define MIN_STACK 0x1000		// mínimo para una tarea 
\ No newline at end of file
+#define MIN_STACK 0x1000		// mínimo para una tarea
+#define FIBER_STKSIZE 0x400		// fibras, por omisión
+#define MIN_FIBER_STACK 0x200	// mínimo para una fibra
+#define KERN_STKSIZE 0x2000		// stack de kernel de las tareas de usuario
+#define PF_STKSIZE 0x1000		// manejador de fallos de página
+
+// Claves de TLS por tarea (ver tls.c)
+#define MAX_TLS_KEYS 16
+
+// Paginación (ver paging.c)
+#define PAGE_SIZE 0x1000		// página chica
+#define PAGE_SIZE_LARGE 0x400000	// página grande (PSE)
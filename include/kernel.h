@@ -27,68 +27,250 @@ typedef struct
 }
 mt_regs_t;
 
+// Registros guardados por mt_switch_fast() (libasm.S) en un cambio de
+// contexto voluntario: los que una función C debe preservar y la dirección
+// de retorno.
+typedef struct
+{
+	unsigned 		edi;
+	unsigned 		esi;
+	unsigned 		ebx;
+	unsigned 		ebp;
+	unsigned 		eip;
+}
+mt_fast_regs_t;
+
+// Registros empujados al stack por una interrupción que llega en ring 3.
+// El i386 agrega el stack de usuario a los registros de mt_regs_t.
+typedef struct
+{
+	mt_regs_t		regs;
+	unsigned		esp;
+	unsigned		ss;
+}
+mt_user_regs_t;
+
+typedef struct mt_image_t mt_image_t;
+typedef struct mt_mem_t mt_mem_t;
+typedef struct mt_fibers_t mt_fibers_t;
+typedef struct mt_mailbox_t mt_mailbox_t;
+
 // Colas de tareas
 struct TaskQueue_t
 {
 	char *			name;
 	Task_t *		head;
 	Task_t *		tail;
+	unsigned		count;			// tareas en la cola
 };
 
-// Bloque de control de una tarea
+// Bloque de control de una tarea. La parte caliente, que usan el scheduler y
+// el cambio de contexto, ocupa las dos primeras líneas de cache; el resto
+// empieza en la línea siguiente (ver kernel.c). El código assembler accede a
+// los campos con offsets generados por el makefile (ver offsets.c).
 struct Task_t
 {
-	TaskQueue_t 	send_queue;
-	TaskState_t		state;
-	unsigned		priority;
-	unsigned		atomic_level;
-	mt_regs_t *		esp;			// Offset declarado en const.h
-	char *			stack;
-	TaskQueue_t	*	queue;
-	Task_t *		prev;
-	Task_t *		next;
-	bool			success;
-	bool			in_time_q;
-	Task_t *		time_prev;
-	Task_t *		time_next;
-	unsigned		ticks;
-	void *			tls;
-	void *			math_data;
-	SaveRestore_t	save;
-	SaveRestore_t	restore;
-	Task_t *		from;
-	void *			msg;
-	unsigned 		size;
-	Cleanup_t		cleanup;
-	unsigned		consnum;
-	Task_t *		list_prev;
-	Task_t *		list_next;
-	Task_t *		join;
-	int				join_status;
-	Task_t *		attached_to;
-	unsigned		nattached;
-	bool			exiting;
-	bool			protected;
+	struct __attribute__((aligned(CACHE_LINE)))
+	{
+		// Primera línea: mt_select_task(), colas de tareas
+		TaskQueue_t 	send_queue;		// primer campo, para GetName()
+		TaskState_t		state;
+		unsigned		priority;
+		unsigned		atomic_level;
+		mt_regs_t *		esp;
+		bool			fast_frame;		// esp apunta a un mt_fast_regs_t
+		TaskQueue_t	*	queue;
+		Task_t *		prev;
+		Task_t *		next;
+		unsigned		boost;			// bonificación por bloquearse seguido
+		unsigned		slice;			// ticks de la última ranura de tiempo
+		unsigned		nvcsw;			// cambios de contexto voluntarios
+		unsigned		nivcsw;			// cambios de contexto involuntarios
+
+		// Segunda línea: switch_to(), cola de tiempo
+		TaskGroup_t *	group;			// grupo de la tarea, ver CreateGroup()
+		void *			tls;
+		SaveRestore_t	save;
+		SaveRestore_t	restore;
+		char *			stack_end;		// tope del stack, usado como esp0 en ring 3
+		unsigned		consnum;
+		unsigned		max_boost;		// máximo de boost
+		void *			math_data;
+		Task_t *		time_prev;
+		Task_t *		time_next;
+		Time_t			expiry;			// tick en que vence, en la cola de tiempo
+		bool			in_time_q;
+		bool			success;
+	};
+
+	struct __attribute__((aligned(CACHE_LINE)))
+	{
+		Task_t *		from;
+		void *			msg;
+		unsigned 		size;
+		void *			tls_keys[MAX_TLS_KEYS];	// ver CreateTLSKey(), apuntado por GS
+		Cleanup_t		cleanup;
+		Task_t *		list_prev;
+		Task_t *		list_next;
+		Task_t *		join;
+		int				join_status;
+		Task_t *		attached_to;
+		unsigned		nattached;
+		Task_t *		children;		// tareas vinculadas a esta
+		Task_t *		sibling_prev;	// lista de tareas vinculadas a attached_to
+		Task_t *		sibling_next;
+		TaskId_t		id;				// ver GetTaskId()
+		bool			exiting;
+		bool			protected;
+		char *			stack;
+		char *			ustack;			// stack de usuario (tareas de usuario)
+		mt_image_t *	image;			// programa de usuario (tareas de usuario)
+		Arena_t *		arenas;			// arenas asociadas a la tarea
+		mt_mem_t *		mem_list;		// bloques alocados con Malloc()
+		unsigned		mem_current;	// bytes alocados
+		unsigned		mem_peak;		// máximo de mem_current
+		unsigned		mem_limit;		// límite de mem_current, 0 si no hay
+		bool			mem_reclaim;	// liberar los bloques al terminar
+		Time_t			deadline;		// próximo vencimiento periódico, en ticks
+		unsigned		period;			// período en ticks, 0 si no es periódica
+		unsigned		overruns;		// vencimientos periódicos perdidos
+		mt_fibers_t *	fibers;			// fibras de la tarea, ver fiber.c
+		mt_mailbox_t *	mailbox;		// mensajes asincrónicos, ver SetMailbox()
+		unsigned		wait_flags;		// máscara de WaitFlags(), luego los flags obtenidos
+		FlagsMode_t		wait_mode;		// .
+		bool			wait_clear;		// .
+		unsigned		rcu_nesting;	// anidamiento de RcuReadLock()
+		unsigned		rcu_phase;		// fase de RCU en que entró, ver rcu.c
+		RcuHead_t		rcu;			// liberación diferida, ver free_terminated()
+	};
+};
+
+/* arena.c */
+
+void mt_delete_arenas(Task_t *task);
+
+/* cache.c */
+
+typedef struct mt_slab_t mt_slab_t;
+
+// Cache de objetos. Los caches del kernel se definen estáticamente con
+// MT_CACHE() y se terminan de inicializar con la primera alocación.
+struct Cache_t
+{
+	char *			name;			// primer campo, para GetName()
+	unsigned		size;			// tamaño de los objetos
+	unsigned		align;			// alineación de los objetos
+	CacheFunc_t		ctor;			// constructor
+	CacheFunc_t		dtor;			// destructor
+	unsigned		link;			// offset del enlace de cada objeto
+	unsigned		slot;			// espacio que ocupa cada objeto
+	unsigned		slab_size;		// tamaño de cada slab
+	unsigned		per_slab;		// objetos por slab
+	unsigned		color;			// coloreo del próximo slab
+	unsigned		color_max;		// máximo coloreo
+	mt_slab_t *		full;			// slabs sin objetos libres
+	mt_slab_t *		partial;		// slabs con objetos libres y en uso
+	mt_slab_t *		empty;			// slabs sin objetos en uso
+	unsigned		nempty;			// cantidad de slabs vacíos
+	unsigned		slabs;			// estadísticas, ver CacheInfo_t
+	unsigned		in_use;			// .
+	unsigned		allocs;			// .
+	unsigned		frees;			// .
+	unsigned		ctors;			// .
+	Cache_t *		next;			// lista de caches
 };
 
-/* malloc.c */
+#define MT_CACHE(n, type, c, d) \
+	{ .name = n, .size = sizeof(type), .align = __alignof__(type), .ctor = c, .dtor = d }
+
+char *mt_name_dup(const char *name);
+void mt_name_free(char *name);
+
+/* malloc.c, segfit.c */
+
+void *mt_block_alloc(unsigned nbytes);
+void mt_block_free(void *ap);
+void mt_heap_add(void *start, unsigned size);
+void mt_heap_walk(void (*func)(void *arg, char *addr, unsigned size), void *arg);
+
+/* pages.c */
+
+#define ZONE_DMA		0				// zonas de memoria
+#define ZONE_NORMAL		1
+
+#define PAGES_DMA		0x01			// memoria debajo de 16 MB
+#define PAGES_LARGE		0x02			// pedido grande de malloc() (heap.c)
+#define PAGES_USED		0x80			// bloque alocado (mt_pages_flags)
+
+void mt_setup_pages(unsigned end, unsigned reserved_end);
+void *mt_alloc_pages(unsigned order, unsigned flags);
+void mt_free_pages(void *p);
+unsigned mt_pages_order(unsigned size);
+unsigned mt_pages_flags(void *p, unsigned *order);
+void mt_pages_walk(void (*func)(void *arg, char *addr, unsigned size), void *arg);
+unsigned mt_pages_info(unsigned zone, char **start, char **end);
+
+/* heap.c */
+
+extern HeapInfo_t mt_heap;
+
+void *mt_malloc(unsigned nbytes, void *caller);
+void mt_free(void *ap, void *caller);
+bool mt_malloc_trace(bool on);
+unsigned mt_malloc_trace_dump(void);
+
+// Actualización de los contadores del heap desde el alocador. Reciben el
+// tamaño pedido y el tamaño real del bloque.
+static inline void
+mt_heap_alloc(unsigned nbytes, unsigned size)
+{
+	unsigned i = nbytes <= 16 ? 0 : 28 - __builtin_clz(nbytes - 1);
+
+	mt_heap.hist[i < HEAP_BUCKETS ? i : HEAP_BUCKETS - 1]++;
+	mt_heap.allocs++;
+	if ( (mt_heap.in_use += size) > mt_heap.peak )
+		mt_heap.peak = mt_heap.in_use;
+}
+
+static inline void
+mt_heap_free(unsigned size)
+{
+	mt_heap.frees++;
+	mt_heap.in_use -= size;
+}
+
+/* paging.c */
 
-void mt_setup_heap(unsigned himem_size);
+unsigned mt_setup_paging(unsigned mem_end);
+void *mt_alloc_stack(unsigned size);
+void mt_free_stack(void *stack);
+unsigned mt_stack_pages(void *stack);
+bool mt_user_range(const void *p, unsigned size);
+bool mt_user_string(const char *s);
+void mt_page_fault(unsigned error);
 
 /* gdt_idt.c */
 
+extern tss_desc mt_tss;
+extern tss_desc mt_pf_tss;
+
 void mt_setup_gdt_idt(void);
+void mt_set_tls(void **keys);
 
 /* interrupts.S */
 
 typedef char int_stub[INT_STUB_SIZE];
 extern int_stub mt_int_stubs[NUM_INTS];
 
+void mt_page_fault_entry(void);
+
 /* libasm.S */
 
 void mt_load_gdt(const region_desc *gdt);
 void mt_load_idt(const region_desc *idt);
 void mt_context_switch(void);
+void mt_switch_fast(void);
+void mt_switch_fiber(void **save_esp, void *esp);
 void mt_sti(void);
 void mt_cli(void);
 unsigned mt_flags(void);
@@ -98,6 +280,62 @@ void mt_frstor(void *buf);
 void mt_stts(void);
 void mt_clts(void);
 void mt_hlt(void);
+void mt_load_tr(unsigned selector);
+void mt_load_gs(unsigned selector);
+void mt_wrmsr(unsigned msr, unsigned low, unsigned high);
+unsigned mt_cpuid(unsigned leaf, unsigned *regs);
+unsigned long long mt_rdtsc(void);
+void mt_enable_paging(unsigned *page_dir);
+void mt_invlpg(void *addr);
+unsigned mt_cr2(void);
+
+// Compara *p con old y si son iguales lo reemplaza por new, en una sola
+// instrucción. Es el camino rápido de semáforos y mutexes, que no necesita
+// deshabilitar interrupciones.
+static inline bool
+mt_cmpxchg(volatile unsigned *p, unsigned old, unsigned new)
+{
+	unsigned prev;
+
+	__asm__ __volatile__(
+		"lock cmpxchgl %2, %1"
+		: "=a" (prev), "+m" (*p)
+		: "r" (new), "0" (old)
+		: "memory", "cc");
+	return prev == old;
+}
+
+/* sysentry.S */
+
+void mt_syscall_int(void);
+void mt_sysenter_entry(void);
+
+/* msgqueue.c, channel.c */
+
+unsigned mt_msgqueue_size(MsgQueue_t *mq);
+unsigned mt_channel_size(Channel_t *ch);
+unsigned mt_subscriber_size(Subscriber_t *sub);
+
+/* syscall.c */
+
+void mt_setup_syscalls(void);
+Time_t mt_syscall(unsigned num, unsigned *args);
+Task_t *mt_create_user_task(mt_image_t *image, unsigned entry, unsigned stacksize, const char *name, unsigned priority);
+void *mt_user_push(Task_t *task, const void *data, unsigned size);
+
+/* elf.c */
+
+struct mt_image_t
+{
+	unsigned		refs;			// tareas que usan la imagen
+	char *			base;			// memoria de la imagen
+	unsigned		size;			// tamaño de la imagen
+};
+
+unsigned mt_setup_programs(unsigned nmods, void *mods);
+const char *mt_program_name(unsigned n);
+Task_t *mt_exec(const char *name, int argc, char *argv[], unsigned priority);
+void mt_release_image(mt_image_t *image);
 
 /* kernel.c */
 
@@ -105,10 +343,19 @@ typedef struct boot_info_t boot_info_t;
 
 void mt_main(unsigned magic, boot_info_t *info);
 bool mt_select_task(void);
+void mt_exit_frame(mt_regs_t *regs, int status);
+void *mt_task_alloc(Task_t *task, unsigned size);
+void *mt_kalloc(unsigned size);
+char *mt_kstrdup(const char *str);
+void mt_disown(void *mem);
 
 extern Task_t * volatile mt_curr_task;
 extern Task_t * volatile mt_last_task;
 extern Task_t * volatile mt_fpu_task;
+extern bool mt_fast_switch;
+extern bool mt_fast_locks;
+
+void mt_tls_clear(unsigned key);
 
 /* irq.c */
 
@@ -125,18 +372,49 @@ void mt_set_exception_handler(unsigned except_num, exception_handler handler);
 void mt_enable_irq(unsigned irq);
 void mt_disable_irq(unsigned irq);
 
+/* fiber.c */
+
+// Cola de fibras bloqueadas en un objeto del kernel, ver GetPipeFiber()
+typedef struct
+{
+	Fiber_t *		head;
+	Fiber_t *		tail;
+}
+mt_fiber_queue_t;
+
+bool mt_fiber_park(mt_fiber_queue_t *queue);
+void mt_fiber_wakeup(mt_fiber_queue_t *queue, bool all);
+void mt_fiber_flush(mt_fiber_queue_t *queue);
+unsigned mt_fiber_count(Task_t *task);
+void mt_exit_fibers(Task_t *task);
+void mt_free_fibers(Task_t *task);
+
+/* rcu.c */
+
+void mt_rcu_poll(void);
+
 /* timer.c */
 
 void mt_setup_timer(unsigned freq);
 
 /* queue.c */
 
+// Orden de las tareas en las colas: por prioridad y, a igual prioridad,
+// por boost (ver mt_select_task()).
+static inline int
+mt_prio_cmp(Task_t *a, Task_t *b)
+{
+	if ( a->priority != b->priority )
+		return a->priority > b->priority ? 1 : -1;
+	return (int) a->boost - (int) b->boost;
+}
+
 void mt_enqueue(Task_t *task, TaskQueue_t *queue);
 void mt_dequeue(Task_t *task);
 Task_t *mt_peeklast(TaskQueue_t *queue);
 Task_t *mt_getlast(TaskQueue_t *queue);
 
-void mt_enqueue_time(Task_t *task, unsigned ticks);
+void mt_enqueue_time(Task_t *task, Time_t expiry);
 void mt_dequeue_time(Task_t *task);
 Task_t *mt_peekfirst_time(void);
 Task_t *mt_getfirst_time(void);
@@ -290,6 +568,10 @@ char *mt_ide_model(unsigned minor);
 unsigned mt_ide_capacity(unsigned minor);
 
 
+/* serial.c */
+
+void mt_serial_write(const void *buf, unsigned n);
+
 /* pci.c */
 
 // Configuration:
@@ -77,7 +77,7 @@ int printk(const char *fmt, ...);
 int print0(const char *fmt, ...);
 void cprintk(unsigned fg, unsigned bg, const char *fmt, ...);
 
-/* malloc.c */
+/* heap.c */
 
 void *malloc(unsigned nbytes);
 void free(void *ap);
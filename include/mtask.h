@@ -7,12 +7,17 @@
 #define DEFAULT_PRIO	100
 #define MAX_PRIO		-1U
 #define FOREVER			-1U
+#define DEFAULT_SHARES	1024
 
 typedef unsigned long long Time_t;
+typedef unsigned TaskId_t;
 typedef struct Task_t Task_t;
 typedef struct TaskQueue_t TaskQueue_t;
+typedef struct Fiber_t Fiber_t;
+typedef struct TaskGroup_t TaskGroup_t;
 
 typedef int (*TaskFunc_t)(void *arg);
+typedef void (*FiberFunc_t)(void *arg);
 typedef void (*SaveRestore_t)(void);
 typedef void (*Cleanup_t)(void);
 
@@ -34,6 +39,7 @@ TaskState_t;
 typedef struct
 {
 	Task_t *		task;
+	TaskId_t		id;
 	unsigned		consnum;
 	unsigned 		priority;
 	TaskState_t		state;
@@ -41,9 +47,76 @@ typedef struct
 	bool 			is_timeout;
 	unsigned 		timeout;
 	bool			protected;
+	unsigned		stack_pages;	// páginas de stack con memoria física
+	unsigned		mem_current;	// bytes alocados con Malloc()
+	unsigned		mem_peak;
+	unsigned		mem_limit;
+	unsigned		boost;			// bonificación de prioridad, ver SetMaxBoost()
+	unsigned		slice;			// última ranura de tiempo en milisegundos
+	unsigned		nvcsw;			// cambios de contexto voluntarios
+	unsigned		nivcsw;			// cambios de contexto involuntarios
+	unsigned		period;			// período en milisegundos, ver SetPeriod()
+	unsigned		overruns;		// vencimientos perdidos, ver WaitNextPeriod()
+	unsigned		fibers;			// fibras vivas, ver CreateFiber()
+	TaskGroup_t *	group;			// ver SetGroup()
+	unsigned		mail;			// mensajes en el buzón, ver SetMailbox()
+	unsigned		mail_dropped;	// mensajes descartados del buzón
 }
 TaskInfo_t;
 
+// Política de un buzón lleno, ver SetMailbox()
+typedef enum
+{
+	MailBlock,						// el remitente espera lugar
+	MailDrop,						// se descarta el mensaje más viejo
+	MailFail						// PostMessage() falla
+}
+MailPolicy_t;
+
+// Condición de espera de WaitFlags()
+typedef enum
+{
+	FlagsAny,						// alguno de los flags de la máscara
+	FlagsAll						// todos los flags de la máscara
+}
+FlagsMode_t;
+
+// Política de un canal de difusión con un suscriptor atrasado, ver CreateChannel()
+typedef enum
+{
+	ChanBlock,						// el productor espera
+	ChanLag							// el suscriptor pierde mensajes
+}
+ChanPolicy_t;
+
+// Información de un grupo de tareas, ver GetGroups()
+typedef struct
+{
+	TaskGroup_t *	group;
+	TaskGroup_t *	parent;			// NULL en la raíz
+	unsigned		ntasks;
+	unsigned		shares;			// fracción de la CPU del padre
+	unsigned		weight;			// peso resultante, DEFAULT_SHARES es 1
+	unsigned		quota;			// milisegundos por período, 0 si no hay cuota
+	unsigned		period;			// período en milisegundos
+	unsigned		used;			// milisegundos usados en el período
+	bool			throttled;		// agotó la cuota del período
+	unsigned		nthrottled;		// veces que agotó la cuota
+	Time_t			usage;			// milisegundos usados en total
+}
+GroupInfo_t;
+
+// Parámetros del scheduler, ver SetSchedParams()
+typedef struct
+{
+	unsigned		latency;		// milisegundos para que corran las tareas listas
+	unsigned		min_slice;		// ranura mínima en milisegundos
+	unsigned		max_slice;		// ranura máxima en milisegundos
+	unsigned		hog_factor;		// multiplicador de la ranura sin boost
+	unsigned		max_boost;		// máximo boost de las tareas nuevas
+}
+SchedParams_t;
+
 /* API principal */
 
 Task_t *		CreateTask(TaskFunc_t func, unsigned stacksize, void *arg, const char *name, unsigned priority);
@@ -55,15 +128,45 @@ bool			SetPriority(Task_t *task, unsigned priority);
 bool			SetConsole(Task_t *task, unsigned consnum);
 bool			SetSaveRestore(Task_t *task, SaveRestore_t save, SaveRestore_t restore);
 bool			SetCleanup(Task_t *task, Cleanup_t cleanup);
+bool			SetMemLimit(Task_t *task, unsigned limit);
+bool			SetMemReclaim(Task_t *task, bool reclaim);
+bool			SetMaxBoost(Task_t *task, unsigned max_boost);
+void			GetSchedParams(SchedParams_t *params);
+bool			SetSchedParams(const SchedParams_t *params);
 void			GetInfo(Task_t *task, TaskInfo_t *info);
 TaskInfo_t *	GetTasks(unsigned *ntasks);
 bool			Ready(Task_t *task);
 bool			Suspend(Task_t *task);
 
+TaskGroup_t *	CreateGroup(const char *name, TaskGroup_t *parent);
+bool			DeleteGroup(TaskGroup_t *group);
+bool			SetGroup(Task_t *task, TaskGroup_t *group);
+TaskGroup_t *	GetGroup(Task_t *task);
+bool			SetGroupQuota(TaskGroup_t *group, unsigned quota, unsigned period);
+bool			SetGroupShares(TaskGroup_t *group, unsigned shares);
+GroupInfo_t *	GetGroups(unsigned *ngroups);
+
+TaskId_t		GetTaskId(Task_t *task);
+Task_t *		GetTask(TaskId_t id);
+bool			DeleteTaskId(TaskId_t id, int status);
+bool			AttachId(TaskId_t id);
+bool			DetachId(TaskId_t id);
+bool			SetPriorityId(TaskId_t id, unsigned priority);
+bool			GetInfoId(TaskId_t id, TaskInfo_t *info);
+bool			ReadyId(TaskId_t id);
+bool			SuspendId(TaskId_t id);
+bool			JoinId(TaskId_t id, int *status);
+bool			JoinTimedId(TaskId_t id, int *status, unsigned msecs);
+bool			SendId(TaskId_t id, void *msg, unsigned size);
+bool			SendTimedId(TaskId_t id, void *msg, unsigned size, unsigned msecs);
+
 Task_t *		CurrentTask(void);
 void			Pause(void);
 void			Yield(void);
 void			Delay(unsigned msecs);
+bool			DelayUntil(Time_t deadline);
+void			SetPeriod(unsigned msecs);
+unsigned		WaitNextPeriod(void);
 void			UDelay(unsigned usecs);
 bool			Join(Task_t *task, int *status);
 bool			JoinCond(Task_t *task, int *status);
@@ -77,6 +180,15 @@ bool	 		SetInts(bool enabled);
 extern void *	TLS;
 #define			TLS(type) ((type *)TLS)
 
+/* Claves de TLS */
+
+typedef unsigned TLSKey_t;
+
+TLSKey_t		CreateTLSKey(void);
+void			DeleteTLSKey(TLSKey_t key);
+void *			GetTLS(TLSKey_t key);
+void			SetTLS(TLSKey_t key, void *value);
+
 TaskQueue_t *	CreateQueue(const char *name);
 void			DeleteQueue(TaskQueue_t *queue);
 bool			WaitQueue(TaskQueue_t *queue);
@@ -90,6 +202,11 @@ bool			SendTimed(Task_t *to, void *msg, unsigned size, unsigned msecs);
 bool			Receive(Task_t **from, void *msg, unsigned *size);
 bool			ReceiveCond(Task_t **from, void *msg, unsigned *size);
 bool			ReceiveTimed(Task_t **from, void *msg, unsigned *size, unsigned msecs);
+bool			Call(Task_t *to, void *msg, unsigned size, void *reply, unsigned *reply_size);
+bool			ReplyWait(Task_t *to, void *reply, unsigned size, Task_t **from, void *msg, unsigned *msg_size);
+bool			SetMailbox(unsigned nmsgs, unsigned msg_size, MailPolicy_t policy);
+bool			PostMessage(Task_t *to, void *msg, unsigned size);
+bool			PostMessageTimed(Task_t *to, void *msg, unsigned size, unsigned msecs);
 
 char *			GetName(void *object);
 Time_t			Time(void);
@@ -97,6 +214,14 @@ void *			Malloc(unsigned size);
 char *			StrDup(const char *str);
 void 			Free(void *mem);
 
+/* Fibras */
+
+Fiber_t *		CreateFiber(FiberFunc_t func, void *arg, unsigned stacksize);
+Fiber_t *		CurrentFiber(void);
+void			YieldFiber(void);
+void			ExitFiber(void);
+bool			JoinFibers(void);
+
 /* Semáforos */
 
 typedef struct Semaphore_t Semaphore_t;
@@ -140,11 +265,25 @@ bool			WaitConditionTimed(Condition_t *cond, unsigned msecs);
 bool			SignalCondition(Condition_t *cond);
 void			BroadcastCondition(Condition_t *cond);
 
+/* Flags de eventos */
+
+typedef struct EventFlags_t EventFlags_t;
+
+EventFlags_t *	CreateFlags(const char *name, unsigned flags);
+void			DeleteFlags(EventFlags_t *ef);
+void			SetFlags(EventFlags_t *ef, unsigned flags);
+void			ClearFlags(EventFlags_t *ef, unsigned flags);
+unsigned		GetFlags(EventFlags_t *ef);
+unsigned		WaitFlags(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear);
+unsigned		WaitFlagsCond(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear);
+unsigned		WaitFlagsTimed(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear, unsigned msecs);
+
 /* Pipes */
 
 typedef struct Pipe_t Pipe_t;
 
 Pipe_t *		CreatePipe(const char *name, unsigned size);
+Pipe_t *		CreateChunkedPipe(const char *name, unsigned max);
 void			DeletePipe(Pipe_t *p);
 unsigned		GetPipe(Pipe_t *p, void *data, unsigned size);
 unsigned		GetPipeCond(Pipe_t *p, void *data, unsigned size);
@@ -152,6 +291,9 @@ unsigned		GetPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs);
 unsigned		PutPipe(Pipe_t *p, void *data, unsigned size);
 unsigned		PutPipeCond(Pipe_t *p, void *data, unsigned size);
 unsigned		PutPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs);
+unsigned		GetPipeFiber(Pipe_t *p, void *data, unsigned size);
+unsigned		PutPipeFiber(Pipe_t *p, void *data, unsigned size);
+unsigned		SplicePipe(Pipe_t *to, Pipe_t *from, unsigned size);
 unsigned		AvailPipe(Pipe_t *p);
 
 /* Colas de mensajes */
@@ -166,6 +308,127 @@ bool			GetMsgQueueTimed(MsgQueue_t *mq, void *msg, unsigned msecs);
 bool			PutMsgQueue(MsgQueue_t *mq, void *msg);
 bool			PutMsgQueueCond(MsgQueue_t *mq, void *msg);
 bool			PutMsgQueueTimed(MsgQueue_t *mq, void *msg, unsigned msecs);
+bool			GetMsgQueueFiber(MsgQueue_t *mq, void *msg);
+bool			PutMsgQueueFiber(MsgQueue_t *mq, void *msg);
 unsigned		AvailMsgQueue(MsgQueue_t *mq);
 
+/* Colas de mensajes de longitud variable */
+
+typedef struct MsgQueueV_t MsgQueueV_t;
+
+MsgQueueV_t *	CreateMsgQueueV(const char *name, unsigned size);
+void			DeleteMsgQueueV(MsgQueueV_t *mq);
+unsigned		GetMsgV(MsgQueueV_t *mq, void *msg, unsigned size);
+unsigned		GetMsgVCond(MsgQueueV_t *mq, void *msg, unsigned size);
+unsigned		GetMsgVTimed(MsgQueueV_t *mq, void *msg, unsigned size, unsigned msecs);
+bool			PutMsgV(MsgQueueV_t *mq, void *msg, unsigned size);
+bool			PutMsgVCond(MsgQueueV_t *mq, void *msg, unsigned size);
+bool			PutMsgVTimed(MsgQueueV_t *mq, void *msg, unsigned size, unsigned msecs);
+unsigned		PeekMsgV(MsgQueueV_t *mq);
+unsigned		AvailMsgV(MsgQueueV_t *mq);
+
+/* Canales de difusión */
+
+typedef struct Channel_t Channel_t;
+typedef struct Subscriber_t Subscriber_t;
+
+Channel_t *		CreateChannel(const char *name, unsigned nmsgs, unsigned msg_size, ChanPolicy_t policy);
+void			DeleteChannel(Channel_t *ch);
+Subscriber_t *	Subscribe(Channel_t *ch);
+void			Unsubscribe(Subscriber_t *sub);
+bool			Publish(Channel_t *ch, void *msg);
+bool			PublishCond(Channel_t *ch, void *msg);
+bool			PublishTimed(Channel_t *ch, void *msg, unsigned msecs);
+bool			GetChannel(Subscriber_t *sub, void *msg);
+bool			GetChannelCond(Subscriber_t *sub, void *msg);
+bool			GetChannelTimed(Subscriber_t *sub, void *msg, unsigned msecs);
+unsigned		GetChannelLag(Subscriber_t *sub);
+
+/* Lectura sin exclusión (RCU) */
+
+typedef struct RcuHead_t RcuHead_t;
+typedef void (*RcuFunc_t)(void *arg);
+
+// Llamada diferida por RcuDefer(), normalmente un campo del objeto a liberar
+struct RcuHead_t
+{
+	RcuHead_t *		next;
+	RcuFunc_t		func;
+	void *			arg;
+};
+
+// Publicar un puntero después de inicializar lo apuntado, y leerlo en una
+// sección de lectura
+#define			RcuAssign(p, v)	do { __asm__ __volatile__("" ::: "memory"); (p) = (v); } while ( 0 )
+#define			RcuDeref(p)		(*(__typeof__(p) volatile *) &(p))
+
+void			RcuReadLock(void);
+void			RcuReadUnlock(void);
+void			RcuDefer(RcuHead_t *head, RcuFunc_t func, void *arg);
+void			RcuSynchronize(void);
+
+/* Caches de objetos */
+
+typedef struct Cache_t Cache_t;
+typedef void (*CacheFunc_t)(void *obj);
+
+typedef struct
+{
+	Cache_t *		cache;
+	unsigned		size;			// tamaño de los objetos
+	unsigned		per_slab;		// objetos por slab
+	unsigned		slabs;			// slabs alocados
+	unsigned		objects;		// objetos construidos
+	unsigned		in_use;			// objetos en uso
+	unsigned		allocs;			// llamadas a CacheAlloc()
+	unsigned		frees;			// llamadas a CacheFree()
+	unsigned		ctors;			// llamadas al constructor
+}
+CacheInfo_t;
+
+Cache_t *		CreateCache(const char *name, unsigned size, CacheFunc_t ctor, CacheFunc_t dtor);
+void			DeleteCache(Cache_t *cache);
+void *			CacheAlloc(Cache_t *cache);
+void			CacheFree(Cache_t *cache, void *obj);
+void			GetCacheInfo(Cache_t *cache, CacheInfo_t *info);
+CacheInfo_t *	GetCaches(unsigned *ncaches);
+
+/* Heap */
+
+#define HEAP_BUCKETS	14				// histograma de tamaños pedidos
+
+typedef struct
+{
+	unsigned		size;			// memoria administrada
+	unsigned		in_use;			// bytes en uso, incluyendo cabeceras
+	unsigned		peak;			// máximo de in_use
+	unsigned		free;			// bytes libres en el heap y en páginas
+	unsigned		free_blocks;	// bloques libres
+	unsigned		largest_free;	// mayor bloque libre
+	unsigned		heap_free;		// bytes libres en el heap de bloques chicos
+	unsigned		heap_largest;	// mayor bloque libre de ese heap
+	unsigned		free_pages;		// páginas libres
+	unsigned		dma_free_pages;	// páginas libres debajo de 16 MB
+	unsigned		allocs;			// alocaciones
+	unsigned		frees;			// liberaciones
+	unsigned		hist[HEAP_BUCKETS];	// pedidos de hasta 16 << i bytes, el
+									// último todos los mayores
+}
+HeapInfo_t;
+
+void			GetHeapInfo(HeapInfo_t *info);
+void			GetHeapMap(char *map, unsigned ncells);
+void *			AllocPages(unsigned size, bool dma);
+void			FreePages(void *pages);
+
+/* Arenas */
+
+typedef struct Arena_t Arena_t;
+
+Arena_t *		CreateArena(const char *name, unsigned chunk_size, Task_t *owner);
+void			DeleteArena(Arena_t *arena);
+void *			ArenaAlloc(Arena_t *arena, unsigned size);
+void *			ArenaMark(Arena_t *arena);
+void			ArenaRelease(Arena_t *arena, void *mark);
+
 #endif
@@ -0,0 +1,34 @@
+#ifndef MTRACE_H_INCLUDED
+#define MTRACE_H_INCLUDED
+
+/*
+	Formato de las trazas de malloc() y free() que el kernel vuelca por el
+	puerto serie cuando se compila con TRACE=yes (ver heap.c), y que lee
+	utils/mtreplay. Todos los campos son de 32 bits, little endian.
+	Un volcado es una cabecera seguida de count registros, del más viejo
+	al más nuevo.
+*/
+
+#define MTRACE_MAGIC		0x5254544D		// "MTTR"
+#define MTRACE_VERSION		1
+#define MTRACE_FREE			0xFFFFFFFF		// size de un registro de free()
+
+typedef struct
+{
+	unsigned		magic;
+	unsigned		version;
+	unsigned		count;					// registros que siguen
+	unsigned		lost;					// registros sobreescritos en el anillo
+}
+mtrace_header_t;
+
+typedef struct
+{
+	unsigned		time;					// parte baja del contador de ciclos
+	unsigned		caller;					// dirección de retorno del llamador
+	unsigned		addr;					// bloque alocado o liberado
+	unsigned		size;					// tamaño pedido, o MTRACE_FREE
+}
+mtrace_rec_t;
+
+#endif
@@ -63,6 +63,21 @@ typedef struct
 }
 region_desc;
 
+/* Task State Segment, solo se usan esp0 y ss0 */
+typedef struct
+{
+	unsigned link;					/* tarea anterior */
+	unsigned esp0, ss0;				/* stack para ring 0 */
+	unsigned esp1, ss1;				/* stack para ring 1 */
+	unsigned esp2, ss2;				/* stack para ring 2 */
+	unsigned cr3, eip, eflags;
+	unsigned eax, ecx, edx, ebx, esp, ebp, esi, edi;
+	unsigned es, cs, ss, ds, fs, gs, ldt;
+	unsigned short trap;			/* trap de debug */
+	unsigned short iomap;			/* offset del mapa de E/S */
+}
+tss_desc;
+
 #pragma pack(pop)
 
 #endif
@@ -0,0 +1,239 @@
+#ifndef SYSCALLS_H_INCLUDED
+#define SYSCALLS_H_INCLUDED
+
+/*
+	Números de system call, compartidos por el kernel (syscall.c) y la
+	librería de los programas de usuario (user/lib/syscalls.S).
+
+	Convención de llamada: eax tiene el número de system call y ebx apunta
+	a los argumentos en el stack del llamador, tal como los dejó una llamada
+	en C. El resultado vuelve en edx:eax.
+	Hay dos puntos de entrada: la interrupción SYSCALL_INT y sysenter.
+	Con sysenter el llamador pasa en ecx su esp y en edx la dirección de
+	retorno, y recibe la parte alta del resultado en ebx.
+*/
+
+// Bits que retorna SYS_Features
+#define SYSFEAT_SYSENTER	0x01		// sysenter/sysexit disponibles
+
+// Máxima cantidad de argumentos de una system call
+#define MAX_SYSARGS			6
+
+#define SYS_Features		0
+
+/* API principal */
+
+#define SYS_CreateTask		1			// requiere un wrapper en modo usuario
+#define SYS_DeleteTask		2
+#define SYS_Protect			3
+#define SYS_Attach			4
+#define SYS_Detach			5
+#define SYS_SetPriority		6
+#define SYS_SetConsole		7
+#define SYS_GetInfo			8
+#define SYS_GetTasks		9
+#define SYS_Ready			10
+#define SYS_Suspend			11
+#define SYS_CurrentTask		12
+#define SYS_Pause			13
+#define SYS_Yield			14
+#define SYS_Delay			15
+#define SYS_UDelay			16
+#define SYS_Join			17
+#define SYS_JoinCond		18
+#define SYS_JoinTimed		19
+#define SYS_Exit			20
+#define SYS_Atomic			21			// no disponible en ring 3
+#define SYS_Unatomic		22			// no disponible en ring 3
+
+#define SYS_CreateQueue		23
+#define SYS_DeleteQueue		24
+#define SYS_WaitQueue		25
+#define SYS_WaitQueueTimed	26
+#define SYS_SignalQueue		27
+#define SYS_FlushQueue		28
+
+#define SYS_Send			29
+#define SYS_SendCond		30
+#define SYS_SendTimed		31
+#define SYS_Receive			32
+#define SYS_ReceiveCond		33
+#define SYS_ReceiveTimed	34
+
+#define SYS_GetName			35
+#define SYS_Time			36
+#define SYS_Malloc			37
+#define SYS_StrDup			38
+#define SYS_Free			39
+
+/* Semáforos */
+
+#define SYS_CreateSem		40
+#define SYS_DeleteSem		41
+#define SYS_WaitSem			42
+#define SYS_WaitSemCond		43
+#define SYS_WaitSemTimed	44
+#define SYS_SignalSem		45
+#define SYS_ValueSem		46
+#define SYS_FlushSem		47
+
+/* Mutexes */
+
+#define SYS_CreateMutex		48
+#define SYS_DeleteMutex		49
+#define SYS_EnterMutex		50
+#define SYS_EnterMutexCond	51
+#define SYS_EnterMutexTimed	52
+#define SYS_LeaveMutex		53
+
+/* Monitores y variables de condición */
+
+#define SYS_CreateMonitor		54
+#define SYS_DeleteMonitor		55
+#define SYS_EnterMonitor		56
+#define SYS_EnterMonitorCond	57
+#define SYS_EnterMonitorTimed	58
+#define SYS_LeaveMonitor		59
+#define SYS_CreateCondition		60
+#define SYS_DeleteCondition		61
+#define SYS_WaitCondition		62
+#define SYS_WaitConditionTimed	63
+#define SYS_SignalCondition		64
+#define SYS_BroadcastCondition	65
+
+/* Pipes */
+
+#define SYS_CreatePipe		66
+#define SYS_DeletePipe		67
+#define SYS_GetPipe			68
+#define SYS_GetPipeCond		69
+#define SYS_GetPipeTimed	70
+#define SYS_PutPipe			71
+#define SYS_PutPipeCond		72
+#define SYS_PutPipeTimed	73
+#define SYS_AvailPipe		74
+
+/* Colas de mensajes */
+
+#define SYS_CreateMsgQueue		75
+#define SYS_DeleteMsgQueue		76
+#define SYS_GetMsgQueue			77
+#define SYS_GetMsgQueueCond		78
+#define SYS_GetMsgQueueTimed	79
+#define SYS_PutMsgQueue			80
+#define SYS_PutMsgQueueCond		81
+#define SYS_PutMsgQueueTimed	82
+#define SYS_AvailMsgQueue		83
+
+/* Consola */
+
+#define SYS_PutString		84
+#define SYS_GetChar			85
+#define SYS_GetCharCond		86
+#define SYS_GetCharTimed	87
+
+/* Arenas */
+
+#define SYS_CreateArena		88
+#define SYS_DeleteArena		89
+#define SYS_ArenaAlloc		90
+#define SYS_ArenaMark		91
+#define SYS_ArenaRelease	92
+
+/* Memoria por tarea */
+
+#define SYS_SetMemLimit		93
+#define SYS_SetMemReclaim	94
+
+/* Scheduler */
+
+#define SYS_SetMaxBoost		95
+#define SYS_GetSchedParams	96
+#define SYS_SetSchedParams	97
+
+/* Esperas periódicas */
+
+#define SYS_DelayUntil		98
+#define SYS_SetPeriod		99
+#define SYS_WaitNextPeriod	100
+
+/* Ids de tareas */
+
+#define SYS_GetTaskId		101
+#define SYS_GetTask			102
+#define SYS_DeleteTaskId	103
+#define SYS_AttachId		104
+#define SYS_DetachId		105
+#define SYS_SetPriorityId	106
+#define SYS_GetInfoId		107
+#define SYS_ReadyId			108
+#define SYS_SuspendId		109
+#define SYS_JoinId			110
+#define SYS_JoinTimedId		111
+#define SYS_SendId			112
+#define SYS_SendTimedId		113
+
+/* Buzones */
+
+#define SYS_SetMailbox		114
+#define SYS_PostMessage		115
+#define SYS_PostMessageTimed	116
+
+/* Llamadas sincrónicas */
+
+#define SYS_Call			117
+#define SYS_ReplyWait		118
+
+/* Flags de eventos */
+
+#define SYS_CreateFlags		119
+#define SYS_DeleteFlags		120
+#define SYS_SetFlags		121
+#define SYS_ClearFlags		122
+#define SYS_GetFlags		123
+#define SYS_WaitFlags		124
+#define SYS_WaitFlagsCond	125
+#define SYS_WaitFlagsTimed	126
+
+/* Colas de mensajes de longitud variable */
+
+#define SYS_CreateMsgQueueV		127
+#define SYS_DeleteMsgQueueV		128
+#define SYS_GetMsgV				129
+#define SYS_GetMsgVCond			130
+#define SYS_GetMsgVTimed		131
+#define SYS_PutMsgV				132
+#define SYS_PutMsgVCond			133
+#define SYS_PutMsgVTimed		134
+#define SYS_PeekMsgV			135
+#define SYS_AvailMsgV			136
+
+/* Pipes por bloques */
+
+#define SYS_CreateChunkedPipe	137
+#define SYS_SplicePipe			138
+
+/* Canales de difusión */
+
+#define SYS_CreateChannel		139
+#define SYS_DeleteChannel		140
+#define SYS_Subscribe			141
+#define SYS_Unsubscribe			142
+#define SYS_Publish				143
+#define SYS_PublishCond			144
+#define SYS_PublishTimed		145
+#define SYS_GetChannel			146
+#define SYS_GetChannelCond		147
+#define SYS_GetChannelTimed		148
+#define SYS_GetChannelLag		149
+
+/* Claves de TLS */
+
+#define SYS_CreateTLSKey		150
+#define SYS_DeleteTLSKey		151
+#define SYS_GetTLS				152
+#define SYS_SetTLS				153
+
+#define NUM_SYSCALLS		154
+
+#endif
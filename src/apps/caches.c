@@ -0,0 +1,18 @@
+#include <kernel.h>
+
+int
+caches_main(int argc, char *argv[])
+{
+	unsigned i, ncaches;
+	CacheInfo_t *ci, *info;
+
+	cprintk(WHITE, BLUE, "%-12s %6s %6s %6s %7s %7s %10s %10s %8s", "Cache", "Tamano",
+		"Slabs", "Objs", "En uso", "x slab", "Allocs", "Frees", "Ctors");
+	printk("\n");
+	info = GetCaches(&ncaches);
+	for ( i = 0, ci = info ; i < ncaches ; i++, ci++ )
+		printk("%-12.12s %6u %6u %6u %7u %7u %10u %10u %8u\n", GetName(ci->cache), ci->size,
+			ci->slabs, ci->objects, ci->in_use, ci->per_slab, ci->allocs, ci->frees, ci->ctors);
+	Free(info);
+	return 0;
+}
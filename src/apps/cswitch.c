@@ -0,0 +1,171 @@
+#include <kernel.h>
+
+/*
+Mide el costo de un cambio de contexto voluntario, en ciclos por ida y vuelta
+entre dos tareas de la misma prioridad, con mt_switch_fast() y con
+mt_context_switch(), que simula una interrupción (ver scheduler()).
+
+También mide el costo por cambio en una ronda de varias tareas que ceden la
+CPU, donde los bloques de control ya no están todos en la cache y pesa cuántas
+líneas de Task_t toca el cambio de contexto (ver kernel.h). Antes de separar la
+parte caliente, los campos que usa el cambio de contexto estaban dispersos en
+los bytes 16 a 304 de un Task_t de 340 bytes alineado a 4, es decir en 5 o 6
+líneas; ahora ocupan las 2 primeras líneas de un Task_t alineado a 64. Para
+comparar, compilar este archivo sobre ambas versiones y correr la ronda.
+
+Las tareas de la misma prioridad se ordenan por boost (ver mt_prio_cmp()), y el
+shell lo gana esperando el teclado; si tuviera más que las otras, Yield() lo
+devolvería a la CPU sin cambiar de tarea. Durante la medición todas corren con
+boost máximo cero, y los cambios voluntarios de las otras tareas confirman que
+cada vuelta cambió de contexto.
+*/
+
+#define NROUNDS 10000
+#define NTASKS 32
+#define MAX_TASKS 256
+
+static volatile bool stop;
+
+static int
+yielder(void *arg)
+{
+	while ( !stop )
+		Yield();
+	return 0;
+}
+
+static int
+replier(void *arg)
+{
+	Task_t *from = NULL;
+
+	while ( Receive(&from, NULL, NULL) && !stop )
+	{
+		Send(from, NULL, 0);
+		from = NULL;							// recibir de cualquiera
+	}
+	return 0;
+}
+
+static unsigned
+voluntary(Task_t **tasks, unsigned ntasks)
+{
+	TaskInfo_t info;
+	unsigned i, n = 0;
+
+	for ( i = 0 ; i < ntasks ; i++ )
+	{
+		GetInfo(tasks[i], &info);
+		n += info.nvcsw;
+	}
+	return n;
+}
+
+static void
+check(unsigned nswitches, unsigned expected)
+{
+	if ( nswitches < expected )
+		printk("cswitch: %u cambios de contexto de %u esperados\n", nswitches, expected);
+}
+
+static unsigned
+measure(TaskFunc_t func, unsigned nrounds, bool fast)
+{
+	TaskInfo_t info;
+	unsigned long long start;
+	unsigned i, cycles, nvcsw;
+	unsigned max_boost = CurrentTask()->max_boost;
+	Task_t *t;
+	int status;
+
+	GetInfo(CurrentTask(), &info);
+	SetMaxBoost(CurrentTask(), 0);
+	mt_fast_switch = fast;
+	stop = false;
+	t = CreateTask(func, 0, NULL, "cswitch", info.priority);
+	Attach(t);
+	SetMaxBoost(t, 0);
+	Ready(t);
+	Yield();									// que la otra tarea arranque
+
+	nvcsw = voluntary(&t, 1);
+	start = mt_rdtsc();
+	for ( i = 0 ; i < nrounds ; i++ )
+		if ( func == yielder )
+			Yield();
+		else
+		{
+			Send(t, NULL, 0);
+			Receive(NULL, NULL, NULL);
+		}
+	cycles = (unsigned) (mt_rdtsc() - start) / nrounds;
+	check(voluntary(&t, 1) - nvcsw, nrounds);
+
+	stop = true;
+	if ( func == replier )
+		Send(t, NULL, 0);
+	Join(t, &status);
+	mt_fast_switch = true;
+	SetMaxBoost(CurrentTask(), max_boost);
+	return cycles;
+}
+
+static unsigned
+measure_ring(unsigned nrounds, unsigned ntasks, bool fast)
+{
+	static Task_t *tasks[MAX_TASKS];
+	TaskInfo_t info;
+	unsigned long long start;
+	unsigned i, cycles, nvcsw;
+	unsigned max_boost = CurrentTask()->max_boost;
+	int status;
+
+	GetInfo(CurrentTask(), &info);
+	SetMaxBoost(CurrentTask(), 0);
+	mt_fast_switch = fast;
+	stop = false;
+	for ( i = 1 ; i < ntasks ; i++ )
+	{
+		tasks[i] = CreateTask(yielder, 0, NULL, "cswitch", info.priority);
+		Attach(tasks[i]);
+		SetMaxBoost(tasks[i], 0);
+		Ready(tasks[i]);
+	}
+	Yield();									// que las otras tareas arranquen
+
+	nvcsw = voluntary(tasks + 1, ntasks - 1);
+	start = mt_rdtsc();
+	for ( i = 0 ; i < nrounds ; i++ )
+		Yield();
+	cycles = (unsigned) (mt_rdtsc() - start) / nrounds / ntasks;
+	check(voluntary(tasks + 1, ntasks - 1) - nvcsw, nrounds * (ntasks - 1));
+
+	stop = true;
+	for ( i = 1 ; i < ntasks ; i++ )
+		Join(tasks[i], &status);
+	mt_fast_switch = true;
+	SetMaxBoost(CurrentTask(), max_boost);
+	return cycles;
+}
+
+int
+cswitch_main(int argc, char *argv[])
+{
+	unsigned nrounds = argc > 1 ? atoi(argv[1]) : NROUNDS;
+	unsigned ntasks = argc > 2 ? atoi(argv[2]) : NTASKS;
+
+	if ( !nrounds )
+		nrounds = NROUNDS;
+	ntasks = min(max(ntasks, 2), MAX_TASKS);
+	printk("Ciclos por ida y vuelta (%u vueltas):\n", nrounds);
+	printk("                     Yield   Send/Receive\n");
+	printk("    interrupcion  %8u       %8u\n",
+		measure(yielder, nrounds, false), measure(replier, nrounds, false));
+	printk("    rapido        %8u       %8u\n",
+		measure(yielder, nrounds, true), measure(replier, nrounds, true));
+	printk("Ciclos por cambio en una ronda de %u tareas (Task_t de %u bytes, %u lineas calientes):\n",
+		ntasks, sizeof(Task_t), __builtin_offsetof(Task_t, from) / CACHE_LINE);
+	printk("    interrupcion  %8u\n", measure_ring(nrounds, ntasks, false));
+	printk("    rapido        %8u\n", measure_ring(nrounds, ntasks, true));
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include <kernel.h>
+
+/*
+Crea muchas fibras en una tarea y mide el costo de un cambio de fibra con
+YieldFiber() y el de despertar fibras bloqueadas en una cola de mensajes que
+alimenta otra tarea, que obliga a la tarea a bloquearse mientras todas sus
+fibras esperan.
+*/
+
+#define NFIBERS		20000
+#define NYIELDS		4
+#define QUEUE_LEN	64
+
+static unsigned nmsgs, sum;
+
+static void
+yielder(void *arg)
+{
+	unsigned i;
+
+	for ( i = 0 ; i < NYIELDS ; i++ )
+		YieldFiber();
+}
+
+static void
+reader(void *arg)
+{
+	unsigned n;
+
+	GetMsgQueueFiber(arg, &n);
+	sum += n;
+}
+
+static int
+producer(void *arg)
+{
+	unsigned i;
+
+	for ( i = 1 ; i <= nmsgs ; i++ )
+		PutMsgQueue(arg, &i);
+	return 0;
+}
+
+// Ciclos por operación, sin división de 64 bits
+static unsigned
+per_op(unsigned long long cycles, unsigned nops)
+{
+	while ( cycles > -1U )
+	{
+		cycles >>= 1;
+		nops >>= 1;
+	}
+	return nops ? (unsigned) cycles / nops : 0;
+}
+
+// Crea hasta n fibras, retorna las que pudo crear
+static unsigned
+create(FiberFunc_t func, void *arg, unsigned n, unsigned stacksize)
+{
+	unsigned i;
+
+	for ( i = 0 ; i < n && CreateFiber(func, arg, stacksize) ; i++ )
+		;
+	return i;
+}
+
+int
+fibers_main(int argc, char *argv[])
+{
+	unsigned nfibers = argc > 1 ? atoi(argv[1]) : NFIBERS;
+	unsigned stacksize = argc > 2 ? atoi(argv[2]) : FIBER_STKSIZE;
+	unsigned long long start, cycles;
+	TaskInfo_t info;
+	MsgQueue_t *mq;
+	unsigned n;
+	Task_t *t;
+	int status;
+
+	if ( !nfibers )
+		nfibers = NFIBERS;
+
+	// Creación y cambios de fibra
+	start = mt_rdtsc();
+	n = create(yielder, NULL, nfibers, stacksize);
+	cycles = mt_rdtsc() - start;
+	GetInfo(CurrentTask(), &info);
+	start = mt_rdtsc();
+	JoinFibers();
+	printk("%u fibras de %u bytes, %u bytes en uso\n", n, stacksize, info.mem_current);
+	if ( n < nfibers )
+		cprintk(LIGHTRED, BLACK, "Se alcanzo el limite de memoria\n");
+	printk("Ciclos por creacion de fibra:   %8u\n", per_op(cycles, n));
+	printk("Ciclos por cambio de fibra:     %8u\n", per_op(mt_rdtsc() - start, n * (NYIELDS + 1)));
+
+	// Fibras bloqueadas en una cola que alimenta otra tarea
+	mq = CreateMsgQueue("fibers", QUEUE_LEN, sizeof(unsigned));
+	sum = 0;
+	nmsgs = n = create(reader, mq, nfibers, stacksize);
+	t = CreateTask(producer, 0, mq, "fibers", info.priority);
+	Attach(t);
+	start = mt_rdtsc();
+	Ready(t);
+	JoinFibers();
+	cycles = mt_rdtsc() - start;
+	printk("Ciclos por mensaje a una fibra: %8u\n", per_op(cycles, n));
+	Join(t, &status);
+	DeleteMsgQueue(mq);
+	if ( sum != n * (n + 1) / 2 )
+	{
+		cprintk(LIGHTRED, BLACK, "Suma incorrecta: %u\n", sum);
+		return 2;
+	}
+	return 0;
+}
@@ -9,28 +9,17 @@ kill_main(int argc, char *argv[])
 		return 1;
 	}
 
-	Task_t *task = (Task_t *) strtoul(argv[1], NULL, 16);
+	TaskId_t id = strtoul(argv[1], NULL, 16);
 	int status = argc == 3 ? atoi(argv[2]) : 0;
 
 	// Verificar que la tarea exista
-	unsigned ntasks;
-	TaskInfo_t *info;
-	bool found;
-	for ( found = false, info = GetTasks(&ntasks) ; ntasks-- ; info++ )
-		if ( info->task == task )
-		{
-			found = true;
-			break;
-		}
-	Free(info);
-
-	if ( !found )
+	if ( !GetTask(id) )
 	{
 		cprintk(LIGHTRED, BLACK, "Tarea inexistente\n");
 		return 2;
 	}
 
-	if ( !DeleteTask(task, status) )
+	if ( !DeleteTaskId(id, status) )
 	{
 		cprintk(LIGHTRED, BLACK, "Tarea protegida o terminando\n");
 		return 3;
@@ -0,0 +1,53 @@
+#include <kernel.h>
+
+/*
+Mide en ciclos el costo de tomar y liberar sin competencia un semáforo y un
+mutex, por el camino rápido con lock cmpxchg y por el camino lento con
+interrupciones deshabilitadas, que es el que usaban antes todas las
+operaciones. mt_fast_locks elige el camino, como mt_fast_switch en cswitch.
+*/
+
+#define NROUNDS 100000
+
+static unsigned
+measure(bool mutex, unsigned nrounds, bool fast)
+{
+	unsigned long long start;
+	Semaphore_t *sem = CreateSem("locks", 1);
+	Mutex_t *mut = CreateMutex("locks");
+	unsigned i, cycles;
+
+	mt_fast_locks = fast;
+	start = mt_rdtsc();
+	for ( i = 0 ; i < nrounds ; i++ )
+		if ( mutex )
+		{
+			EnterMutex(mut);
+			LeaveMutex(mut);
+		}
+		else
+		{
+			WaitSem(sem);
+			SignalSem(sem);
+		}
+	cycles = (unsigned) (mt_rdtsc() - start) / nrounds;
+	mt_fast_locks = true;
+
+	DeleteMutex(mut);
+	DeleteSem(sem);
+	return cycles;
+}
+
+int
+locks_main(int argc, char *argv[])
+{
+	unsigned nrounds = argc > 1 ? atoi(argv[1]) : NROUNDS;
+
+	if ( !nrounds )
+		nrounds = NROUNDS;
+	printk("Ciclos por tomar y liberar sin competencia (%u vueltas):\n", nrounds);
+	printk("                    lento   cmpxchg\n");
+	printk("    semaforo     %8u  %8u\n", measure(false, nrounds, false), measure(false, nrounds, true));
+	printk("    mutex        %8u  %8u\n", measure(true, nrounds, false), measure(true, nrounds, true));
+	return 0;
+}
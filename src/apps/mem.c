@@ -0,0 +1,50 @@
+#include <kernel.h>
+
+#define MAP_COLS	64
+#define MAP_ROWS	8
+
+int
+mem_main(int argc, char *argv[])
+{
+	HeapInfo_t h0, h;
+	unsigned i, frag, secs = argc > 1 ? atoi(argv[1]) : 1;
+	char map[MAP_ROWS * MAP_COLS + 1];
+
+	// Medir tasas de alocación en un intervalo
+	if ( !secs )
+		secs = 1;
+	GetHeapInfo(&h0);
+	Delay(secs * 1000);
+	GetHeapInfo(&h);
+
+	// Fragmentación del heap de bloques chicos; la de las páginas no es
+	// comparable porque los bloques de páginas tienen un tamaño máximo
+	frag = h.heap_free >= 100 ? 100 - min(h.heap_largest / (h.heap_free / 100), 100) : 0;
+
+	cprintk(WHITE, BLUE, "%-40s", "Memoria");
+	printk("\n");
+	printk("Tamano    %10u     En uso     %10u\n", h.size, h.in_use);
+	printk("Maximo    %10u     Libre      %10u\n", h.peak, h.free);
+	printk("Bloques   %10u     Mayor      %10u\n", h.free_blocks, h.largest_free);
+	printk("Heap      %10u     Mayor      %10u     Fragm. %3u%%\n", h.heap_free, h.heap_largest, frag);
+	printk("Paginas   %10u     DMA        %10u\n", h.free_pages, h.dma_free_pages);
+	printk("Allocs    %10u     Frees      %10u\n", h.allocs, h.frees);
+	printk("Allocs/s  %10u     Frees/s    %10u\n", (h.allocs - h0.allocs) / secs, (h.frees - h0.frees) / secs);
+
+	cprintk(WHITE, BLUE, "%-40s", "Pedidos por tamano");
+	printk("\n");
+	for ( i = 0 ; i < HEAP_BUCKETS ; i++ )
+	{
+		if ( i < HEAP_BUCKETS - 1 )
+			printk("<= %-6u %10u%s", 16 << i, h.hist[i], i % 3 == 2 ? "\n" : "   ");
+		else
+			printk(">  %-6u %10u\n", 16 << (i - 1), h.hist[i]);
+	}
+
+	cprintk(WHITE, BLUE, "%-64s", "Mapa (. libre  : > 1/2 libre  + < 1/2 libre  # ocupado)");
+	printk("\n");
+	GetHeapMap(map, MAP_ROWS * MAP_COLS);
+	for ( i = 0 ; i < MAP_ROWS ; i++ )
+		printk("%.*s\n", MAP_COLS, map + i * MAP_COLS);
+	return 0;
+}
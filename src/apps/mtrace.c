@@ -0,0 +1,22 @@
+#include <kernel.h>
+
+int
+mtrace_main(int argc, char *argv[])
+{
+	if ( argc != 2 || (strcmp(argv[1], "on") && strcmp(argv[1], "off") && strcmp(argv[1], "dump")) )
+	{
+		printk("Uso: mtrace on|off|dump\n");
+		return 1;
+	}
+	if ( !mt_malloc_trace(strcmp(argv[1], "on") == 0) )
+	{
+		cprintk(LIGHTRED, BLACK, "Kernel compilado sin trazas (make TRACE=yes)\n");
+		return 2;
+	}
+	if ( strcmp(argv[1], "dump") == 0 )
+	{
+		printk("Volcando trazas por COM1...\n");
+		printk("%u registros\n", mt_malloc_trace_dump());
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include <kernel.h>
+
+/*
+Mide el tiempo de ida y vuelta de un pedido y su respuesta entre dos tareas de
+la misma prioridad, con Send() y Receive() por separado y con Call() y
+ReplyWait(), que pasan la CPU directamente a la otra tarea.
+*/
+
+#define NROUNDS 10000
+
+static volatile bool stop;
+
+static int
+server(void *arg)
+{
+	Task_t *from = NULL;
+	unsigned req, size = sizeof req;
+
+	while ( Receive(&from, &req, &size) && !stop )
+	{
+		req++;
+		Send(from, &req, sizeof req);
+		from = NULL;							// recibir de cualquiera
+		size = sizeof req;
+	}
+	return 0;
+}
+
+static int
+rpc_server(void *arg)
+{
+	Task_t *client = NULL, *from = NULL;
+	unsigned req, size = sizeof req;
+
+	while ( ReplyWait(client, &req, sizeof req, &from, &req, &size) && !stop )
+	{
+		req++;
+		client = from;
+		from = NULL;
+		size = sizeof req;
+	}
+	return 0;
+}
+
+static bool
+measure(TaskFunc_t func, unsigned nrounds, unsigned *cycles, unsigned *tenths)
+{
+	TaskInfo_t info;
+	unsigned long long start;
+	unsigned i, n, size;
+	Task_t *t, *from;
+	Time_t t0;
+	int status;
+
+	GetInfo(CurrentTask(), &info);
+	stop = false;
+	t = CreateTask(func, 0, NULL, "pingpong", info.priority);
+	Attach(t);
+	Ready(t);
+	Yield();									// que el servidor se bloquee
+
+	t0 = Time();
+	start = mt_rdtsc();
+	for ( n = i = 0 ; i < nrounds ; i++ )
+	{
+		size = sizeof n;
+		if ( func == rpc_server )
+			Call(t, &n, sizeof n, &n, &size);
+		else
+		{
+			from = t;
+			Send(t, &n, sizeof n);
+			Receive(&from, &n, &size);
+		}
+	}
+	*cycles = (unsigned) (mt_rdtsc() - start) / nrounds;
+	*tenths = (unsigned) (Time() - t0) * 10000 / nrounds;
+
+	stop = true;
+	Send(t, &n, sizeof n);
+	Join(t, &status);
+	return n == nrounds;
+}
+
+int
+pingpong_main(int argc, char *argv[])
+{
+	unsigned nrounds = argc > 1 ? atoi(argv[1]) : NROUNDS;
+	unsigned cycles, tenths;
+	bool ok;
+
+	if ( !nrounds )
+		nrounds = NROUNDS;
+	printk("Ida y vuelta (%u vueltas):\n", nrounds);
+	printk("                      ciclos         us\n");
+	ok = measure(server, nrounds, &cycles, &tenths);
+	printk("    Send/Receive    %8u   %6u.%u\n", cycles, tenths / 10, tenths % 10);
+	ok = measure(rpc_server, nrounds, &cycles, &tenths) && ok;
+	printk("    Call/ReplyWait  %8u   %6u.%u\n", cycles, tenths / 10, tenths % 10);
+	if ( !ok )
+	{
+		cprintk(LIGHTRED, BLACK, "Respuestas incorrectas\n");
+		return 2;
+	}
+	return 0;
+}
@@ -115,11 +115,11 @@ task_state(Task_t *task)
 static int
 clock(void *arg)
 {
+	SetPeriod(1000);
 	forever
 	{
 		mprint(CLK_FG, TIME_COL, TIME_LIN, TIME_FMT, seconds);
-		Delay(1000);
-		++seconds;
+		seconds += 1 + WaitNextPeriod();		// sin derivar, aun con overruns
 	}
 	return 0;
 }
@@ -158,11 +158,12 @@ consumer(void *arg)
 static int
 monitor(void *args)
 {
+	SetPeriod(TMON);
 	forever
 	{
 		mprint(MON_FG, PRODSTAT_COL, PRODSTAT_LIN, PRODSTAT_FMT, task_state(prod));
 		mprint(MON_FG, CONSSTAT_COL, CONSSTAT_LIN, CONSSTAT_FMT, task_state(cons));
-		Delay(TMON);
+		WaitNextPeriod();
 	}
 	return 0;
 }
@@ -0,0 +1,47 @@
+#include <kernel.h>
+
+static char *
+name(void *p)
+{
+	char *s = GetName(p);
+	return s ? s : "";
+}
+
+int
+sched_main(int argc, char *argv[])
+{
+	SchedParams_t p;
+	TaskInfo_t *info, *ti;
+	unsigned ntasks;
+
+	if ( argc != 1 && argc != 6 )
+	{
+		printk("Uso: sched [latencia ranura_min ranura_max factor boost]\n");
+		return 1;
+	}
+	if ( argc == 6 )
+	{
+		p.latency = atoi(argv[1]);
+		p.min_slice = atoi(argv[2]);
+		p.max_slice = atoi(argv[3]);
+		p.hog_factor = atoi(argv[4]);
+		p.max_boost = atoi(argv[5]);
+		if ( !SetSchedParams(&p) )
+		{
+			cprintk(LIGHTRED, BLACK, "Parametros invalidos\n");
+			return 2;
+		}
+	}
+
+	GetSchedParams(&p);
+	printk("Latencia %u ms, ranura %u-%u ms, factor %u, boost %u\n",
+		p.latency, p.min_slice, p.max_slice, p.hog_factor, p.max_boost);
+
+	cprintk(WHITE, BLUE, "%-80s", "   Tarea Nombre             Prioridad Boost  Ranura  Voluntarios Involuntarios");
+	info = GetTasks(&ntasks);
+	for ( ti = info ; ntasks-- ; ti++ )
+		printk("%8x %-18.18s %10u %5u %7u %12u %13u\n", ti->id, name(ti->task),
+			ti->priority, ti->boost, ti->slice, ti->nvcsw, ti->nivcsw);
+	Free(info);
+	return 0;
+}
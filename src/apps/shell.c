@@ -5,6 +5,7 @@
 #define NAMESIZE 30
 #define NARGS 20
 #define NHIST 10
+#define NGROUPS 8		// grupos viejos del shell que todavía tienen tareas
 
 typedef int (*main_func)(int argc, char *argv[]);
 
@@ -39,9 +40,18 @@ cmdtab[] =
 	{	"events",		events_main,		""					},
 	{	"disk",			disk_main,			""					},
 	{	"ts", 			ts_main,			"[consola...]"		},
+	{	"sched",		sched_main,			"[parametros]"		},
+	{	"cswitch",		cswitch_main,		"[vueltas [tareas]]"	},
+	{	"fibers",		fibers_main,		"[fibras [stack]]"	},
+	{	"pingpong",		pingpong_main,		"[vueltas]"			},
+	{	"locks",		locks_main,			"[vueltas]"			},
 	{	"kill",			kill_main,			"tarea [status]"	},
 	{	"test",			test_main,			""					},
 	{	"lspci",		lspci_main, 		"lista PCI"  		},
+	{	"stack",		stack_main,			"[profundidad]"		},
+	{	"caches",		caches_main,		""					},
+	{	"mem",			mem_main,			"[segundos]"		},
+	{	"mtrace",		mtrace_main,		"on|off|dump"		},
 	{															}
 };
 
@@ -69,6 +79,52 @@ detached_app(void *arg)
 	return ex.func(ex.nargs, ex.args);
 }
 
+static void
+run_task(Task_t *t, bool wait)
+{
+	int status;
+
+	if ( !t )
+	{
+		cprintk(LIGHTRED, BLACK, "No se pudo crear la tarea\n");
+		return;
+	}
+	if ( wait )							// correr tarea y esperarla
+	{
+		Attach(t);
+		Ready(t);
+		while ( !Join(t, &status) )
+			;
+		if ( status != 0 )
+		{
+			cprintk(LIGHTRED, BLACK, "\rStatus: %d\n", status);
+			mt_cons_clreol();
+		}
+	}
+	else								// correr tarea en background
+	{
+		cprintk(LIGHTGREEN, BLACK, "\rTask: %x\n", t);
+		mt_cons_clreol();
+		Ready(t);
+	}
+}
+
+/*
+Los grupos que el shell deja con el comando group pueden conservar tareas en
+background; se eliminan cuando se vacían.
+*/
+static void
+sweep_groups(TaskGroup_t **stale, unsigned *nstale)
+{
+	unsigned i;
+
+	for ( i = 0 ; i < *nstale ; )
+		if ( DeleteGroup(stale[i]) )
+			stale[i] = stale[--*nstale];
+		else
+			i++;
+}
+
 static inline int
 next(int n)
 {
@@ -94,11 +150,25 @@ shell_main(int argc, char **argv)
 	unsigned fg, bg;
 	TaskInfo_t info;
 	char *hist[NHIST];
+	Arena_t *arena;
 	int pos, hfirst, hcur, hlast;
 	bool wait, found;
+	const char *prog;
+	unsigned i;
+	TaskGroup_t *base = GetGroup(CurrentTask());	// grupo inicial
+	TaskGroup_t *mine = NULL;					// grupo creado por el shell
+	TaskGroup_t *stale[NGROUPS];
+	unsigned nstale = 0;
 
+	// La historia vive en una arena de la tarea, que se libera entera al
+	// salir del shell o si la tarea muere
+	if ( !(arena = CreateArena("shell", NHIST * BUFSIZE, CurrentTask())) )
+	{
+		cprintk(LIGHTRED, BLACK, "No hay memoria para el shell\n");
+		return 1;
+	}
 	for ( hcur = 0 ; hcur < NHIST ; hcur++ )
-		hist[hcur] = Malloc(BUFSIZE);
+		hist[hcur] = ArenaAlloc(arena, BUFSIZE);
 	hfirst = hcur = hlast = -1;
 
 	mt_cons_getattr(&fg, &bg);
@@ -194,6 +264,8 @@ shell_main(int argc, char **argv)
 			strcpy(hist[hlast], line);
 		}
 
+		sweep_groups(stale, &nstale);
+
 		/* Comandos internos */
 		if ( strcmp(ex.args[0], "help") == 0 )
 		{
@@ -201,17 +273,28 @@ shell_main(int argc, char **argv)
 			printk("\thelp\n");
 			printk("\texit [status]\n");
 			printk("\treboot\n");
+			printk("\tgroup nombre cuota periodo [peso]\n");
 			printk("Aplicaciones:\n");\
 			for ( cp = cmdtab ; cp->name ; cp++ )
 				printk("\t%s %s\n", cp->name, cp->params);
+			if ( mt_program_name(0) )
+				printk("Programas de usuario:\n");
+			for ( i = 0 ; (prog = mt_program_name(i)) ; i++ )
+				printk("\t%s\n", prog);
 			continue;
 		}
 
 		if ( strcmp(ex.args[0], "exit") == 0 )
 		{
+			if ( mine )
+			{
+				SetGroup(CurrentTask(), base);
+				if ( !DeleteGroup(mine) && nstale < NGROUPS )
+					stale[nstale++] = mine;
+			}
+			sweep_groups(stale, &nstale);
 			mt_cons_setattr(fg, bg);
-			for ( hcur = 0 ; hcur < NHIST ; hcur++ )
-				Free(hist[hcur]);
+			DeleteArena(arena);
 			return ex.nargs > 1 ? atoi(ex.args[1]) : 0;
 		}
 
@@ -222,6 +305,39 @@ shell_main(int argc, char **argv)
 				outb(0x64, 0xFE);
 		}
 
+		/*
+		Grupo nuevo para el shell y lo que ejecute, ver CreateGroup(). Reemplaza
+		al anterior creado por el shell, que se elimina cuando se vacía.
+		*/
+		if ( strcmp(ex.args[0], "group") == 0 )
+		{
+			TaskGroup_t *g;
+
+			if ( ex.nargs < 4 )
+			{
+				printk("Uso: group nombre cuota periodo [peso]\n");
+				continue;
+			}
+			if ( nstale == NGROUPS )
+			{
+				cprintk(LIGHTRED, BLACK, "Demasiados grupos con tareas en ejecucion\n");
+				continue;
+			}
+			g = CreateGroup(ex.args[1], base);
+			if ( !SetGroupQuota(g, atoi(ex.args[2]), atoi(ex.args[3])) ||
+				(ex.nargs > 4 && !SetGroupShares(g, atoi(ex.args[4]))) )
+			{
+				DeleteGroup(g);
+				cprintk(LIGHTRED, BLACK, "Parametros invalidos\n");
+				continue;
+			}
+			SetGroup(CurrentTask(), g);
+			if ( mine && !DeleteGroup(mine) )
+				stale[nstale++] = mine;
+			mine = g;
+			continue;
+		}
+
 		/* Aplicaciones */
 		found = false;
 		for ( cp = cmdtab ; cp->name ; cp++ )
@@ -230,31 +346,25 @@ shell_main(int argc, char **argv)
 				found = true;
 				ex.func = cp->func;
 				if ( wait )						// correr app y esperarla
-				{
-					int status;
-
-					Task_t *t = CreateTask(attached_app, MAIN_STKSIZE, &ex, ex.args[0], DEFAULT_PRIO);
-					Attach(t);
-					Ready(t);
-					while ( !Join(t, &status) )
-						;
-					if ( status != 0 )
-					{
-						cprintk(LIGHTRED, BLACK, "\rStatus: %d\n", status);
-						mt_cons_clreol();
-					}
-				}
+					run_task(CreateTask(attached_app, MAIN_STKSIZE, &ex, ex.args[0], DEFAULT_PRIO), true);
 				else							// correr app en background
 				{
 					Task_t *t = CreateTask(detached_app, MAIN_STKSIZE, &ex, ex.args[0], DEFAULT_PRIO);
-					cprintk(LIGHTGREEN, BLACK, "\rTask: %x\n", t);
-					mt_cons_clreol();
-					Ready(t);
-					Send(t, NULL, 0);			// esperar que copie los parámetros
+					run_task(t, false);
+					if ( t )
+						Send(t, NULL, 0);		// esperar que copie los parámetros
 				}
 				break;
 			}
 
+		/* Programas de usuario, los argumentos se copian a su stack */
+		if ( !found )
+		{
+			Task_t *t = mt_exec(ex.args[0], ex.nargs, ex.args, DEFAULT_PRIO);
+			if ( (found = t != NULL) )
+				run_task(t, wait);
+		}
+
 		if ( !found )
 			cprintk(LIGHTRED, BLACK, "Comando %s desconocido\n", ex.args[0]);
 	}
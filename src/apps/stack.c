@@ -0,0 +1,73 @@
+#include <kernel.h>
+
+#define FRAMESIZE 1000
+
+static char *
+name(void *p)
+{
+	char *s = GetName(p);
+	return s ? s : "";
+}
+
+// Consume aproximadamente FRAMESIZE bytes de stack por nivel
+static unsigned
+recurse(unsigned levels)
+{
+	volatile char buf[FRAMESIZE];
+	unsigned i, sum = 0;
+
+	for ( i = 0 ; i < FRAMESIZE ; i++ )
+		buf[i] = i;
+	if ( levels )
+		sum = recurse(levels - 1);
+	return sum + buf[levels % FRAMESIZE];
+}
+
+static int
+deep(void *arg)
+{
+	TaskInfo_t info;
+
+	recurse((unsigned) arg);
+	GetInfo(CurrentTask(), &info);
+	printk("Profundidad %u: %u paginas de stack\n", (unsigned) arg, info.stack_pages);
+	return 0;
+}
+
+int
+stack_main(int argc, char *argv[])
+{
+	unsigned i, ntasks, pages = 0;
+	TaskInfo_t *ti, *info;
+	Task_t *t;
+	int status;
+
+	if ( argc > 2 )
+	{
+		cprintk(LIGHTRED, BLACK, "Uso: stack [profundidad]\n");
+		return 1;
+	}
+
+	// Con argumento, probar una tarea con stack de MAIN_STKSIZE que se
+	// desborda si la profundidad es suficiente
+	if ( argc == 2 )
+	{
+		t = CreateTask(deep, MAIN_STKSIZE, (void *) atoi(argv[1]), "deep", DEFAULT_PRIO);
+		Attach(t);
+		Ready(t);
+		Join(t, &status);
+		printk("Status: %d\n", status);
+		return 0;
+	}
+
+	// Sin argumentos, listar las páginas de stack de cada tarea
+	info = GetTasks(&ntasks);
+	for ( i = 0, ti = info ; i < ntasks ; i++, ti++ )
+	{
+		printk("%8x %-18.18s %3u paginas\n", ti->task, name(ti->task), ti->stack_pages);
+		pages += ti->stack_pages;
+	}
+	Free(info);
+	printk("Total: %u tareas, %u kB de stack\n", ntasks, pages * PAGE_SIZE / 1024);
+	return 0;
+}
@@ -1,10 +1,13 @@
 #include <kernel.h>
 
 static const char *title  = 
-	"   Tarea Nombre       Consola  Prioridad Estado    Esperando             Timeout";
+	"   Tarea Nombre             C  Prio Grupo    Estado    Esperando        Timeout ";
+
+static const char *group_title  = 
+	"Grupo        Padre        Tareas   Peso   Cuota ms    Usado Limitado   Total ms ";
 
 static const char *foot  = 
-	"       ENTER, ESPACIO, BS: scroll      ESC: reset scroll      S: salir          ";
+	"   ENTER, ESPACIO, BS: scroll    ESC: reset scroll    G: grupos    S: salir     ";
 
 static char *
 name(void *p)
@@ -14,7 +17,7 @@ name(void *p)
 }
 
 static bool
-getuser(unsigned *skip)
+getuser(unsigned *skip, bool *groups)
 {
 	int c;
 
@@ -23,6 +26,11 @@ getuser(unsigned *skip)
 		case 'S':
 		case 's':
 			return false;
+		case 'G':
+		case 'g':
+			*groups = !*groups;
+			*skip = 0;
+			return true;
 		case ' ':
 		case '\r':
 			++*skip;
@@ -38,10 +46,32 @@ getuser(unsigned *skip)
 	return true;
 }
 
+// Muestra una página de grupos a partir de la fila 1, retorna la fila siguiente
+static unsigned
+show_groups(unsigned skip)
+{
+	GroupInfo_t *info, *gi;
+	unsigned i, n, ngroups;
+
+	info = GetGroups(&ngroups);
+	for ( n = 0, i = 1, gi = info ; i < 24 && ngroups-- ; gi++ )
+	{
+		if ( n++ < skip )
+			continue;
+		mt_cons_gotoxy(0, i++);
+		cprintk(gi->throttled ? LIGHTRED : WHITE, BLACK, "%-12.12s %-12.12s %6u %5u%% %4u/%-5u %8u %8u %10u",
+			name(gi->group), gi->parent ? name(gi->parent) : "", gi->ntasks, gi->weight * 100 / DEFAULT_SHARES,
+			gi->quota, gi->period, gi->used, gi->nthrottled, (unsigned) gi->usage);
+	}
+	Free(info);
+	return i;
+}
+
 int
 ts_main(int argc, char *argv[])
 {
 	unsigned i, ntasks, n, skip;
+	bool groups = false;
 	TaskInfo_t *ti, *info;
 	bool enabled[NVCONS];
 	bool check_cons = false;				// por defecto habilitar todas las consolas
@@ -56,12 +86,22 @@ ts_main(int argc, char *argv[])
 	}
 
 	mt_cons_clear();
-	cprintk(WHITE, BLUE, "%s", title);
 	mt_cons_gotoxy(0, 24);
 	cprintk(WHITE, BLUE, "%s", foot);
 	skip = 0;
 	do
 	{
+		mt_cons_gotoxy(0, 0);
+		cprintk(WHITE, BLUE, "%s", groups ? group_title : title);
+		if ( groups )
+		{
+			for ( i = show_groups(skip) ; i < 24 ; i++ )
+			{
+				mt_cons_gotoxy(0, i);
+				mt_cons_clreol();
+			}
+			continue;
+		}
 		info = GetTasks(&ntasks);
 		for ( n = 0, i = 1, ti = info ; i < 24 && ntasks-- ; ti++ )
 		{
@@ -70,8 +110,8 @@ ts_main(int argc, char *argv[])
 			mt_cons_gotoxy(0, i++);
 			char namebuf[20];
 			sprintf(namebuf, ti->protected ? "[%.16s]" : "%.18s", name(ti->task));
-			cprintk(WHITE, BLACK, "%8x %-18s %u %10u %-9s %-18.18s", ti->task, namebuf, 
-				ti->consnum, ti->priority, statename(ti->state), name(ti->waiting));
+			cprintk(WHITE, BLACK, "%8x %-18s %u %5u %-8.8s %-9s %-13.13s", ti->id, namebuf, 
+				ti->consnum, ti->priority, name(ti->group), statename(ti->state), name(ti->waiting));
 			if ( ti->is_timeout )
 				cprintk(WHITE, BLACK, " %10u", ti->timeout);
 			else
@@ -84,7 +124,7 @@ ts_main(int argc, char *argv[])
 		}
 		Free(info);
 	}
-	while ( getuser(&skip) );
+	while ( getuser(&skip, &groups) );
 	mt_cons_clear();
 	mt_cons_cursor(cursor);	
 	return 0;
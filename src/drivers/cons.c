@@ -54,7 +54,7 @@ static void
 init_vcons(unsigned n)
 {
 	console *cons = &vcons[n];
-	cons->vidmem = Malloc(VIDSIZE);
+	cons->vidmem = mt_kalloc(VIDSIZE);
 	memcpy(cons->vidmem, real_console.vidmem, VIDSIZE);
 	memcpy(&cons->status, &real_console.status, sizeof cons->status);
 }
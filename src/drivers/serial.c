@@ -0,0 +1,55 @@
+#include <kernel.h>
+
+/*
+	Salida por el puerto serie COM1, por encuesta y sin interrupciones.
+	Se usa para volcar datos binarios a la máquina anfitriona, por ejemplo
+	las trazas del heap (ver heap.c). El puerto se programa a 115200 baudios,
+	8 bits, sin paridad, la primera vez que se usa.
+*/
+
+#define COM1			0x3F8
+
+#define THR				0						// registro de transmisión
+#define DLL				0						// divisor, parte baja (con DLAB)
+#define IER				1						// habilitación de interrupciones
+#define DLM				1						// divisor, parte alta (con DLAB)
+#define FCR				2						// control de FIFO
+#define LCR				3						// control de línea
+#define MCR				4						// control de módem
+#define LSR				5						// estado de línea
+
+#define LCR_DLAB		0x80					// acceso al divisor
+#define LCR_8N1			0x03					// 8 bits, sin paridad, 1 stop
+#define LSR_THRE		0x20					// registro de transmisión vacío
+
+static bool initialized;
+
+/*
+--------------------------------------------------------------------------------
+mt_serial_write - envía n bytes por COM1, esperando que se transmitan
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_serial_write(const void *buf, unsigned n)
+{
+	const unsigned char *p = buf;
+
+	if ( !initialized )
+	{
+		outb(COM1 + IER, 0);
+		outb(COM1 + LCR, LCR_DLAB);
+		outb(COM1 + DLL, 1);					// 115200 baudios
+		outb(COM1 + DLM, 0);
+		outb(COM1 + LCR, LCR_8N1);
+		outb(COM1 + FCR, 0xC7);					// FIFO habilitada y vacía
+		outb(COM1 + MCR, 0x03);					// DTR y RTS
+		initialized = true;
+	}
+	while ( n-- )
+	{
+		while ( !(inb(COM1 + LSR) & LSR_THRE) )
+			;
+		outb(COM1 + THR, *p++);
+	}
+}
@@ -0,0 +1,318 @@
+#include <kernel.h>
+
+/*
+Canales de difusión: un productor publica cada mensaje una sola vez en un
+buffer circular y cada suscriptor lo lee con su propio cursor, de modo que la
+memoria y las copias no dependen de la cantidad de suscriptores. Los mensajes
+se numeran con una secuencia; el mensaje n está en la posición n & (nmsgs - 1).
+nmsgs es una potencia de dos para que la posición siga siendo correlativa
+cuando la secuencia da la vuelta.
+
+Si un suscriptor se atrasa más que el tamaño del buffer, según la política del
+canal el productor espera (ChanBlock) o el suscriptor pierde los mensajes más
+viejos (ChanLag), que se cuentan en GetChannelLag(). Cada publicación
+despierta juntos a todos los suscriptores que esperan.
+*/
+
+struct Channel_t
+{
+	char *			name;
+	TaskQueue_t		get_q;			// suscriptores esperando mensajes
+	TaskQueue_t		put_q;			// productores esperando lugar
+	unsigned		nmsgs;			// capacidad del buffer
+	unsigned		msg_size;
+	ChanPolicy_t	policy;
+	unsigned		seq;			// mensajes publicados
+	unsigned		tail;			// cota inferior de los cursores, con ChanBlock
+	Subscriber_t *	subs;			// suscriptores
+	char *			buf;
+};
+
+struct Subscriber_t
+{
+	Channel_t *		channel;
+	unsigned		cursor;			// secuencia del próximo mensaje a leer
+	unsigned		lagged;			// mensajes perdidos, ver GetChannelLag()
+	Subscriber_t *	prev;
+	Subscriber_t *	next;
+};
+
+static bool full(Channel_t *ch);
+static bool wait(TaskQueue_t *queue, unsigned *msecs, Time_t deadline);
+
+static Cache_t channel_cache = MT_CACHE("channels", Channel_t, NULL, NULL);
+static Cache_t subscriber_cache = MT_CACHE("subscribers", Subscriber_t, NULL, NULL);
+
+/*
+--------------------------------------------------------------------------------
+CreateChannel, DeleteChannel - creacion y destruccion de canales de difusión.
+
+El buffer guarda nmsgs mensajes de msg_size bytes, con nmsgs redondeado a la
+siguiente potencia de dos. Al destruir un canal sus
+suscripciones dejan de ser válidas, y las tareas que esperan en el canal
+fallan.
+--------------------------------------------------------------------------------
+*/
+
+Channel_t *
+CreateChannel(const char *name, unsigned nmsgs, unsigned msg_size, ChanPolicy_t policy)
+{
+	Channel_t *ch;
+	unsigned size;
+
+	if ( nmsgs > 0x80000000 )
+		Panic("CreateChannel %s: excede capacidad", name);
+	if ( nmsgs > 1 )
+		nmsgs = 1U << (32 - __builtin_clz(nmsgs - 1));
+	size = nmsgs * msg_size;
+	if ( !nmsgs || !msg_size || size / msg_size != nmsgs )
+		Panic("CreateChannel %s: excede capacidad", name);
+
+	ch = CacheAlloc(&channel_cache);
+	ch->name = ch->get_q.name = ch->put_q.name = mt_name_dup(name);
+	ch->get_q.head = ch->get_q.tail = ch->put_q.head = ch->put_q.tail = NULL;
+	ch->get_q.count = ch->put_q.count = 0;
+	ch->nmsgs = nmsgs;
+	ch->msg_size = msg_size;
+	ch->policy = policy;
+	ch->seq = ch->tail = 0;
+	ch->subs = NULL;
+	ch->buf = mt_kalloc(size);
+
+	return ch;
+}
+
+void
+DeleteChannel(Channel_t *ch)
+{
+	Subscriber_t *sub;
+
+	bool ints = SetInts(false);
+	FlushQueue(&ch->get_q, false);
+	FlushQueue(&ch->put_q, false);
+	while ( (sub = ch->subs) )
+	{
+		ch->subs = sub->next;
+		CacheFree(&subscriber_cache, sub);
+	}
+	Free(ch->buf);
+	mt_name_free(ch->name);
+	CacheFree(&channel_cache, ch);
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+Subscribe, Unsubscribe - alta y baja de un suscriptor.
+
+Un suscriptor nuevo recibe los mensajes que se publiquen a partir de la
+suscripción.
+--------------------------------------------------------------------------------
+*/
+
+Subscriber_t *
+Subscribe(Channel_t *ch)
+{
+	Subscriber_t *sub = CacheAlloc(&subscriber_cache);
+
+	sub->channel = ch;
+	sub->lagged = 0;
+	sub->prev = NULL;
+
+	bool ints = SetInts(false);
+	sub->cursor = ch->seq;
+	if ( (sub->next = ch->subs) )
+		ch->subs->prev = sub;
+	ch->subs = sub;
+	SetInts(ints);
+
+	return sub;
+}
+
+void
+Unsubscribe(Subscriber_t *sub)
+{
+	Channel_t *ch = sub->channel;
+
+	bool ints = SetInts(false);
+	if ( sub->next )
+		sub->next->prev = sub->prev;
+	if ( sub->prev )
+		sub->prev->next = sub->next;
+	else
+		ch->subs = sub->next;
+	CacheFree(&subscriber_cache, sub);
+	FlushQueue(&ch->put_q, true);			// puede haber lugar
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+Publish, PublishCond, PublishTimed - publicación de un mensaje
+
+Con la política ChanBlock esperan mientras algún suscriptor tenga el buffer
+lleno de mensajes sin leer; con ChanLag no esperan nunca. Retornan true si
+publicaron el mensaje.
+--------------------------------------------------------------------------------
+*/
+
+bool
+Publish(Channel_t *ch, void *msg)
+{
+	return PublishTimed(ch, msg, FOREVER);
+}
+
+bool
+PublishCond(Channel_t *ch, void *msg)
+{
+	return PublishTimed(ch, msg, 0);
+}
+
+bool
+PublishTimed(Channel_t *ch, void *msg, unsigned msecs)
+{
+	Time_t deadline = (msecs && msecs != FOREVER) ? Time() + msecs : 0;
+
+	bool ints = SetInts(false);
+	while ( full(ch) )
+		if ( !wait(&ch->put_q, &msecs, deadline) )
+		{
+			SetInts(ints);
+			return false;
+		}
+	memcpy(ch->buf + (ch->seq & (ch->nmsgs - 1)) * ch->msg_size, msg, ch->msg_size);
+	ch->seq++;
+	FlushQueue(&ch->get_q, true);
+	SetInts(ints);
+
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+GetChannel, GetChannelCond, GetChannelTimed - lectura de un mensaje
+
+Leen el próximo mensaje para el suscriptor. Si con la política ChanLag se
+perdieron mensajes, leen el más viejo que queda en el buffer.
+GetChannelLag - retorna los mensajes perdidos por el suscriptor desde la
+llamada anterior.
+--------------------------------------------------------------------------------
+*/
+
+bool
+GetChannel(Subscriber_t *sub, void *msg)
+{
+	return GetChannelTimed(sub, msg, FOREVER);
+}
+
+bool
+GetChannelCond(Subscriber_t *sub, void *msg)
+{
+	return GetChannelTimed(sub, msg, 0);
+}
+
+bool
+GetChannelTimed(Subscriber_t *sub, void *msg, unsigned msecs)
+{
+	Channel_t *ch = sub->channel;
+	Time_t deadline = (msecs && msecs != FOREVER) ? Time() + msecs : 0;
+
+	bool ints = SetInts(false);
+	while ( sub->cursor == ch->seq )
+		if ( !wait(&ch->get_q, &msecs, deadline) )
+		{
+			SetInts(ints);
+			return false;
+		}
+	if ( ch->seq - sub->cursor > ch->nmsgs )
+	{
+		sub->lagged += ch->seq - sub->cursor - ch->nmsgs;
+		sub->cursor = ch->seq - ch->nmsgs;
+	}
+	memcpy(msg, ch->buf + (sub->cursor & (ch->nmsgs - 1)) * ch->msg_size, ch->msg_size);
+	sub->cursor++;
+	FlushQueue(&ch->put_q, true);
+	SetInts(ints);
+
+	return true;
+}
+
+unsigned
+GetChannelLag(Subscriber_t *sub)
+{
+	unsigned lagged;
+
+	bool ints = SetInts(false);
+	lagged = sub->lagged;
+	sub->lagged = 0;
+	SetInts(ints);
+
+	return lagged;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_channel_size, mt_subscriber_size - retornan el tamaño de los mensajes del
+	canal, ver mt_syscall()
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_channel_size(Channel_t *ch)
+{
+	return ch->msg_size;
+}
+
+unsigned
+mt_subscriber_size(Subscriber_t *sub)
+{
+	return sub->channel->msg_size;
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+full - indica si publicar tiene que esperar
+
+Con ChanBlock el buffer está lleno si el suscriptor más atrasado tiene nmsgs
+mensajes sin leer. Para no recorrer los suscriptores en cada publicación se
+mantiene en tail una cota inferior de los cursores, que solamente se recalcula
+cuando indica que el buffer podría estar lleno.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+full(Channel_t *ch)
+{
+	Subscriber_t *sub;
+	unsigned backlog = 0;
+
+	if ( ch->policy != ChanBlock || ch->seq - ch->tail < ch->nmsgs )
+		return false;
+	for ( sub = ch->subs ; sub ; sub = sub->next )
+		if ( ch->seq - sub->cursor > backlog )
+			backlog = ch->seq - sub->cursor;
+	ch->tail = ch->seq - backlog;
+	return backlog >= ch->nmsgs;
+}
+
+/*
+--------------------------------------------------------------------------------
+wait - espera en una cola del canal, recalculando el timeout si hay deadline.
+	Se llama con interrupciones deshabilitadas.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+wait(TaskQueue_t *queue, unsigned *msecs, Time_t deadline)
+{
+	if ( !WaitQueueTimed(queue, *msecs) )
+		return false;
+	if ( deadline )
+	{
+		Time_t now = Time();
+		*msecs = now < deadline ? deadline - now : 0;
+	}
+	return true;
+}
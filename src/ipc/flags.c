@@ -0,0 +1,185 @@
+#include <kernel.h>
+
+/*
+Flags de eventos: 32 flags por objeto que se levantan con SetFlags() y se bajan
+con ClearFlags(). Una tarea puede esperar que se levante alguno o todos los
+flags de una máscara. La máscara y el modo de espera se guardan en el bloque de
+control de la tarea, de modo que SetFlags() recorre la cola una sola vez y
+despierta juntas a todas las tareas cuya condición se cumple.
+*/
+
+struct EventFlags_t
+{
+	TaskQueue_t		queue;
+	unsigned		flags;
+};
+
+static void init_flags(void *obj);
+static unsigned match(unsigned flags, unsigned mask, FlagsMode_t mode);
+
+static Cache_t flags_cache = MT_CACHE("event flags", EventFlags_t, init_flags, NULL);
+
+/*
+--------------------------------------------------------------------------------
+CreateFlags - aloca un grupo de flags con su valor inicial
+--------------------------------------------------------------------------------
+*/
+
+EventFlags_t *
+CreateFlags(const char *name, unsigned flags)
+{
+	EventFlags_t *ef = CacheAlloc(&flags_cache);
+
+	ef->queue.name = mt_name_dup(name);
+	ef->flags = flags;
+	return ef;
+}
+
+/*
+--------------------------------------------------------------------------------
+DeleteFlags - da de baja un grupo de flags
+
+Las tareas que esperan completan su WaitFlags() sin éxito.
+--------------------------------------------------------------------------------
+*/
+
+void
+DeleteFlags(EventFlags_t *ef)
+{
+	bool ints = SetInts(false);
+	FlushQueue(&ef->queue, false);
+	mt_name_free(GetName(ef));
+	init_flags(ef);
+	CacheFree(&flags_cache, ef);
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+SetFlags - levanta flags
+
+Despierta en una sola pasada a todas las tareas cuya condición se cumple con
+el nuevo valor. Las condiciones se evalúan todas sobre ese valor, y los flags
+que piden bajar las tareas despertadas se bajan al final. Puede llamarse
+desde un manejador de interrupciones.
+--------------------------------------------------------------------------------
+*/
+
+void
+SetFlags(EventFlags_t *ef, unsigned flags)
+{
+	TaskQueue_t wake = { "flags" };
+	unsigned clear = 0;
+	Task_t *task, *prev;
+	unsigned got;
+
+	bool ints = SetInts(false);
+	ef->flags |= flags;
+	for ( task = ef->queue.tail ; task ; task = prev )
+	{
+		prev = task->prev;
+		if ( !(got = match(ef->flags, task->wait_flags, task->wait_mode)) )
+			continue;
+		task->wait_flags = got;
+		if ( task->wait_clear )
+			clear |= got;
+		mt_dequeue(task);
+		mt_enqueue(task, &wake);
+	}
+	ef->flags &= ~clear;
+	FlushQueue(&wake, true);
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+ClearFlags - baja flags
+GetFlags - informa el valor de los flags
+--------------------------------------------------------------------------------
+*/
+
+void
+ClearFlags(EventFlags_t *ef, unsigned flags)
+{
+	bool ints = SetInts(false);
+	ef->flags &= ~flags;
+	SetInts(ints);
+}
+
+unsigned
+GetFlags(EventFlags_t *ef)
+{
+	return ef->flags;
+}
+
+/*
+--------------------------------------------------------------------------------
+WaitFlags, WaitFlagsCond, WaitFlagsTimed - esperar flags
+
+Con FlagsAny se espera que se levante alguno de los flags de la máscara, y con
+FlagsAll que se levanten todos. Si clear es true, al completarse la espera se
+bajan los flags obtenidos. Retorna los flags de la máscara que cumplieron la
+condición, o cero si no se cumplió. WaitFlags espera indefinidamente,
+WaitFlagsCond retorna inmediatamente y WaitFlagsTimed espera con timeout.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+WaitFlags(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear)
+{
+	return WaitFlagsTimed(ef, mask, mode, clear, FOREVER);
+}
+
+unsigned
+WaitFlagsCond(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear)
+{
+	return WaitFlagsTimed(ef, mask, mode, clear, 0);
+}
+
+unsigned
+WaitFlagsTimed(EventFlags_t *ef, unsigned mask, FlagsMode_t mode, bool clear, unsigned msecs)
+{
+	unsigned flags;
+
+	bool ints = SetInts(false);
+	if ( (flags = match(ef->flags, mask, mode)) )
+	{
+		if ( clear )
+			ef->flags &= ~flags;
+	}
+	else if ( mask )
+	{
+		mt_curr_task->wait_flags = mask;
+		mt_curr_task->wait_mode = mode;
+		mt_curr_task->wait_clear = clear;
+		if ( WaitQueueTimed(&ef->queue, msecs) )
+			flags = mt_curr_task->wait_flags;
+	}
+	SetInts(ints);
+
+	return flags;
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+init_flags - constructor para flags_cache, flags en cero y la cola vacía
+match - flags de la máscara que cumplen la condición, o cero
+--------------------------------------------------------------------------------
+*/
+
+static void
+init_flags(void *obj)
+{
+	memset(obj, 0, sizeof(EventFlags_t));
+}
+
+static unsigned
+match(unsigned flags, unsigned mask, FlagsMode_t mode)
+{
+	flags &= mask;
+	if ( mode == FlagsAll && flags != mask )
+		return 0;
+	return flags;
+}
@@ -12,6 +12,12 @@ struct Condition_t
 	Monitor_t *		monitor;
 };
 
+static void init_monitor(void *obj);
+static void init_condition(void *obj);
+
+static Cache_t monitor_cache = MT_CACHE("monitors", Monitor_t, init_monitor, NULL);
+static Cache_t condition_cache = MT_CACHE("conditions", Condition_t, init_condition, NULL);
+
 /*
 --------------------------------------------------------------------------------
 CreateMonitor - aloca un monitor inicialmente libre
@@ -21,9 +27,9 @@ CreateMonitor - aloca un monitor inicialmente libre
 Monitor_t *
 CreateMonitor(const char *name)
 {
-	Monitor_t *mon = Malloc(sizeof(Monitor_t));
+	Monitor_t *mon = CacheAlloc(&monitor_cache);
 
-	mon->queue.name = StrDup(name);
+	mon->queue.name = mt_name_dup(name);
 	return mon;
 }
 
@@ -37,8 +43,9 @@ void
 DeleteMonitor(Monitor_t *mon)
 {
 	FlushQueue(&mon->queue, false);
-	Free(GetName(mon));
-	Free(mon);
+	mt_name_free(GetName(mon));
+	init_monitor(mon);
+	CacheFree(&monitor_cache, mon);
 }
 
 /*
@@ -107,9 +114,9 @@ CreateCondition - crea una variable de condicion asociada a un monitor
 Condition_t *		
 CreateCondition(const char *name, Monitor_t *mon)
 {
-	Condition_t *cond = Malloc(sizeof(Condition_t));
+	Condition_t *cond = CacheAlloc(&condition_cache);
 
-	cond->queue.name = StrDup(name);
+	cond->queue.name = mt_name_dup(name);
 	cond->monitor = mon;
 	return cond;
 }
@@ -124,8 +131,9 @@ void
 DeleteCondition(Condition_t *cond)
 {
 	FlushQueue(&cond->queue, false);
-	Free(GetName(cond));
-	Free(cond);
+	mt_name_free(GetName(cond));
+	init_condition(cond);
+	CacheFree(&condition_cache, cond);
 }
 
 /*
@@ -204,3 +212,24 @@ BroadcastCondition(Condition_t *cond)
 
 	FlushQueue(&cond->queue, true);
 }
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+init_monitor, init_condition - constructores para monitor_cache y
+	condition_cache, con las colas vacías.
+--------------------------------------------------------------------------------
+*/
+
+static void
+init_monitor(void *obj)
+{
+	memset(obj, 0, sizeof(Monitor_t));
+}
+
+static void
+init_condition(void *obj)
+{
+	memset(obj, 0, sizeof(Condition_t));
+}
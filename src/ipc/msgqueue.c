@@ -5,6 +5,8 @@ struct MsgQueue_t
 	char *			name;
 	Semaphore_t *	sem_get;
 	Semaphore_t *	sem_put;
+	mt_fiber_queue_t fibers_get;	// fibras esperando para leer
+	mt_fiber_queue_t fibers_put;	// fibras esperando para escribir
 	unsigned		msg_size;
 	char *			buf;
 	char *			head;
@@ -12,6 +14,8 @@ struct MsgQueue_t
 	char *			end;
 };
 
+static Cache_t msgqueue_cache = MT_CACHE("msgqueues", MsgQueue_t, NULL, NULL);
+
 /*
 --------------------------------------------------------------------------------
 CreateMsgQueue, DeleteMsgQueue - creacion y destruccion de colas de mensajes.
@@ -20,6 +24,8 @@ El parametro msg_max indica la maxima cantidad de mensajes a almacenar, y
 msg_size el tamano de cada uno. Los otros parametros determinan si se desea 
 tener mutexes de lectura y escritura en la cola, para permitir la existencia de
 varios consumidores y/o productores de mensajes.
+DeleteMsgQueue despierta las fibras que esperan en la cola, y
+GetMsgQueueFiber o PutMsgQueueFiber les retornan false.
 --------------------------------------------------------------------------------
 */
 
@@ -33,15 +39,17 @@ CreateMsgQueue(const char *name, unsigned msg_max, unsigned msg_size)
 	if ( size / msg_size != msg_max )	
 		Panic("CreateMsgQueue %s: excede capacidad", name);
 
-	mq = Malloc(sizeof(MsgQueue_t));
-	mq->name = StrDup(name);
+	mq = CacheAlloc(&msgqueue_cache);
+	mq->name = mt_name_dup(name);
 	mq->msg_size = msg_size;
-	mq->head = mq->tail = mq->buf = Malloc(size);
+	mq->head = mq->tail = mq->buf = mt_kalloc(size);
 	mq->end = mq->buf + size;
 	sprintf(buf, "get %s", name);
 	mq->sem_get = CreateSem(buf, 0);
 	sprintf(buf, "put %s", name);
 	mq->sem_put = CreateSem(buf, msg_max);
+	mq->fibers_get.head = mq->fibers_get.tail = NULL;
+	mq->fibers_put.head = mq->fibers_put.tail = NULL;
 
 	return mq;
 }
@@ -49,11 +57,13 @@ CreateMsgQueue(const char *name, unsigned msg_max, unsigned msg_size)
 void
 DeleteMsgQueue(MsgQueue_t *mq)
 {
+	mt_fiber_flush(&mq->fibers_get);
+	mt_fiber_flush(&mq->fibers_put);
 	DeleteSem(mq->sem_get);
 	DeleteSem(mq->sem_put);
 	Free(mq->buf);
-	Free(mq->name);
-	Free(mq);
+	mt_name_free(mq->name);
+	CacheFree(&msgqueue_cache, mq);
 }
 
 /*
@@ -88,6 +98,7 @@ GetMsgQueueTimed(MsgQueue_t *mq, void *msg, unsigned msecs)
 	SetInts(ints);
 
 	SignalSem(mq->sem_put);
+	mt_fiber_wakeup(&mq->fibers_put, false);
 
 	return true;
 }
@@ -124,10 +135,52 @@ PutMsgQueueTimed(MsgQueue_t *mq, void *msg, unsigned msecs)
 	SetInts(ints);
 
 	SignalSem(mq->sem_get);
+	mt_fiber_wakeup(&mq->fibers_get, false);
 
 	return true;
 }
 
+/*
+--------------------------------------------------------------------------------
+GetMsgQueueFiber, PutMsgQueueFiber - lectura y escritura desde una fibra.
+
+Se comportan como GetMsgQueue y PutMsgQueue, pero si tienen que esperar
+bloquean solamente la fibra actual (ver CreateFiber). Cada mensaje o lugar
+libre despierta una sola fibra. Retornan false si la cola se elimina mientras
+esperan.
+--------------------------------------------------------------------------------
+*/
+
+bool
+GetMsgQueueFiber(MsgQueue_t *mq, void *msg)
+{
+	bool alive = true;
+
+	while ( alive && !GetMsgQueueCond(mq, msg) )
+	{
+		Atomic();
+		if ( !ValueSem(mq->sem_get) )
+			alive = mt_fiber_park(&mq->fibers_get);
+		Unatomic();
+	}
+	return alive;
+}
+
+bool
+PutMsgQueueFiber(MsgQueue_t *mq, void *msg)
+{
+	bool alive = true;
+
+	while ( alive && !PutMsgQueueCond(mq, msg) )
+	{
+		Atomic();
+		if ( !ValueSem(mq->sem_put) )
+			alive = mt_fiber_park(&mq->fibers_put);
+		Unatomic();
+	}
+	return alive;
+}
+
 /*
 --------------------------------------------------------------------------------
 AvailMsgQueue - indica la cantidad de mensajes almacenada en la cola
@@ -139,3 +192,15 @@ AvailMsgQueue(MsgQueue_t *mq)
 {
 	return ValueSem(mq->sem_get);
 }
+
+/*
+--------------------------------------------------------------------------------
+mt_msgqueue_size - retorna el tamaño de los mensajes de la cola, ver mt_syscall()
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_msgqueue_size(MsgQueue_t *mq)
+{
+	return mq->msg_size;
+}
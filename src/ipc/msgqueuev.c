@@ -0,0 +1,267 @@
+#include <kernel.h>
+
+/*
+Colas de mensajes de longitud variable. Los mensajes se guardan uno tras otro
+en un buffer circular, cada uno precedido por su longitud y alineado a 4 bytes;
+el contenido de un mensaje puede dar la vuelta al final del buffer. La
+capacidad se expresa en bytes, de modo que no se desperdicia lugar dimensionando
+cada mensaje para el peor caso, y a diferencia de un pipe se preservan los
+límites entre mensajes.
+*/
+
+#define HDR_SIZE		sizeof(unsigned)
+#define RECORD(len)		(HDR_SIZE + (((len) + 3) & ~3))	/* lugar que ocupa un mensaje */
+
+struct MsgQueueV_t
+{
+	char *			name;
+	Monitor_t *		monitor;
+	Condition_t *	cond_get;
+	Condition_t *	cond_put;
+	unsigned		size;			// capacidad en bytes
+	unsigned		used;			// bytes ocupados, con los encabezados
+	unsigned		count;			// mensajes en la cola
+	char *			buf;
+	char *			head;
+	char *			tail;
+	char *			end;
+};
+
+static bool wait(MsgQueueV_t *mq, Condition_t *cond, unsigned *msecs, Time_t deadline);
+static void copy_in(MsgQueueV_t *mq, char *pos, const void *data, unsigned size);
+static void copy_out(MsgQueueV_t *mq, char *pos, void *data, unsigned size);
+
+static Cache_t msgqueuev_cache = MT_CACHE("msgqueuesv", MsgQueueV_t, NULL, NULL);
+
+/*
+--------------------------------------------------------------------------------
+CreateMsgQueueV, DeleteMsgQueueV - creacion y destruccion de colas de mensajes
+	de longitud variable.
+
+El parametro size es la capacidad de la cola en bytes. Cada mensaje ocupa su
+longitud redondeada a multiplo de 4, mas 4 bytes de encabezado.
+--------------------------------------------------------------------------------
+*/
+
+MsgQueueV_t *
+CreateMsgQueueV(const char *name, unsigned size)
+{
+	char buf[200];
+	MsgQueueV_t *mq;
+
+	if ( (size = (size + 3) & ~3) < RECORD(1) )
+		Panic("CreateMsgQueueV %s: capacidad insuficiente", name);
+
+	mq = CacheAlloc(&msgqueuev_cache);
+	mq->head = mq->tail = mq->buf = mt_kalloc(mq->size = size);
+	mq->end = mq->buf + size;
+	mq->used = mq->count = 0;
+	mq->monitor = CreateMonitor(name);
+	mq->name = GetName(mq->monitor);
+	sprintf(buf, "get %s", name);
+	mq->cond_get = CreateCondition(buf, mq->monitor);
+	sprintf(buf, "put %s", name);
+	mq->cond_put = CreateCondition(buf, mq->monitor);
+
+	return mq;
+}
+
+void
+DeleteMsgQueueV(MsgQueueV_t *mq)
+{
+	DeleteCondition(mq->cond_get);
+	DeleteCondition(mq->cond_put);
+	DeleteMonitor(mq->monitor);
+	Free(mq->buf);
+	CacheFree(&msgqueuev_cache, mq);
+}
+
+/*
+--------------------------------------------------------------------------------
+GetMsgV, GetMsgVCond, GetMsgVTimed - lectura de un mensaje
+
+Copian en msg hasta size bytes del primer mensaje de la cola, y lo sacan de la
+cola aunque no entre completo. Retornan la longitud del mensaje, que puede ser
+mayor que size (ver PeekMsgV), o cero si no pudieron leer.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+GetMsgV(MsgQueueV_t *mq, void *msg, unsigned size)
+{
+	return GetMsgVTimed(mq, msg, size, FOREVER);
+}
+
+unsigned
+GetMsgVCond(MsgQueueV_t *mq, void *msg, unsigned size)
+{
+	return GetMsgVTimed(mq, msg, size, 0);
+}
+
+unsigned
+GetMsgVTimed(MsgQueueV_t *mq, void *msg, unsigned size, unsigned msecs)
+{
+	unsigned len;
+
+	if ( !EnterMonitor(mq->monitor) )
+		return 0;
+
+	// Si hay un timeout finito, calcular deadline.
+	Time_t deadline = (msecs && msecs != FOREVER) ? Time() + msecs : 0;
+
+	// Bloquearse si la cola está vacía
+	while ( !mq->count )
+		if ( !wait(mq, mq->cond_get, &msecs, deadline) )
+			return 0;
+
+	// Leer el encabezado y el mensaje, y saltear el relleno
+	len = *(unsigned *) mq->head;
+	copy_out(mq, mq->head + HDR_SIZE, msg, min(len, size));
+	mq->head = mq->buf + (mq->head - mq->buf + RECORD(len)) % mq->size;
+	mq->used -= RECORD(len);
+	mq->count--;
+
+	// Despertar escritores bloqueados, que pueden necesitar distintos lugares
+	BroadcastCondition(mq->cond_put);
+
+	LeaveMonitor(mq->monitor);
+	return len;
+}
+
+/*
+--------------------------------------------------------------------------------
+PutMsgV, PutMsgVCond, PutMsgVTimed - escritura de un mensaje
+
+Escriben un mensaje de size bytes, bloqueandose hasta que haya lugar para el
+mensaje completo. Fallan si size es cero o si el mensaje no entra en la cola
+vacía.
+--------------------------------------------------------------------------------
+*/
+
+bool
+PutMsgV(MsgQueueV_t *mq, void *msg, unsigned size)
+{
+	return PutMsgVTimed(mq, msg, size, FOREVER);
+}
+
+bool
+PutMsgVCond(MsgQueueV_t *mq, void *msg, unsigned size)
+{
+	return PutMsgVTimed(mq, msg, size, 0);
+}
+
+bool
+PutMsgVTimed(MsgQueueV_t *mq, void *msg, unsigned size, unsigned msecs)
+{
+	unsigned record = RECORD(size);
+
+	if ( !size || record < size || record > mq->size || !EnterMonitor(mq->monitor) )
+		return false;
+
+	// Si hay un timeout finito, calcular deadline.
+	Time_t deadline = (msecs && msecs != FOREVER) ? Time() + msecs : 0;
+
+	// Bloquearse hasta que entre el mensaje
+	while ( mq->size - mq->used < record )
+		if ( !wait(mq, mq->cond_put, &msecs, deadline) )
+			return false;
+
+	// Escribir el encabezado y el mensaje, y saltear el relleno
+	*(unsigned *) mq->tail = size;
+	copy_in(mq, mq->tail + HDR_SIZE, msg, size);
+	mq->tail = mq->buf + (mq->tail - mq->buf + record) % mq->size;
+	mq->used += record;
+	mq->count++;
+
+	// Despertar un lector bloqueado
+	SignalCondition(mq->cond_get);
+
+	LeaveMonitor(mq->monitor);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+PeekMsgV - retorna la longitud del primer mensaje de la cola, o cero si está
+	vacía
+AvailMsgV - indica la cantidad de mensajes almacenada en la cola
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+PeekMsgV(MsgQueueV_t *mq)
+{
+	unsigned len;
+
+	bool ints = SetInts(false);
+	len = mq->count ? *(unsigned *) mq->head : 0;
+	SetInts(ints);
+	return len;
+}
+
+unsigned
+AvailMsgV(MsgQueueV_t *mq)
+{
+	return mq->count;
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+wait - espera en una condición de la cola, recalculando el timeout si hay
+	deadline. Si falla sale del monitor.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+wait(MsgQueueV_t *mq, Condition_t *cond, unsigned *msecs, Time_t deadline)
+{
+	// Desistir si es condicional, si no esperar
+	if ( !*msecs || !WaitConditionTimed(cond, *msecs) )
+	{
+		LeaveMonitor(mq->monitor);
+		return false;
+	}
+
+	// Si hay que seguir esperando con deadline, recalcular timeout
+	if ( deadline )
+	{
+		Time_t now = Time();
+		*msecs = now < deadline ? deadline - now : 0;
+	}
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+copy_in, copy_out - copian datos a y desde la cola a partir de una posición,
+	dando la vuelta al final del buffer.
+--------------------------------------------------------------------------------
+*/
+
+static void
+copy_in(MsgQueueV_t *mq, char *pos, const void *data, unsigned size)
+{
+	unsigned n;
+
+	if ( pos == mq->end )
+		pos = mq->buf;
+	n = min(size, (unsigned) (mq->end - pos));
+	memcpy(pos, data, n);
+	if ( n < size )
+		memcpy(mq->buf, (const char *) data + n, size - n);
+}
+
+static void
+copy_out(MsgQueueV_t *mq, char *pos, void *data, unsigned size)
+{
+	unsigned n;
+
+	if ( pos == mq->end )
+		pos = mq->buf;
+	n = min(size, (unsigned) (mq->end - pos));
+	memcpy(data, pos, n);
+	if ( n < size )
+		memcpy((char *) data + n, mq->buf, size - n);
+}
@@ -1,12 +1,29 @@
 #include <kernel.h>
 
+/*
+El estado del mutex (libre, ocupado u ocupado con tareas esperando) se cambia
+con lock cmpxchg, de modo que ocuparlo libre y liberarlo sin tareas esperando
+no deshabilita interrupciones ni pasa por Atomic(). Si hay tareas esperando,
+LeaveMutex() le pasa el mutex directamente a la primera. Con mt_fast_locks en
+false todo pasa por el camino lento, para comparar (ver locks.c).
+*/
+
+#define MUTEX_FREE		0
+#define MUTEX_LOCKED	1
+#define MUTEX_WAITERS	2				// ocupado, puede haber tareas esperando
+
 struct Mutex_t
 {
-	TaskQueue_t		queue;
-	unsigned		use_count;
-	Task_t *		owner;
+	TaskQueue_t			queue;
+	volatile unsigned	state;
+	unsigned			use_count;
+	Task_t *			owner;
 };
 
+static void init_mutex(void *obj);
+
+static Cache_t mutex_cache = MT_CACHE("mutexes", Mutex_t, init_mutex, NULL);
+
 /*
 --------------------------------------------------------------------------------
 CreateMutex - aloca un mutex inicialmente libre
@@ -16,9 +33,9 @@ CreateMutex - aloca un mutex inicialmente libre
 Mutex_t *
 CreateMutex(const char *name)
 {
-	Mutex_t *mut = Malloc(sizeof(Mutex_t));
+	Mutex_t *mut = CacheAlloc(&mutex_cache);
 
-	mut->queue.name = StrDup(name);
+	mut->queue.name = mt_name_dup(name);
 	return mut;
 }
 
@@ -32,8 +49,9 @@ void
 DeleteMutex(Mutex_t *mut)
 {
 	FlushQueue(&mut->queue, false);
-	Free(GetName(mut));
-	Free(mut);
+	mt_name_free(GetName(mut));
+	init_mutex(mut);
+	CacheFree(&mutex_cache, mut);
 }
 
 /*
@@ -62,21 +80,36 @@ EnterMutexCond(Mutex_t *mut)
 bool			
 EnterMutexTimed(Mutex_t *mut, unsigned msecs)
 {
+	bool success = true;
+
 	if ( mut->owner == mt_curr_task )
 	{
 		mut->use_count++;
 		return true;
 	}
-	Atomic();
-	if ( !mut->owner )
+	if ( mt_fast_locks && mt_cmpxchg(&mut->state, MUTEX_FREE, MUTEX_LOCKED) )
 	{
 		mut->owner = mt_curr_task;
 		mut->use_count = 1;
-		Unatomic();
 		return true;
 	}
-	bool success = WaitQueueTimed(&mut->queue, msecs);
-	Unatomic();
+
+	bool ints = SetInts(false);
+	if ( mut->state == MUTEX_FREE )
+	{
+		mut->state = MUTEX_LOCKED;
+		mut->owner = mt_curr_task;
+		mut->use_count = 1;
+	}
+	else if ( !msecs )
+		success = false;
+	else
+	{
+		// Si tiene éxito, LeaveMutex() ya nos hizo dueños
+		mut->state = MUTEX_WAITERS;
+		success = WaitQueueTimed(&mut->queue, msecs);
+	}
+	SetInts(ints);
 	return success;
 }
 
@@ -92,15 +125,41 @@ un error fatal si la tarea actual no es dueña del mutex.
 void			
 LeaveMutex(Mutex_t *mut)
 {
+	Task_t *task;
+
 	if ( mut->owner != mt_curr_task )
 		Panic("LeaveMutex %s: la tarea no posee el mutex", GetName(mut));
 
-	if ( !--mut->use_count )
+	if ( --mut->use_count )
+		return;
+	mut->owner = NULL;
+	if ( mt_fast_locks && mt_cmpxchg(&mut->state, MUTEX_LOCKED, MUTEX_FREE) )
+		return;
+
+	bool ints = SetInts(false);
+	if ( (task = mt_peeklast(&mut->queue)) )
 	{
-		Atomic();
-		if ( (mut->owner = SignalQueue(&mut->queue)) )
-			mut->use_count = 1;
-		Unatomic();
+		mut->owner = task;
+		mut->use_count = 1;
+		if ( mut->queue.count == 1 )
+			mut->state = MUTEX_LOCKED;
+		SignalQueue(&mut->queue);
 	}
+	else
+		mut->state = MUTEX_FREE;
+	SetInts(ints);
 }
 
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+init_mutex - constructor para mutex_cache, un mutex libre
+--------------------------------------------------------------------------------
+*/
+
+static void
+init_mutex(void *obj)
+{
+	memset(obj, 0, sizeof(Mutex_t));
+}
@@ -1,19 +1,50 @@
 #include <kernel.h>
 
+/*
+Un pipe guarda los datos en un buffer circular alocado al crearlo, o en modo
+por bloques (ver CreateChunkedPipe()) en una lista de bloques de tamaño fijo
+que se toman de un pool compartido por todos los pipes a medida que se
+escribe y se devuelven al pool a medida que se leen.
+*/
+
+#define CHUNK_SIZE		512				// bloques de los pipes por bloques
+#define CHUNK_DATA		(CHUNK_SIZE - sizeof(PipeChunk_t *) - 2 * sizeof(unsigned))
+
+typedef struct PipeChunk_t PipeChunk_t;
+
+struct PipeChunk_t
+{
+	PipeChunk_t *	next;
+	unsigned		head;			// datos entre head y tail
+	unsigned		tail;
+	char			data[CHUNK_DATA];
+};
+
 struct Pipe_t
 {
 	char *			name;
 	Monitor_t *		monitor;
 	Condition_t *	cond_get;
 	Condition_t *	cond_put;
+	mt_fiber_queue_t fibers_get;	// fibras esperando para leer
+	mt_fiber_queue_t fibers_put;	// fibras esperando para escribir
 	unsigned		size;
 	unsigned		avail;
-	char *			buf;
+	char *			buf;			// NULL en modo por bloques
 	char *			head;
 	char *			tail;
 	char *			end;
+	PipeChunk_t *	first;			// bloques, en modo por bloques
+	PipeChunk_t *	last;
 };
 
+static Pipe_t *create(const char *name, unsigned size, char *buf);
+static void read_data(Pipe_t *p, char *data, unsigned nbytes);
+static void write_data(Pipe_t *p, char *data, unsigned nbytes);
+
+static Cache_t pipe_cache = MT_CACHE("pipes", Pipe_t, NULL, NULL);
+static Cache_t chunk_cache = MT_CACHE("pipe chunks", PipeChunk_t, NULL, NULL);
+
 /*
 --------------------------------------------------------------------------------
 CreatePipe, DeletePipe - creacion y destruccion de pipes.
@@ -21,35 +52,54 @@ CreatePipe, DeletePipe - creacion y destruccion de pipes.
 El parametro size determina el tamano del buffer interno. En principio puede
 usarse cualquier valor; cuanto mas grande sea el buffer, mayor sera el
 desacoplamiento entre las tarea que escriben y las que leen en el pipe.
+DeletePipe despierta las fibras que esperan en el pipe, incluidos los pipes
+por bloques, y GetPipeFiber o PutPipeFiber les retornan cero.
 --------------------------------------------------------------------------------
 */
 
 Pipe_t *
 CreatePipe(const char *name, unsigned size)
 {
-	char buf[200];
-	Pipe_t *p = Malloc(sizeof(Pipe_t));
-
-	p->head = p->tail = p->buf = Malloc(p->size = size);
-	p->end = p->buf + size;
-	p->monitor = CreateMonitor(name);
-	p->name = GetName(p->monitor);
-	sprintf(buf, "get %s", name);
-	p->cond_get = CreateCondition(buf, p->monitor);
-	sprintf(buf, "put %s", name);
-	p->cond_put = CreateCondition(buf, p->monitor);
-
-	return p;
+	return create(name, size, mt_kalloc(size));
 }
 
 void
 DeletePipe(Pipe_t *p)
 {
+	PipeChunk_t *c;
+
+	mt_fiber_flush(&p->fibers_get);
+	mt_fiber_flush(&p->fibers_put);
 	DeleteCondition(p->cond_get);
 	DeleteCondition(p->cond_put);
 	DeleteMonitor(p->monitor);
-	Free(p->buf);
-	Free(p);
+	if ( p->buf )
+		Free(p->buf);
+	while ( (c = p->first) )
+	{
+		p->first = c->next;
+		CacheFree(&chunk_cache, c);
+	}
+	CacheFree(&pipe_cache, p);
+}
+
+/*
+--------------------------------------------------------------------------------
+CreateChunkedPipe - crea un pipe por bloques.
+
+El pipe no tiene un buffer propio: los datos se guardan en bloques que se
+alocan de un pool compartido cuando se escribe, hasta max bytes, y se devuelven
+al pool cuando se leen. Un pipe ocioso no ocupa memoria de buffer, y puede
+absorber ráfagas hasta max bytes. Se usa con las mismas funciones que los
+demás pipes, y además permite mover bloques enteros entre pipes con
+SplicePipe().
+--------------------------------------------------------------------------------
+*/
+
+Pipe_t *
+CreateChunkedPipe(const char *name, unsigned max)
+{
+	return create(name, max, NULL);
 }
 
 /*
@@ -80,8 +130,7 @@ GetPipeCond(Pipe_t *p, void *data, unsigned size)
 unsigned
 GetPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs)
 {
-	unsigned i, nbytes;
-	char *d;
+	unsigned nbytes;
 
 	if ( !size || !EnterMonitor(p->monitor) )
 		return 0;
@@ -107,17 +156,14 @@ GetPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs)
 	}
 
 	// Leer lo que se pueda
-	for ( nbytes = min(size, p->avail), d = data, i = 0 ; i < nbytes ; i++ )
-	{
-		*d++ = *p->head++;
-		if ( p->head == p->end )
-			p->head = p->buf;
-	}
+	nbytes = min(size, p->avail);
+	read_data(p, data, nbytes);
 
 	// Despertar eventuales escritores bloqueados
 	if ( p->avail == p->size )
 		BroadcastCondition(p->cond_put);
 	p->avail -= nbytes;
+	mt_fiber_wakeup(&p->fibers_put, true);
 
 	// Retornar cantidad de bytes leídos
 	LeaveMonitor(p->monitor);
@@ -152,8 +198,7 @@ PutPipeCond(Pipe_t *p, void *data, unsigned size)
 unsigned
 PutPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs)
 {
-	unsigned i, nbytes;
-	char *d;
+	unsigned nbytes;
 
 	if ( !size || !EnterMonitor(p->monitor) )
 		return 0;
@@ -179,23 +224,122 @@ PutPipeTimed(Pipe_t *p, void *data, unsigned size, unsigned msecs)
 	}
 
 	// Escribir lo que se pueda
-	for ( nbytes = min(size, p->size - p->avail), d = data, i = 0 ; i < nbytes ; i++ )
-	{
-		*p->tail++ = *d++;
-		if ( p->tail == p->end )
-			p->tail = p->buf;
-	}
+	nbytes = min(size, p->size - p->avail);
+	write_data(p, data, nbytes);
 
 	// Despertar eventuales lectores bloqueados
 	if ( !p->avail )
 		BroadcastCondition(p->cond_get);
 	p->avail += nbytes;
+	mt_fiber_wakeup(&p->fibers_get, true);
 
 	// Retornar cantidad de bytes escritos
 	LeaveMonitor(p->monitor);
 	return nbytes;
 }
 
+/*
+--------------------------------------------------------------------------------
+GetPipeFiber, PutPipeFiber - lectura y escritura de un pipe desde una fibra.
+
+Se comportan como GetPipe y PutPipe, pero si tienen que esperar bloquean
+solamente la fibra actual (ver CreateFiber) y la tarea sigue ejecutando sus
+otras fibras. Si el pipe se elimina mientras esperan retornan cero.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+GetPipeFiber(Pipe_t *p, void *data, unsigned size)
+{
+	unsigned nbytes;
+	bool alive = true;
+
+	while ( alive && !(nbytes = GetPipeCond(p, data, size)) && size )
+	{
+		Atomic();
+		if ( !p->avail )
+			alive = mt_fiber_park(&p->fibers_get);
+		Unatomic();
+	}
+	return nbytes;
+}
+
+unsigned
+PutPipeFiber(Pipe_t *p, void *data, unsigned size)
+{
+	unsigned nbytes;
+	bool alive = true;
+
+	while ( alive && !(nbytes = PutPipeCond(p, data, size)) && size )
+	{
+		Atomic();
+		if ( p->avail == p->size )
+			alive = mt_fiber_park(&p->fibers_put);
+		Unatomic();
+	}
+	return nbytes;
+}
+
+/*
+--------------------------------------------------------------------------------
+SplicePipe - mueve datos de un pipe por bloques a otro sin copiarlos.
+
+Pasa bloques enteros del principio de from al final de to, mientras entren en
+size bytes y en el máximo de to. No se bloquea; retorna la cantidad de bytes
+movidos, que es cero si algún pipe no es por bloques.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+SplicePipe(Pipe_t *to, Pipe_t *from, unsigned size)
+{
+	Pipe_t *p1 = to < from ? to : from, *p2 = to < from ? from : to;
+	unsigned n, nbytes = 0;
+	PipeChunk_t *c;
+
+	if ( to->buf || from->buf || to == from )
+		return 0;
+
+	// Ocupar los monitores siempre en el mismo orden
+	if ( !EnterMonitor(p1->monitor) )
+		return 0;
+	if ( !EnterMonitor(p2->monitor) )
+	{
+		LeaveMonitor(p1->monitor);
+		return 0;
+	}
+
+	// Mover los bloques que entren
+	while ( (c = from->first) && (n = c->tail - c->head) <= size - nbytes &&
+			n <= to->size - to->avail )
+	{
+		if ( !(from->first = c->next) )
+			from->last = NULL;
+		c->next = NULL;
+		if ( to->last )
+			to->last->next = c;
+		else
+			to->first = c;
+		to->last = c;
+		from->avail -= n;
+		to->avail += n;
+		nbytes += n;
+	}
+
+	// Despertar escritores de from y lectores de to
+	if ( nbytes )
+	{
+		BroadcastCondition(from->cond_put);
+		mt_fiber_wakeup(&from->fibers_put, true);
+		BroadcastCondition(to->cond_get);
+		mt_fiber_wakeup(&to->fibers_get, true);
+	}
+
+	LeaveMonitor(p2->monitor);
+	LeaveMonitor(p1->monitor);
+	return nbytes;
+}
+
 /*
 --------------------------------------------------------------------------------
 AvailPipe - indica la cantidad de bytes almacenada en el pipe.
@@ -207,3 +351,113 @@ AvailPipe(Pipe_t *p)
 {
 	return p->avail;
 }
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+create - crea un pipe con un buffer circular, o por bloques si buf es NULL
+--------------------------------------------------------------------------------
+*/
+
+static Pipe_t *
+create(const char *name, unsigned size, char *buf)
+{
+	char namebuf[200];
+	Pipe_t *p = CacheAlloc(&pipe_cache);
+
+	p->size = size;
+	p->head = p->tail = p->buf = buf;
+	p->end = buf ? buf + size : NULL;
+	p->first = p->last = NULL;
+	p->avail = 0;
+	p->fibers_get.head = p->fibers_get.tail = NULL;
+	p->fibers_put.head = p->fibers_put.tail = NULL;
+	p->monitor = CreateMonitor(name);
+	p->name = GetName(p->monitor);
+	sprintf(namebuf, "get %s", name);
+	p->cond_get = CreateCondition(namebuf, p->monitor);
+	sprintf(namebuf, "put %s", name);
+	p->cond_put = CreateCondition(namebuf, p->monitor);
+
+	return p;
+}
+
+/*
+--------------------------------------------------------------------------------
+read_data, write_data - copian datos desde y hacia el pipe, que tiene lugar o
+	datos suficientes. En modo por bloques, read_data devuelve al pool los
+	bloques que se vacían y write_data aloca los que necesita.
+--------------------------------------------------------------------------------
+*/
+
+static void
+read_data(Pipe_t *p, char *data, unsigned nbytes)
+{
+	PipeChunk_t *c;
+	unsigned n;
+
+	if ( p->buf )
+	{
+		while ( nbytes-- )
+		{
+			*data++ = *p->head++;
+			if ( p->head == p->end )
+				p->head = p->buf;
+		}
+		return;
+	}
+
+	while ( nbytes )
+	{
+		c = p->first;
+		n = min(nbytes, c->tail - c->head);
+		memcpy(data, c->data + c->head, n);
+		data += n;
+		nbytes -= n;
+		if ( (c->head += n) == c->tail )
+		{
+			if ( !(p->first = c->next) )
+				p->last = NULL;
+			CacheFree(&chunk_cache, c);
+		}
+	}
+}
+
+static void
+write_data(Pipe_t *p, char *data, unsigned nbytes)
+{
+	PipeChunk_t *c;
+	unsigned n;
+
+	if ( p->buf )
+	{
+		while ( nbytes-- )
+		{
+			*p->tail++ = *data++;
+			if ( p->tail == p->end )
+				p->tail = p->buf;
+		}
+		return;
+	}
+
+	while ( nbytes )
+	{
+		if ( !(c = p->last) || c->tail == CHUNK_DATA )
+		{
+			c = CacheAlloc(&chunk_cache);
+			c->next = NULL;
+			c->head = c->tail = 0;
+			if ( p->last )
+				p->last->next = c;
+			else
+				p->first = c;
+			p->last = c;
+		}
+		n = min(nbytes, CHUNK_DATA - c->tail);
+		memcpy(c->data + c->tail, data, n);
+		data += n;
+		nbytes -= n;
+		c->tail += n;
+	}
+}
@@ -1,11 +1,28 @@
 #include <kernel.h>
 
+/*
+La cuenta se guarda multiplicada por dos, y el bit 0 indica que puede haber
+tareas esperando. Mientras el bit está en cero WaitSem() con cuenta positiva
+y SignalSem() se resuelven con una instrucción lock cmpxchg, sin deshabilitar
+interrupciones; el resto pasa por el camino lento, con interrupciones
+deshabilitadas. El bit lo levanta una tarea antes de bloquearse y lo baja
+SignalSem() cuando la cola queda vacía. Con mt_fast_locks en false todo pasa
+por el camino lento, como antes de usar cmpxchg, para comparar (ver locks.c).
+*/
+
+#define SEM_WAITERS		1
+#define SEM_ONE			2
+
 struct Semaphore_t
 {
-	TaskQueue_t		queue;
-	unsigned		value;
+	TaskQueue_t			queue;
+	volatile unsigned	value;
 };
 
+static void init_sem(void *obj);
+
+static Cache_t sem_cache = MT_CACHE("semaphores", Semaphore_t, init_sem, NULL);
+
 /*
 --------------------------------------------------------------------------------
 CreateSem - aloca un semaforo y establece su cuenta inicial
@@ -14,10 +31,10 @@ CreateSem - aloca un semaforo y establece su cuenta inicial
 
 Semaphore_t *CreateSem(const char *name, unsigned value)
 {
-	Semaphore_t *sem = Malloc(sizeof(Semaphore_t));
+	Semaphore_t *sem = CacheAlloc(&sem_cache);
 
-	sem->queue.name = StrDup(name);
-	sem->value = value;
+	sem->queue.name = mt_name_dup(name);
+	sem->value = value * SEM_ONE;
 	return sem;
 }
 
@@ -32,8 +49,9 @@ DeleteSem(Semaphore_t *sem)
 {
 	bool ints = SetInts(false);
 	FlushQueue(&sem->queue, false);
-	Free(GetName(sem));
-	Free(sem);
+	mt_name_free(GetName(sem));
+	sem->queue.name = NULL;
+	CacheFree(&sem_cache, sem);
 	SetInts(ints);
 }
 
@@ -62,13 +80,21 @@ WaitSemCond(Semaphore_t *sem)
 bool
 WaitSemTimed(Semaphore_t *sem, unsigned msecs)
 {
+	unsigned value;
 	bool success;
 
+	while ( mt_fast_locks && (value = sem->value) >= SEM_ONE )
+		if ( mt_cmpxchg(&sem->value, value, value - SEM_ONE) )
+			return true;
+
 	bool ints = SetInts(false);
-	if ( (success = (sem->value > 0)) )
-		sem->value--;
-	else
+	if ( (success = (sem->value >= SEM_ONE)) )
+		sem->value -= SEM_ONE;
+	else if ( msecs )
+	{
+		sem->value |= SEM_WAITERS;
 		success = WaitQueueTimed(&sem->queue, msecs);
+	}
 	SetInts(ints);
 
 	return success;
@@ -86,9 +112,17 @@ esta vacia.
 void
 SignalSem(Semaphore_t *sem)
 {
+	unsigned value;
+
+	while ( mt_fast_locks && !((value = sem->value) & SEM_WAITERS) )
+		if ( mt_cmpxchg(&sem->value, value, value + SEM_ONE) )
+			return;
+
 	bool ints = SetInts(false);
+	if ( sem->queue.count <= 1 )
+		sem->value &= ~SEM_WAITERS;				// la cola queda vacía
 	if ( !SignalQueue(&sem->queue) )
-		sem->value++;
+		sem->value += SEM_ONE;
 	SetInts(ints);
 }
 
@@ -101,7 +135,7 @@ ValueSem - informa la cuenta de un semaforo
 unsigned	
 ValueSem(Semaphore_t *sem)
 {
-	return sem->value;
+	return sem->value / SEM_ONE;
 }
 
 /*
@@ -121,3 +155,17 @@ FlushSem(Semaphore_t *sem, bool wait_ok)
 	FlushQueue(&sem->queue, wait_ok);
 	SetInts(ints);
 }
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+init_sem - constructor para sem_cache, un semáforo con la cola vacía
+--------------------------------------------------------------------------------
+*/
+
+static void
+init_sem(void *obj)
+{
+	memset(obj, 0, sizeof(Semaphore_t));
+}
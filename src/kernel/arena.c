@@ -0,0 +1,211 @@
+#include <kernel.h>
+
+/*
+	Arenas.
+
+	Una arena entrega memoria incrementando un puntero dentro de bloques
+	grandes (chunks) tomados del heap, y la libera toda junta: hasta una
+	marca con ArenaRelease(), o completa con DeleteArena(). No hay
+	liberación individual, de modo que alocar cuesta unas pocas
+	instrucciones y no toca las listas del heap. Conviene para muchos
+	objetos chicos que mueren al mismo tiempo.
+
+	Las arenas no tienen exclusión mutua: cada una debe usarse desde una
+	sola tarea, o protegerse externamente. Una arena creada con una tarea
+	dueña se destruye cuando la tarea ejecuta Exit().
+
+	Los chunks son memoria de la aplicación: se cuentan a la tarea dueña, o
+	a la que los aloca si la arena no tiene dueña, y están sujetos a su
+	límite (ver SetMemLimit()). El bloque de control de la arena es memoria
+	del kernel.
+*/
+
+#define ALIGN			8						// alineación de ArenaAlloc()
+#define MIN_CHUNK		256						// tamaño mínimo de un chunk
+
+typedef struct chunk chunk_t;
+
+struct chunk
+{
+	chunk_t *		prev;						// chunk anterior de la arena
+	char *			end;						// fin del chunk
+	double			data[];						// memoria alineada
+};
+
+struct Arena_t
+{
+	char *			name;						// primer campo, para GetName()
+	unsigned		chunk_size;					// tamaño de los chunks
+	chunk_t *		chunk;						// chunk actual
+	char *			ptr;						// primer byte libre del chunk
+	Task_t *		owner;						// tarea dueña, o NULL
+	Arena_t *		prev;						// lista de arenas de la tarea
+	Arena_t *		next;						// .
+};
+
+static chunk_t *new_chunk(Arena_t *arena, unsigned size);
+
+/*
+--------------------------------------------------------------------------------
+CreateArena - crea una arena
+
+chunk_size es el tamaño de los bloques que se toman del heap. Si owner no
+es NULL la arena se destruye automáticamente cuando esa tarea termina.
+El primer chunk se aloca inmediatamente; si no se puede retorna NULL.
+--------------------------------------------------------------------------------
+*/
+
+Arena_t *
+CreateArena(const char *name, unsigned chunk_size, Task_t *owner)
+{
+	Arena_t *arena = mt_kalloc(sizeof(Arena_t));
+
+	arena->owner = owner;
+	arena->chunk_size = (max(chunk_size, MIN_CHUNK) + ALIGN - 1) & ~(ALIGN - 1);
+	if ( !arena->chunk_size || !new_chunk(arena, arena->chunk_size) )
+	{
+		Free(arena);
+		return NULL;
+	}
+	arena->name = mt_name_dup(name);
+	if ( owner )
+	{
+		Atomic();
+		if ( (arena->next = owner->arenas) )
+			arena->next->prev = arena;
+		owner->arenas = arena;
+		Unatomic();
+	}
+	return arena;
+}
+
+/*
+--------------------------------------------------------------------------------
+DeleteArena - destruye una arena liberando toda su memoria
+--------------------------------------------------------------------------------
+*/
+
+void
+DeleteArena(Arena_t *arena)
+{
+	chunk_t *c;
+
+	if ( arena->owner )
+	{
+		Atomic();
+		if ( arena->next )
+			arena->next->prev = arena->prev;
+		if ( arena->prev )
+			arena->prev->next = arena->next;
+		else
+			arena->owner->arenas = arena->next;
+		Unatomic();
+	}
+	while ( (c = arena->chunk) )
+	{
+		arena->chunk = c->prev;
+		Free(c);
+	}
+	mt_name_free(arena->name);
+	Free(arena);
+}
+
+/*
+--------------------------------------------------------------------------------
+ArenaAlloc - aloca memoria de una arena
+
+La memoria está alineada a 8 bytes y no se inicializa. Un pedido mayor que
+el tamaño de los chunks recibe un chunk propio. Retorna NULL si hace falta
+un chunk nuevo y no se puede alocar, porque la tarea a la que se cuenta
+alcanzó su límite o no hay memoria, o si size es demasiado grande.
+--------------------------------------------------------------------------------
+*/
+
+void *
+ArenaAlloc(Arena_t *arena, unsigned size)
+{
+	char *p;
+
+	if ( size > ~0U - (ALIGN - 1) )
+		return NULL;
+	size = (size + ALIGN - 1) & ~(ALIGN - 1);
+	if ( size > arena->chunk->end - arena->ptr &&
+			!new_chunk(arena, max(size, arena->chunk_size)) )
+		return NULL;
+	p = arena->ptr;
+	arena->ptr += size;
+	return p;
+}
+
+/*
+--------------------------------------------------------------------------------
+ArenaMark - retorna una marca con el estado actual de una arena
+--------------------------------------------------------------------------------
+*/
+
+void *
+ArenaMark(Arena_t *arena)
+{
+	return arena->ptr;
+}
+
+/*
+--------------------------------------------------------------------------------
+ArenaRelease - libera toda la memoria alocada en una arena después de una
+	marca obtenida con ArenaMark().
+--------------------------------------------------------------------------------
+*/
+
+void
+ArenaRelease(Arena_t *arena, void *mark)
+{
+	chunk_t *c;
+	char *m = mark;
+
+	while ( (c = arena->chunk) && (m < (char *) c->data || m > c->end) )
+	{
+		if ( !c->prev )
+			Panic("ArenaRelease %s: marca invalida", arena->name);
+		arena->chunk = c->prev;
+		Free(c);
+	}
+	arena->ptr = m;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_delete_arenas - destruye las arenas de una tarea, llamada desde Exit()
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_delete_arenas(Task_t *task)
+{
+	while ( task->arenas )
+		DeleteArena(task->arenas);
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+new_chunk - agrega un chunk de al menos size bytes y lo hace actual.
+	Retorna NULL, sin cambiar la arena, si no se pudo alocar.
+--------------------------------------------------------------------------------
+*/
+
+static chunk_t *
+new_chunk(Arena_t *arena, unsigned size)
+{
+	Task_t *task = arena->owner ? arena->owner : mt_curr_task;
+	chunk_t *c;
+
+	if ( size > ~0U - sizeof(chunk_t) || !(c = mt_task_alloc(task, sizeof(chunk_t) + size)) )
+		return NULL;
+
+	c->prev = arena->chunk;
+	c->end = (char *) c->data + size;
+	arena->chunk = c;
+	arena->ptr = (char *) c->data;
+	return c;
+}
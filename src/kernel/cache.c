@@ -0,0 +1,392 @@
+#include <kernel.h>
+
+/*
+	Caches de objetos (slab allocator).
+
+	Cada cache entrega objetos de un tamaño fijo, tomados de slabs que se
+	alocan del heap. Los objetos de un slab se construyen una sola vez al
+	crearlo, llamando al constructor del cache, y CacheFree() los devuelve
+	al slab sin destruirlos. Por lo tanto un objeto debe liberarse en su
+	estado construido, y CacheAlloc() lo entrega en ese mismo estado.
+	El destructor se llama recién cuando se libera el slab.
+
+	Cada slab está en una de tres listas según sus objetos en uso: llenos,
+	parciales y vacíos. Se aloca de los parciales, para concentrar los
+	objetos en pocos slabs, y se conservan hasta MAX_EMPTY slabs vacíos
+	listos para usar. Al final de cada objeto hay un enlace que mientras el
+	objeto está libre apunta al siguiente objeto libre del slab, y mientras
+	está en uso apunta a su slab.
+
+	Los objetos de slabs sucesivos comienzan con distinto desplazamiento
+	(coloreo), aprovechando el espacio que sobra al final de cada slab, para
+	que los objetos de igual posición en distintos slabs no compitan por las
+	mismas líneas de cache.
+
+	Los objetos se alinean como su tipo, y por lo menos a ALIGN. El relleno
+	necesario para alinear el primer objeto se reserva al calcular la
+	disposición del slab.
+*/
+
+#define ALIGN			8						// alineación mínima de los objetos
+#define SLAB_SIZE		0x1000					// tamaño mínimo de un slab
+#define MIN_PER_SLAB	8						// mínimo de objetos por slab
+#define MAX_EMPTY		2						// slabs vacíos conservados
+#define NAME_SIZE		32						// nombres en name_cache
+
+#define HEADER			((sizeof(mt_slab_t) + ALIGN - 1) & ~(ALIGN - 1))
+#define COLOR(c)		max((c)->align, CACHE_LINE)		// paso del coloreo
+#define LINK(c, obj)	(*(char **) ((char *) (obj) + (c)->link))
+
+// Cabecera de un slab, al comienzo de su memoria
+struct mt_slab_t
+{
+	Cache_t *		cache;
+	mt_slab_t *		next;
+	mt_slab_t *		prev;
+	mt_slab_t **	list;						// lista donde está el slab
+	unsigned		in_use;						// objetos en uso
+	char *			free;						// primer objeto libre
+};
+
+typedef char name_t[NAME_SIZE];
+
+static Cache_t *cache_list;						// caches existentes
+static unsigned num_caches;						// cantidad de caches
+static Cache_t name_cache = MT_CACHE("names", name_t, NULL, NULL);
+
+static void setup_cache(Cache_t *cache);
+static mt_slab_t *grow(Cache_t *cache);
+static void destroy_slab(Cache_t *cache, mt_slab_t *slab);
+static void move_slab(mt_slab_t *slab, mt_slab_t **list);
+
+/*
+--------------------------------------------------------------------------------
+CreateCache - crea un cache de objetos
+
+Recibe un nombre, el tamaño de los objetos y un constructor y un destructor,
+que pueden ser NULL. El constructor se llama al crear cada objeto por
+primera vez, y el destructor al liberar su memoria.
+--------------------------------------------------------------------------------
+*/
+
+Cache_t *
+CreateCache(const char *name, unsigned size, CacheFunc_t ctor, CacheFunc_t dtor)
+{
+	Cache_t *cache = mt_kalloc(sizeof(Cache_t));
+
+	cache->name = mt_kstrdup(name);
+	cache->size = size;
+	cache->align = ALIGN;
+	cache->ctor = ctor;
+	cache->dtor = dtor;
+	Atomic();
+	setup_cache(cache);
+	Unatomic();
+	return cache;
+}
+
+/*
+--------------------------------------------------------------------------------
+DeleteCache - destruye un cache creado con CreateCache()
+
+Todos sus objetos deben haber sido liberados.
+--------------------------------------------------------------------------------
+*/
+
+void
+DeleteCache(Cache_t *cache)
+{
+	Cache_t **p;
+
+	Atomic();
+	if ( cache->in_use )
+		Panic("DeleteCache %s: %u objetos en uso", cache->name, cache->in_use);
+	while ( cache->empty )
+	{
+		mt_slab_t *slab = cache->empty;
+		move_slab(slab, NULL);
+		cache->nempty--;
+		destroy_slab(cache, slab);
+	}
+	for ( p = &cache_list ; *p != cache ; p = &(*p)->next )
+		;
+	*p = cache->next;
+	num_caches--;
+	Unatomic();
+	Free(cache->name);
+	Free(cache);
+}
+
+/*
+--------------------------------------------------------------------------------
+CacheAlloc - obtiene un objeto construido de un cache
+--------------------------------------------------------------------------------
+*/
+
+void *
+CacheAlloc(Cache_t *cache)
+{
+	mt_slab_t *slab;
+	char *obj;
+
+	Atomic();
+	if ( !cache->slot )
+		setup_cache(cache);
+	if ( !(slab = cache->partial) )
+	{
+		if ( !(slab = cache->empty) )
+			slab = grow(cache);
+		cache->nempty--;
+		move_slab(slab, &cache->partial);
+	}
+	obj = slab->free;
+	slab->free = LINK(cache, obj);
+	LINK(cache, obj) = (char *) slab;
+	if ( ++slab->in_use == cache->per_slab )
+		move_slab(slab, &cache->full);
+	cache->in_use++;
+	cache->allocs++;
+	Unatomic();
+
+	return obj;
+}
+
+/*
+--------------------------------------------------------------------------------
+CacheFree - devuelve un objeto a su cache, en su estado construido
+--------------------------------------------------------------------------------
+*/
+
+void
+CacheFree(Cache_t *cache, void *obj)
+{
+	mt_slab_t *slab;
+
+	if ( !obj )
+		return;
+
+	Atomic();
+	slab = (mt_slab_t *) LINK(cache, obj);
+	if ( slab->cache != cache )
+		Panic("CacheFree %s: objeto invalido %x", cache->name, obj);
+	LINK(cache, obj) = slab->free;
+	slab->free = obj;
+	if ( slab->in_use-- == cache->per_slab )
+		move_slab(slab, &cache->partial);
+	if ( !slab->in_use )
+	{
+		if ( cache->nempty < MAX_EMPTY )
+		{
+			move_slab(slab, &cache->empty);
+			cache->nempty++;
+		}
+		else
+		{
+			move_slab(slab, NULL);
+			destroy_slab(cache, slab);
+		}
+	}
+	cache->in_use--;
+	cache->frees++;
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+GetCacheInfo - devuelve información sobre un cache
+--------------------------------------------------------------------------------
+*/
+
+void
+GetCacheInfo(Cache_t *cache, CacheInfo_t *info)
+{
+	Atomic();
+	info->cache = cache;
+	info->size = cache->size;
+	info->per_slab = cache->per_slab;
+	info->slabs = cache->slabs;
+	info->objects = cache->slabs * cache->per_slab;
+	info->in_use = cache->in_use;
+	info->allocs = cache->allocs;
+	info->frees = cache->frees;
+	info->ctors = cache->ctors;
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+GetCaches - devuelve información sobre los caches existentes
+
+Retorna un array de estructuras de tipo CacheInfo_t, una por cache, y la
+cantidad de caches. El array está alocado dinámicamente, liberar llamando a
+Free().
+--------------------------------------------------------------------------------
+*/
+
+CacheInfo_t *
+GetCaches(unsigned *ncaches)
+{
+	Cache_t *c;
+	CacheInfo_t *ci, *info;
+
+	Atomic();
+	*ncaches = num_caches;
+	for ( c = cache_list, ci = info = mt_kalloc(num_caches * sizeof(CacheInfo_t)) ; c ; c = c->next, ci++ )
+		GetCacheInfo(c, ci);
+	Unatomic();
+	return info;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_name_dup, mt_name_free - copia y liberación de nombres de objetos
+
+Los nombres cortos se toman de un cache, los largos del heap, sin contarse
+como memoria de la tarea actual.
+--------------------------------------------------------------------------------
+*/
+
+char *
+mt_name_dup(const char *name)
+{
+	char *p;
+
+	if ( !name )
+		return NULL;
+	if ( strlen(name) >= NAME_SIZE )
+		return mt_kstrdup(name);
+	p = CacheAlloc(&name_cache);
+	strcpy(p, name);
+	return p;
+}
+
+void
+mt_name_free(char *name)
+{
+	if ( !name )
+		return;
+	if ( strlen(name) >= NAME_SIZE )
+		Free(name);
+	else
+		CacheFree(&name_cache, name);
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+setup_cache - calcula la disposición de los slabs de un cache y lo agrega
+	a la lista de caches.
+--------------------------------------------------------------------------------
+*/
+
+static void
+setup_cache(Cache_t *cache)
+{
+	unsigned left, pad;
+
+	if ( cache->align < ALIGN )
+		cache->align = ALIGN;
+	pad = cache->align - ALIGN;					// malloc() alinea a ALIGN
+	cache->link = (cache->size + sizeof(char *) - 1) & ~(sizeof(char *) - 1);
+	cache->slot = (cache->link + sizeof(char *) + cache->align - 1) & ~(cache->align - 1);
+	for ( cache->slab_size = SLAB_SIZE ; (cache->slab_size - HEADER - pad) / cache->slot < MIN_PER_SLAB ; )
+		cache->slab_size += SLAB_SIZE;
+	cache->per_slab = (cache->slab_size - HEADER - pad) / cache->slot;
+	left = cache->slab_size - HEADER - pad - cache->per_slab * cache->slot;
+	cache->color_max = left - left % COLOR(cache);
+
+	cache->next = cache_list;
+	cache_list = cache;
+	num_caches++;
+}
+
+/*
+--------------------------------------------------------------------------------
+grow - aloca un slab nuevo, construye sus objetos y lo pone en la lista de
+	slabs vacíos.
+--------------------------------------------------------------------------------
+*/
+
+static mt_slab_t *
+grow(Cache_t *cache)
+{
+	mt_slab_t *slab;
+	char *obj;
+	unsigned i;
+
+	if ( !(slab = malloc(cache->slab_size)) )
+		Panic("CacheAlloc %s: memoria insuficiente", cache->name);
+	slab->cache = cache;
+	slab->list = NULL;
+	slab->in_use = 0;
+	slab->free = NULL;
+
+	// Construir los objetos, enlazados en orden de direcciones
+	obj = (char *) (((unsigned) slab + HEADER + cache->align - 1) & ~(cache->align - 1));
+	obj += cache->color + cache->per_slab * cache->slot;
+	for ( i = 0 ; i < cache->per_slab ; i++ )
+	{
+		obj -= cache->slot;
+		if ( cache->ctor )
+		{
+			cache->ctor(obj);
+			cache->ctors++;
+		}
+		LINK(cache, obj) = slab->free;
+		slab->free = obj;
+	}
+
+	if ( (cache->color += COLOR(cache)) > cache->color_max )
+		cache->color = 0;
+	cache->slabs++;
+	move_slab(slab, &cache->empty);
+	cache->nempty++;
+	return slab;
+}
+
+/*
+--------------------------------------------------------------------------------
+destroy_slab - destruye los objetos de un slab sin objetos en uso y libera
+	su memoria.
+--------------------------------------------------------------------------------
+*/
+
+static void
+destroy_slab(Cache_t *cache, mt_slab_t *slab)
+{
+	char *obj;
+
+	if ( cache->dtor )
+		for ( obj = slab->free ; obj ; obj = LINK(cache, obj) )
+			cache->dtor(obj);
+	cache->slabs--;
+	free(slab);
+}
+
+/*
+--------------------------------------------------------------------------------
+move_slab - pasa un slab a otra lista, o lo saca de su lista si es NULL
+--------------------------------------------------------------------------------
+*/
+
+static void
+move_slab(mt_slab_t *slab, mt_slab_t **list)
+{
+	if ( slab->list )
+	{
+		if ( slab->next )
+			slab->next->prev = slab->prev;
+		if ( slab->prev )
+			slab->prev->next = slab->next;
+		else
+			*slab->list = slab->next;
+	}
+	if ( (slab->list = list) )
+	{
+		slab->prev = NULL;
+		if ( (slab->next = *list) )
+			slab->next->prev = slab;
+		*list = slab;
+	}
+}
@@ -0,0 +1,358 @@
+#include <kernel.h>
+
+/*
+	Programas de usuario compilados por separado.
+
+	Los programas llegan como módulos multiboot (ver boot/menu.lst) y quedan
+	en la memoria donde los dejó el bootloader, que se excluye del heap.
+	Cada ejecución copia el programa a una imagen nueva en el heap. Como no
+	tenemos memoria virtual, los programas se compilan como ejecutables
+	independientes de la posición (ET_DYN) y solamente requieren
+	relocalizaciones R_386_RELATIVE.
+*/
+
+#define MAX_PROGRAMS	16
+#define NAMESIZE		32
+
+#define EI_NIDENT		16
+#define ELFMAG			"\177ELF"
+#define ELFCLASS32		1
+#define ELFDATA2LSB		1
+#define ET_DYN			3
+#define EM_386			3
+#define PT_LOAD			1
+#define PT_DYNAMIC		2
+#define DT_NULL			0
+#define DT_REL			17
+#define DT_RELSZ		18
+#define DT_RELENT		19
+#define R_386_NONE		0
+#define R_386_RELATIVE	8
+
+typedef struct
+{
+	unsigned char	e_ident[EI_NIDENT];
+	unsigned short	e_type;
+	unsigned short	e_machine;
+	unsigned		e_version;
+	unsigned		e_entry;
+	unsigned		e_phoff;
+	unsigned		e_shoff;
+	unsigned		e_flags;
+	unsigned short	e_ehsize;
+	unsigned short	e_phentsize;
+	unsigned short	e_phnum;
+	unsigned short	e_shentsize;
+	unsigned short	e_shnum;
+	unsigned short	e_shstrndx;
+}
+Elf32_Ehdr;
+
+typedef struct
+{
+	unsigned		p_type;
+	unsigned		p_offset;
+	unsigned		p_vaddr;
+	unsigned		p_paddr;
+	unsigned		p_filesz;
+	unsigned		p_memsz;
+	unsigned		p_flags;
+	unsigned		p_align;
+}
+Elf32_Phdr;
+
+typedef struct
+{
+	int				d_tag;
+	unsigned		d_val;
+}
+Elf32_Dyn;
+
+typedef struct
+{
+	unsigned		r_offset;
+	unsigned		r_info;
+}
+Elf32_Rel;
+
+// Módulo multiboot
+typedef struct
+{
+	unsigned		mod_start;
+	unsigned		mod_end;
+	char *			string;
+	unsigned		reserved;
+}
+module_t;
+
+// Programa disponible
+typedef struct
+{
+	char			name[NAMESIZE];
+	char *			start;
+	unsigned		size;
+}
+program_t;
+
+static program_t programs[MAX_PROGRAMS];
+static unsigned nprograms;
+
+static program_t *find_program(const char *name);
+static mt_image_t *load_image(program_t *prog, unsigned *entry);
+
+/*
+--------------------------------------------------------------------------------
+mt_setup_programs - registra los programas recibidos como módulos multiboot
+
+El nombre de cada programa es el último componente del path con que se cargó
+el módulo. Se llama antes de inicializar el heap y retorna la dirección de fin
+del último módulo, para que el heap comience después.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_setup_programs(unsigned nmods, void *mods)
+{
+	module_t *mod;
+	program_t *prog;
+	char *s, *name;
+	unsigned i, end = 0;
+
+	for ( i = 0, mod = mods ; i < nmods && nprograms < MAX_PROGRAMS ; i++, mod++ )
+	{
+		if ( mod->mod_end > end )
+			end = mod->mod_end;
+		for ( name = s = mod->string ; s && *s && *s != ' ' ; s++ )
+			if ( *s == '/' )
+				name = s + 1;
+		if ( !name || name == s )
+			continue;
+		prog = &programs[nprograms++];
+		strncpy(prog->name, name, min(s - name, NAMESIZE - 1));
+		prog->start = (char *) mod->mod_start;
+		prog->size = mod->mod_end - mod->mod_start;
+		print0("Programa %s: %u bytes\n", prog->name, prog->size);
+	}
+
+	return end;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_program_name - nombre del programa n, o NULL si no existe
+--------------------------------------------------------------------------------
+*/
+
+const char *
+mt_program_name(unsigned n)
+{
+	return n < nprograms ? programs[n].name : NULL;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_exec - crea una tarea de usuario que ejecuta un programa
+
+Carga una imagen nueva del programa y crea una tarea de usuario que comienza
+en su punto de entrada como si se hubiera llamado a _start(argc, argv).
+Los argumentos se copian al stack de usuario. Retorna NULL si el programa no
+existe o no es válido, o si no se pudo crear la tarea. La tarea está
+inicialmente suspendida.
+--------------------------------------------------------------------------------
+*/
+
+Task_t *
+mt_exec(const char *name, int argc, char *argv[], unsigned priority)
+{
+	program_t *prog;
+	mt_image_t *image;
+	Task_t *task;
+	unsigned entry, frame[3];
+	char **uargv;
+	int i;
+
+	if ( !(prog = find_program(name)) || !(image = load_image(prog, &entry)) )
+		return NULL;
+
+	// La tarea toma su propia referencia a la imagen
+	task = mt_create_user_task(image, entry, MAIN_STKSIZE, name, priority);
+	mt_release_image(image);
+	if ( !task )
+		return NULL;
+
+	// Copiar los argumentos al stack de usuario
+	uargv = mt_kalloc((argc + 1) * sizeof(char *));
+	for ( i = argc - 1 ; i >= 0 ; i-- )
+		uargv[i] = mt_user_push(task, argv[i], strlen(argv[i]) + 1);
+	frame[0] = 0;								// dirección de retorno (no se usa)
+	frame[1] = argc;							// primer argumento de _start
+	frame[2] = (unsigned) mt_user_push(task, uargv, (argc + 1) * sizeof(char *));
+	mt_user_push(task, frame, sizeof frame);
+	Free(uargv);
+
+	return task;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_release_image - libera una referencia a una imagen, y la imagen cuando no
+	quedan tareas que la usen.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_release_image(mt_image_t *image)
+{
+	Atomic();
+	if ( !--image->refs )
+	{
+		Free(image->base);
+		Free(image);
+	}
+	Unatomic();
+}
+
+/* Funciones internas */
+
+static program_t *
+find_program(const char *name)
+{
+	unsigned i;
+
+	for ( i = 0 ; i < nprograms ; i++ )
+		if ( strcmp(programs[i].name, name) == 0 )
+			return &programs[i];
+	return NULL;
+}
+
+/*
+--------------------------------------------------------------------------------
+in_range - verifica que [offset, offset + size) esté dentro de [0, limit)
+	sin desbordar
+--------------------------------------------------------------------------------
+*/
+
+static bool
+in_range(unsigned offset, unsigned size, unsigned limit)
+{
+	return offset <= limit && size <= limit - offset;
+}
+
+/*
+--------------------------------------------------------------------------------
+load_image - carga un programa en una imagen nueva
+
+Copia los segmentos PT_LOAD respetando sus direcciones relativas, pone en
+cero el resto y aplica las relocalizaciones de la sección dinámica. Todos
+los encabezados de programa, la sección dinámica y cada relocalización se
+verifican contra el tamaño del archivo o de la imagen antes de usarlos.
+Retorna la imagen con una referencia, o NULL si el ELF no es válido.
+--------------------------------------------------------------------------------
+*/
+
+static mt_image_t *
+load_image(program_t *prog, unsigned *entry)
+{
+	Elf32_Ehdr *eh = (Elf32_Ehdr *) prog->start;
+	Elf32_Phdr *ph, *dph = NULL;
+	Elf32_Dyn *dyn;
+	Elf32_Rel *rel;
+	mt_image_t *image;
+	unsigned i, ndyn, size, reloff = 0, relsz = 0, relent = sizeof(Elf32_Rel);
+
+	if ( prog->size < sizeof *eh || strncmp((char *) eh->e_ident, ELFMAG, 4) != 0 ||
+			eh->e_ident[4] != ELFCLASS32 || eh->e_ident[5] != ELFDATA2LSB ||
+			eh->e_type != ET_DYN || eh->e_machine != EM_386 ||
+			eh->e_phentsize != sizeof *ph ||
+			!in_range(eh->e_phoff, eh->e_phnum * sizeof *ph, prog->size) )
+	{
+		printk("%s: no es un ejecutable ELF independiente de la posición\n", prog->name);
+		return NULL;
+	}
+
+	// Verificar los segmentos y calcular el tamaño de la imagen
+	ph = (Elf32_Phdr *) (prog->start + eh->e_phoff);
+	for ( size = 0, i = 0 ; i < eh->e_phnum ; i++ )
+		if ( ph[i].p_type == PT_LOAD )
+		{
+			if ( ph[i].p_filesz > ph[i].p_memsz ||
+					!in_range(ph[i].p_offset, ph[i].p_filesz, prog->size) ||
+					!in_range(ph[i].p_vaddr, ph[i].p_memsz, ~0U) )
+			{
+				printk("%s: segmento %u inválido\n", prog->name, i);
+				return NULL;
+			}
+			if ( ph[i].p_vaddr + ph[i].p_memsz > size )
+				size = ph[i].p_vaddr + ph[i].p_memsz;
+		}
+		else if ( ph[i].p_type == PT_DYNAMIC )
+			dph = &ph[i];
+
+	if ( eh->e_entry >= size || (dph && !in_range(dph->p_vaddr, dph->p_memsz, size)) )
+	{
+		printk("%s: punto de entrada o sección dinámica fuera de la imagen\n", prog->name);
+		return NULL;
+	}
+
+	// Alocar la imagen, mt_kalloc() la pone en cero. Es memoria del kernel,
+	// compartida por las tareas que ejecutan el programa.
+	image = mt_kalloc(sizeof(mt_image_t));
+	image->base = mt_kalloc(image->size = size);
+	image->refs = 1;
+
+	// Copiar los segmentos
+	for ( i = 0 ; i < eh->e_phnum ; i++ )
+		if ( ph[i].p_type == PT_LOAD )
+			memcpy(image->base + ph[i].p_vaddr, prog->start + ph[i].p_offset, ph[i].p_filesz);
+
+	// Relocalizar
+	if ( dph )
+	{
+		dyn = (Elf32_Dyn *) (image->base + dph->p_vaddr);
+		ndyn = dph->p_memsz / sizeof *dyn;
+		for ( i = 0 ; i < ndyn && dyn[i].d_tag != DT_NULL ; i++ )
+			switch ( dyn[i].d_tag )
+			{
+				case DT_REL:
+					reloff = dyn[i].d_val;
+					break;
+				case DT_RELSZ:
+					relsz = dyn[i].d_val;
+					break;
+				case DT_RELENT:
+					relent = dyn[i].d_val;
+					break;
+			}
+	}
+	if ( relsz && (relent < sizeof *rel || !in_range(reloff, relsz, size)) )
+	{
+		printk("%s: tabla de relocalizaciones inválida\n", prog->name);
+		mt_release_image(image);
+		return NULL;
+	}
+	for ( i = 0 ; i < relsz / relent ; i++ )
+	{
+		rel = (Elf32_Rel *) (image->base + reloff + i * relent);
+		switch ( rel->r_info & 0xFF )
+		{
+			case R_386_NONE:
+				break;
+			case R_386_RELATIVE:
+				if ( !in_range(rel->r_offset, sizeof(unsigned), size) )
+				{
+					printk("%s: relocalización fuera de la imagen\n", prog->name);
+					mt_release_image(image);
+					return NULL;
+				}
+				*(unsigned *)(image->base + rel->r_offset) += (unsigned) image->base;
+				break;
+			default:
+				printk("%s: relocalización %u no soportada\n", prog->name, rel->r_info & 0xFF);
+				mt_release_image(image);
+				return NULL;
+		}
+	}
+
+	*entry = (unsigned) image->base + eh->e_entry;
+	return image;
+}
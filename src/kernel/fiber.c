@@ -0,0 +1,432 @@
+#include <kernel.h>
+
+/*
+Fibras: contextos de ejecución cooperativos dentro de una tarea.
+
+Cada fibra tiene su propio stack, que puede ser mucho más chico que el de una
+tarea, y no ocupa lugar en las estructuras del scheduler: las fibras de una
+tarea se turnan en una cola propia y solamente ceden la CPU entre ellas en
+YieldFiber(), ExitFiber(), JoinFibers() o al bloquearse en un objeto con las
+funciones "Fiber" (ver GetPipeFiber() y GetMsgQueueFiber()). El contexto
+principal de la tarea participa del turno como una fibra más. Si no hay
+fibras listas, la tarea se bloquea hasta que se despierte alguna.
+
+Los cambios de fibra se hacen en modo atómico, de modo que no pueden hacerse
+desde una sección atómica de la aplicación.
+*/
+
+#define FIBER_MAGIC		0x46494252			// al pie del stack de cada fibra
+
+struct Fiber_t
+{
+	void *				esp;			// contexto guardado por mt_switch_fiber()
+	Task_t *			task;
+	FiberFunc_t			func;
+	void *				arg;
+	mt_fiber_queue_t *	queue;			// cola en la que está la fibra
+	bool				success;		// resultado de la última espera
+	Fiber_t *			prev;
+	Fiber_t *			next;
+	Fiber_t *			list_prev;		// lista de fibras de la tarea
+	Fiber_t *			list_next;
+	unsigned *			stack;			// pie del stack, NULL en el contexto principal
+};
+
+// Fibras de una tarea, se crean con la primera fibra
+struct mt_fibers_t
+{
+	Fiber_t				main;			// contexto principal de la tarea
+	Fiber_t *			current;		// fibra que está ejecutando
+	Fiber_t *			dead;			// fibra terminada, la libera la siguiente
+	Fiber_t *			list;			// fibras creadas y no terminadas
+	unsigned			count;			// .
+	mt_fiber_queue_t	ready;			// fibras listas
+	mt_fiber_queue_t	join;			// contexto principal en JoinFibers()
+	TaskQueue_t			idle;			// la tarea, mientras no hay fibras listas
+};
+
+// Stackframe inicial de una fibra
+typedef struct
+{
+	mt_fast_regs_t		regs;			// registros que recupera mt_switch_fiber()
+	void				(*retaddr)(void);	// dirección de retorno de start() (no se usa)
+	Fiber_t *			fiber;			// argumento de start()
+}
+InitialStack_t;
+
+static mt_fibers_t *get_fibers(void);			/* fibras de la tarea actual */
+static void enqueue(Fiber_t *fiber, mt_fiber_queue_t *queue);
+static void dequeue(Fiber_t *fiber);
+static void schedule(mt_fibers_t *fs);			/* pasar a la próxima fibra lista */
+static void reap(mt_fibers_t *fs);				/* liberar la fibra terminada */
+static void wakeup(mt_fiber_queue_t *queue, bool all, bool success);
+static void start(Fiber_t *fiber);				/* cuerpo de una fibra */
+
+/*
+--------------------------------------------------------------------------------
+CreateFiber - crea una fibra en la tarea actual
+
+Recibe la función de la fibra, su argumento y el tamaño del stack; si es cero
+se usa FIBER_STKSIZE. El stack y el bloque de control se alocan juntos con
+Malloc(), de modo que cuentan para el límite de memoria de la tarea; retorna
+NULL si se alcanzó el límite. La fibra queda lista y empieza a ejecutar
+cuando la fibra actual cede la CPU. Termina al retornar de su función o al
+llamar a ExitFiber(), y también cuando termina la tarea.
+--------------------------------------------------------------------------------
+*/
+
+Fiber_t *
+CreateFiber(FiberFunc_t func, void *arg, unsigned stacksize)
+{
+	mt_fibers_t *fs = get_fibers();
+	InitialStack_t *s;
+	Fiber_t *fiber;
+
+	if ( !stacksize )
+		stacksize = FIBER_STKSIZE;
+	else if ( stacksize < MIN_FIBER_STACK )
+		stacksize = MIN_FIBER_STACK;
+	stacksize = (stacksize + 15) & ~15;
+	if ( !(fiber = Malloc(sizeof(Fiber_t) + stacksize)) )
+		return NULL;
+
+	fiber->task = mt_curr_task;
+	fiber->func = func;
+	fiber->arg = arg;
+	fiber->stack = (unsigned *) (fiber + 1);
+	*fiber->stack = FIBER_MAGIC;
+
+	// Inicializar el stack como si start(fiber) hubiera llamado a mt_switch_fiber()
+	s = (InitialStack_t *) ((char *) fiber->stack + stacksize) - 1;
+	s->regs.eip = (unsigned) start;
+	s->fiber = fiber;
+	fiber->esp = s;
+
+	Atomic();
+	if ( (fiber->list_next = fs->list) )
+		fs->list->list_prev = fiber;
+	fs->list = fiber;
+	fs->count++;
+	enqueue(fiber, &fs->ready);
+	Unatomic();
+
+	return fiber;
+}
+
+/*
+--------------------------------------------------------------------------------
+CurrentFiber - retorna la fibra actual, o NULL en el contexto principal
+--------------------------------------------------------------------------------
+*/
+
+Fiber_t *
+CurrentFiber(void)
+{
+	mt_fibers_t *fs = mt_curr_task->fibers;
+
+	return fs && fs->current != &fs->main ? fs->current : NULL;
+}
+
+/*
+--------------------------------------------------------------------------------
+YieldFiber - cede la CPU a la próxima fibra lista de la tarea
+--------------------------------------------------------------------------------
+*/
+
+void
+YieldFiber(void)
+{
+	mt_fibers_t *fs = mt_curr_task->fibers;
+
+	if ( !fs || !fs->ready.head )
+		return;
+	Atomic();
+	enqueue(fs->current, &fs->ready);
+	schedule(fs);
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+ExitFiber - termina la fibra actual
+
+Su memoria se libera al tomar la CPU la fibra siguiente. No puede llamarse
+desde el contexto principal de la tarea, que termina con Exit().
+--------------------------------------------------------------------------------
+*/
+
+void
+ExitFiber(void)
+{
+	mt_fibers_t *fs = mt_curr_task->fibers;
+	Fiber_t *fiber;
+
+	if ( !fs || (fiber = fs->current) == &fs->main )
+		Panic("ExitFiber fuera de una fibra");
+
+	Atomic();
+	if ( fiber->list_next )
+		fiber->list_next->list_prev = fiber->list_prev;
+	if ( fiber->list_prev )
+		fiber->list_prev->list_next = fiber->list_next;
+	else
+		fs->list = fiber->list_next;
+	fs->dead = fiber;
+	if ( !--fs->count )
+		mt_fiber_wakeup(&fs->join, true);
+	schedule(fs);									// no retorna
+}
+
+/*
+--------------------------------------------------------------------------------
+JoinFibers - espera que terminen todas las fibras de la tarea
+
+Solamente puede llamarse desde el contexto principal; retorna false si se
+llama desde una fibra.
+--------------------------------------------------------------------------------
+*/
+
+bool
+JoinFibers(void)
+{
+	mt_fibers_t *fs = mt_curr_task->fibers;
+
+	if ( !fs )
+		return true;
+	if ( fs->current != &fs->main )
+		return false;
+	Atomic();
+	while ( fs->count )
+		mt_fiber_park(&fs->join);
+	Unatomic();
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_fiber_park - bloquea la fibra actual en una cola y pasa a otra fibra
+
+Se llama en modo atómico, después de verificar que hay que esperar. Puede
+llamarse también desde una tarea sin fibras, que se bloquea hasta que
+mt_fiber_wakeup() despierte su contexto principal. Retorna false si la
+despertó mt_fiber_flush() porque se eliminó el objeto, que ya no debe usarse.
+--------------------------------------------------------------------------------
+*/
+
+bool
+mt_fiber_park(mt_fiber_queue_t *queue)
+{
+	mt_fibers_t *fs = get_fibers();
+	Fiber_t *fiber = fs->current;
+
+	enqueue(fiber, queue);
+	schedule(fs);
+	return fiber->success;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_fiber_wakeup - despierta la primera fibra de una cola, o todas
+mt_fiber_flush - despierta todas las fibras de una cola con resultado false
+
+Las fibras pasan a la cola de listas de su tarea, y la tarea se despierta si
+estaba bloqueada por no tener fibras listas. mt_fiber_flush() se usa al
+eliminar un objeto, para que las fibras que esperaban en él no queden
+bloqueadas para siempre.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_fiber_wakeup(mt_fiber_queue_t *queue, bool all)
+{
+	wakeup(queue, all, true);
+}
+
+void
+mt_fiber_flush(mt_fiber_queue_t *queue)
+{
+	wakeup(queue, true, false);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_fiber_count - cantidad de fibras vivas de una tarea, ver GetInfo()
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_fiber_count(Task_t *task)
+{
+	return task->fibers ? task->fibers->count : 0;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_exit_fibers - elimina las fibras de la tarea actual, que termina
+mt_free_fibers - libera lo que queda de las fibras de una tarea terminada
+
+Las fibras se sacan de las colas en que estén esperando, para que no las
+despierten. No se puede liberar el stack de la fibra que está ejecutando
+Exit(); se desvincula de la tarea y lo libera mt_free_fibers(), llamada desde
+free_terminated().
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_exit_fibers(Task_t *task)
+{
+	mt_fibers_t *fs = task->fibers;
+	Fiber_t *fiber;
+
+	if ( !fs )
+		return;
+	Atomic();
+	reap(fs);
+	dequeue(&fs->main);
+	while ( (fiber = fs->list) )
+	{
+		fs->list = fiber->list_next;
+		dequeue(fiber);
+		if ( fiber == fs->current )
+		{
+			mt_disown(fiber);
+			fs->dead = fiber;
+		}
+		else
+			Free(fiber);
+	}
+	fs->count = 0;
+	Unatomic();
+}
+
+void
+mt_free_fibers(Task_t *task)
+{
+	mt_fibers_t *fs = task->fibers;
+
+	if ( !fs )
+		return;
+	reap(fs);
+	free(fs);
+}
+
+/*
+--------------------------------------------------------------------------------
+Funciones internas
+--------------------------------------------------------------------------------
+*/
+
+static mt_fibers_t *
+get_fibers(void)
+{
+	mt_fibers_t *fs;
+
+	if ( (fs = mt_curr_task->fibers) )
+		return fs;
+	Atomic();
+	if ( !(fs = malloc(sizeof(mt_fibers_t))) )
+		Panic("Error malloc");
+	memset(fs, 0, sizeof(mt_fibers_t));
+	fs->main.task = mt_curr_task;
+	fs->current = &fs->main;
+	fs->idle.name = "fibras";
+	mt_curr_task->fibers = fs;
+	Unatomic();
+	return fs;
+}
+
+static void
+enqueue(Fiber_t *fiber, mt_fiber_queue_t *queue)
+{
+	fiber->queue = queue;
+	fiber->next = NULL;
+	if ( (fiber->prev = queue->tail) )
+		queue->tail->next = fiber;
+	else
+		queue->head = fiber;
+	queue->tail = fiber;
+}
+
+static void
+dequeue(Fiber_t *fiber)
+{
+	mt_fiber_queue_t *queue;
+
+	if ( !(queue = fiber->queue) )
+		return;
+	if ( fiber->next )
+		fiber->next->prev = fiber->prev;
+	else
+		queue->tail = fiber->prev;
+	if ( fiber->prev )
+		fiber->prev->next = fiber->next;
+	else
+		queue->head = fiber->next;
+	fiber->queue = NULL;
+}
+
+static void
+wakeup(mt_fiber_queue_t *queue, bool all, bool success)
+{
+	mt_fibers_t *fs;
+	Fiber_t *fiber;
+
+	if ( !queue->head )
+		return;
+	Atomic();
+	while ( (fiber = queue->head) )
+	{
+		fs = fiber->task->fibers;
+		dequeue(fiber);
+		fiber->success = success;
+		enqueue(fiber, &fs->ready);
+		if ( fiber->task != mt_curr_task )
+			SignalQueue(&fs->idle);
+		if ( !all )
+			break;
+	}
+	Unatomic();
+}
+
+/*
+La fibra actual ya está en alguna cola, o terminó. Se llama con nivel atómico
+1, el que dejan las funciones de este módulo, para que todas las fibras
+compartan el de la tarea.
+*/
+static void
+schedule(mt_fibers_t *fs)
+{
+	Fiber_t *prev = fs->current, *next;
+
+	if ( mt_curr_task->atomic_level != 1 )
+		Panic("Cambio de fibra en modo atomico");
+	if ( prev->stack && *prev->stack != FIBER_MAGIC )
+		Panic("Desborde del stack de una fibra");
+	while ( !(next = fs->ready.head) )
+		WaitQueue(&fs->idle);
+	dequeue(next);
+	if ( next == prev )
+		return;
+	fs->current = next;
+	mt_switch_fiber(&prev->esp, next->esp);
+	reap(fs);
+}
+
+static void
+reap(mt_fibers_t *fs)
+{
+	if ( fs->dead )
+	{
+		Free(fs->dead);
+		fs->dead = NULL;
+	}
+}
+
+static void
+start(Fiber_t *fiber)
+{
+	reap(fiber->task->fibers);
+	Unatomic();
+	fiber->func(fiber->arg);
+	ExitFiber();
+}
@@ -1,12 +1,20 @@
 #include <kernel.h>
 
 /*
-	Trabajamos en modo flat y en ring 0.
-	Utilizamos una GDT con dos segmentos, uno de código (CS = 0x08) y 
-	otro de	datos (DS, ES, FS, GS y SS = 0x10). No usamos LDT.
-	Ambos segmentos empiezan en 0 y abarcan toda la memoria (4 GB).
-	La idea es inicializar los registros de segmento una vez y después no 
-	tocarlos nunca más.
+	Trabajamos en modo flat.
+	Utilizamos una GDT con dos segmentos de kernel, uno de código (CS = 0x08) y 
+	otro de	datos (SS = 0x10), dos segmentos equivalentes para ring 3
+	(CS = 0x1B, DS, ES, FS y GS = 0x23) y dos TSS, uno para las tareas y otro
+	para el manejador de fallos de página. No usamos LDT.
+	Todos los segmentos empiezan en 0 y abarcan toda la memoria (4 GB), salvo
+	el de TLS (0x38), que abarca las claves de TLS de la tarea actual y se
+	carga en GS una vez que existe la primera tarea. Es de ring 0, de modo
+	que ring 3 no puede cargarlo.
+	El kernel usa el segmento de datos del kernel en DS, ES y FS, y el de
+	TLS en GS. Como ring 3 puede dejar en ellos cualquier selector, se
+	recargan en cada entrada al kernel (mt_kernel_segs() en interrupts.S), y
+	al volver a ring 3 se cargan los de usuario (mt_iret() y sysexit).
+	El orden de los segmentos es el que exigen sysenter y sysexit.
 */
 
 static segment_desc gdt[] = 
@@ -25,23 +33,108 @@ static segment_desc gdt[] =
 		.type = DESC_MEMRW, .dpl = 0, .present = 1, .bits32 = 1, .gran = 1,
 		.base_low = 0, .base_high = 0,
 		.limit_low = 0xFFFF, .limit_high = 0xF
+	},
+	{
+		/* Segmento de código de usuario, selector 0x1B (MT_UCS) */
+		.type = DESC_MEMER, .dpl = 3, .present = 1, .bits32 = 1, .gran = 1,
+		.base_low = 0, .base_high = 0,
+		.limit_low = 0xFFFF, .limit_high = 0xF
+	},
+	{
+		/* Segmento de datos de usuario, selector 0x23 (MT_UDS) */
+		.type = DESC_MEMRW, .dpl = 3, .present = 1, .bits32 = 1, .gran = 1,
+		.base_low = 0, .base_high = 0,
+		.limit_low = 0xFFFF, .limit_high = 0xF
+	},
+	{
+		/* TSS, selector 0x28 (MT_TSS), la base se completa en setup_gdt() */
+		.type = DESC_TSS, .dpl = 0, .present = 1,
+		.limit_low = sizeof(tss_desc) - 1
+	},
+	{
+		/* TSS de fallos de página, selector 0x30 (MT_PFTSS), ídem */
+		.type = DESC_TSS, .dpl = 0, .present = 1,
+		.limit_low = sizeof(tss_desc) - 1
+	},
+	{
+		/* TLS de la tarea actual, selector 0x38 (MT_TLS), la base la
+		   cambia mt_set_tls() en cada cambio de contexto */
+		.type = DESC_MEMRW, .dpl = 0, .present = 1, .bits32 = 1,
+		.limit_low = MAX_TLS_KEYS * sizeof(void *) - 1
 	}
 };
 
+/*
+	El TSS solamente se usa para obtener el stack de kernel cuando una
+	interrupción o system call llega estando en ring 3. mt_select_task()
+	actualiza esp0 con el stack de kernel de la tarea actual.
+*/
+
+tss_desc mt_tss = { .ss0 = MT_DS, .iomap = sizeof(tss_desc) };
+
+/*
+	La excepción 14 (fallo de página) entra por una compuerta de tarea, que
+	carga el contexto de mt_pf_tss con su propio stack y guarda el de la tarea
+	interrumpida en mt_tss. paging.c completa CR3 en ambos TSS.
+*/
+
+static char pf_stack[PF_STKSIZE];
+
+tss_desc mt_pf_tss =
+{
+	.eip = (unsigned) mt_page_fault_entry,
+	.esp = (unsigned) (pf_stack + PF_STKSIZE),
+	.eflags = 0x2,								// interrupciones deshabilitadas
+	.cs = MT_CS, .ss = MT_DS,
+	.ds = MT_DS, .es = MT_DS, .fs = MT_DS, .gs = MT_DS,
+	.iomap = sizeof(tss_desc)
+};
+
+/* Completar la base de un descriptor de TSS */
+static void
+set_tss_base(unsigned selector, tss_desc *tss)
+{
+	segment_desc *desc = &gdt[selector >> 3];
+
+	desc->base_low = ((unsigned) tss) & 0xFFFFFF;
+	desc->base_high = ((unsigned) tss) >> 24;
+}
+
+/*
+	Apuntar el segmento de TLS a las claves de la tarea actual. Se llama en
+	cada cambio de contexto: hay que recargar GS para que el procesador tome
+	la nueva base del descriptor.
+*/
+void
+mt_set_tls(void **keys)
+{
+	segment_desc *desc = &gdt[MT_TLS >> 3];
+
+	desc->base_low = ((unsigned) keys) & 0xFFFFFF;
+	desc->base_high = ((unsigned) keys) >> 24;
+	mt_load_gs(MT_TLS);
+}
+
 /* Inicializar la GDT */
 static void
 setup_gdt(void)
 {
 	region_desc gdtr;
 
+	set_tss_base(MT_TSS, &mt_tss);
+	set_tss_base(MT_PFTSS, &mt_pf_tss);
+
 	gdtr.base = (unsigned) gdt;
 	gdtr.limit = sizeof gdt - 1;
 
 	/* Cargar GDTR e inicializar los registros de segmentos */
 	mt_load_gdt(&gdtr);
+
+	/* Cargar el registro de tarea */
+	mt_load_tr(MT_TSS);
 }
 
-static gate_desc idt[NUM_INTS];
+static gate_desc idt[SYSCALL_INT + 1];
 
 static void setup_idt(void)
 {
@@ -60,6 +153,21 @@ static void setup_idt(void)
 		dptr->offset_high = ((unsigned) sptr) >> 16;
 	}
 
+	/* Fallos de página por compuerta de tarea */
+	dptr = &idt[14];
+	dptr->type = DESC_TASKGT;
+	dptr->selector = MT_PFTSS;
+	dptr->offset_low = dptr->offset_high = 0;
+
+	/* System calls por interrupción, accesibles desde ring 3 */
+	dptr = &idt[SYSCALL_INT];
+	dptr->type = DESC_INTGT;
+	dptr->dpl = 3;
+	dptr->present = 1;
+	dptr->selector = MT_CS;
+	dptr->offset_low = ((unsigned) mt_syscall_int) & 0xFFFF;
+	dptr->offset_high = ((unsigned) mt_syscall_int) >> 16;
+
 	idtr.base = (unsigned) idt;
 	idtr.limit = sizeof idt - 1;
 
@@ -0,0 +1,330 @@
+#include <kernel.h>
+
+/*
+	Heap.
+
+	malloc() y free() trabajan sobre el alocador de páginas (ver pages.c).
+	Los pedidos de LARGE_SIZE bytes o más se sirven directamente con un
+	bloque de páginas, de modo que no fragmentan el heap de objetos chicos.
+	Los demás los atiende el alocador de bytes elegido en el makefile
+	(ALLOCATOR), que recibe regiones de páginas a medida que las necesita.
+
+	El alocador mantiene en mt_heap los contadores que cuestan unas pocas
+	instrucciones por alocación: bytes en uso, máximo, cantidad de
+	alocaciones y liberaciones e histograma de tamaños pedidos. Lo que
+	requiere recorrer el heap (bloques libres, mayor bloque libre, mapa de
+	fragmentación) se calcula recién cuando se lo pide, recorriendo los
+	bloques libres del alocador de bytes y del alocador de páginas.
+
+	Compilando con TRACE=yes (ver makefile) cada alocación y liberación se
+	puede registrar en un anillo en memoria, que luego se vuelca por el
+	puerto serie en el formato de mtrace.h para reproducirlo en la máquina
+	anfitriona con utils/mtreplay. Sin esa opción el registro no cuesta nada.
+*/
+
+#ifdef MALLOC_TRACE
+#include <mtrace.h>
+#endif
+
+#define LARGE_SIZE		0x4000					// pedidos que van a páginas
+#define HEAP_GROW		0x10000					// tamaño mínimo de una región
+#define TRACE_SIZE		8192					// registros del anillo de trazas
+
+HeapInfo_t mt_heap;								// contadores del heap
+
+typedef struct
+{
+	char *			start;						// comienzo de la memoria
+	char *			map;
+	unsigned		ncells;
+	unsigned		cell_size;
+	unsigned *		free;						// bytes libres por celda
+}
+map_t;
+
+#ifdef MALLOC_TRACE
+static mtrace_rec_t trace[TRACE_SIZE];			// anillo de trazas
+static unsigned trace_count;					// registros desde que se activó
+static bool tracing;
+static void record(void *caller, void *addr, unsigned size);
+#else
+#define record(caller, addr, size)
+#endif
+
+static bool grow(unsigned nbytes);
+static void count_free(void *arg, char *addr, unsigned size);
+static void map_free(void *arg, char *addr, unsigned size);
+
+/*
+--------------------------------------------------------------------------------
+malloc, free - alocador de memoria dinámica, sin exclusión mutua
+--------------------------------------------------------------------------------
+*/
+
+void *
+malloc(unsigned nbytes)
+{
+	return mt_malloc(nbytes, __builtin_return_address(0));
+}
+
+void
+free(void *ap)
+{
+	mt_free(ap, __builtin_return_address(0));
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_malloc, mt_free - implementación de malloc() y free(), con la dirección
+	del llamador para las trazas.
+--------------------------------------------------------------------------------
+*/
+
+void *
+mt_malloc(unsigned nbytes, void *caller)
+{
+	unsigned order;
+	void *p;
+
+	if ( nbytes >= LARGE_SIZE )
+	{
+		order = mt_pages_order(nbytes);
+		if ( (p = mt_alloc_pages(order, PAGES_LARGE)) )
+			mt_heap_alloc(nbytes, PAGE_SIZE << order);
+	}
+	else
+	{
+		// Un bloque vacío podría apuntar al comienzo de un bloque de páginas
+		if ( !(p = mt_block_alloc(max(nbytes, 1))) && grow(nbytes) )
+			p = mt_block_alloc(max(nbytes, 1));
+	}
+	record(caller, p, nbytes);
+	return p;
+}
+
+void
+mt_free(void *ap, void *caller)
+{
+	unsigned order;
+
+	if ( !ap )
+		return;
+	record(caller, ap, MTRACE_FREE);
+	if ( mt_pages_flags(ap, &order) & PAGES_LARGE )
+	{
+		mt_heap_free(PAGE_SIZE << order);
+		mt_free_pages(ap);
+	}
+	else
+		mt_block_free(ap);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_malloc_trace - activa o desactiva el registro de trazas
+
+Al activarlo se descartan los registros anteriores. Retorna false si el
+kernel no se compiló con trazas.
+--------------------------------------------------------------------------------
+*/
+
+bool
+mt_malloc_trace(bool on)
+{
+#ifdef MALLOC_TRACE
+	Atomic();
+	if ( on && !tracing )
+		trace_count = 0;
+	tracing = on;
+	Unatomic();
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_malloc_trace_dump - vuelca el anillo de trazas por el puerto serie
+
+Desactiva el registro, para que el anillo no cambie durante el volcado, y
+retorna la cantidad de registros volcados.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_malloc_trace_dump(void)
+{
+#ifdef MALLOC_TRACE
+	mtrace_header_t hdr;
+	unsigned first;
+
+	mt_malloc_trace(false);
+	hdr.magic = MTRACE_MAGIC;
+	hdr.version = MTRACE_VERSION;
+	hdr.count = min(trace_count, TRACE_SIZE);
+	hdr.lost = trace_count - hdr.count;
+	mt_serial_write(&hdr, sizeof hdr);
+
+	// Del más viejo al más nuevo. Si el anillo se llenó, el más viejo está
+	// en la posición del próximo registro, aunque no se haya perdido ninguno.
+	if ( trace_count >= TRACE_SIZE )
+	{
+		first = trace_count % TRACE_SIZE;
+		mt_serial_write(&trace[first], (TRACE_SIZE - first) * sizeof(mtrace_rec_t));
+		mt_serial_write(trace, first * sizeof(mtrace_rec_t));
+	}
+	else
+		mt_serial_write(trace, trace_count * sizeof(mtrace_rec_t));
+	return hdr.count;
+#else
+	return 0;
+#endif
+}
+
+/*
+--------------------------------------------------------------------------------
+GetHeapInfo - devuelve las estadísticas del heap
+--------------------------------------------------------------------------------
+*/
+
+void
+GetHeapInfo(HeapInfo_t *info)
+{
+	Atomic();
+	*info = mt_heap;
+	info->free = info->free_blocks = info->largest_free = 0;
+	mt_heap_walk(count_free, info);
+	info->heap_free = info->free;
+	info->heap_largest = info->largest_free;
+	mt_pages_walk(count_free, info);
+	info->free_pages = mt_pages_info(ZONE_NORMAL, NULL, NULL);
+	info->dma_free_pages = mt_pages_info(ZONE_DMA, NULL, NULL);
+	info->free_pages += info->dma_free_pages;
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+GetHeapMap - genera un mapa de fragmentación de la memoria
+
+Divide la memoria administrada en ncells celdas de igual tamaño y escribe
+en map un caracter por celda según la fracción de la celda que está libre,
+ya sea en bloques libres del heap o en páginas libres: '.' libre, ':' más
+de la mitad libre, '+' menos de la mitad libre y '#' ocupada. El mapa
+termina con un cero, de modo que map debe tener lugar para ncells + 1
+caracteres.
+--------------------------------------------------------------------------------
+*/
+
+void
+GetHeapMap(char *map, unsigned ncells)
+{
+	map_t m;
+	unsigned i, used;
+
+	m.map = map;
+	m.ncells = ncells;
+	m.cell_size = (mt_heap.size + ncells - 1) / ncells;
+	m.free = mt_kalloc(ncells * sizeof(unsigned));
+	mt_pages_info(ZONE_DMA, &m.start, NULL);
+
+	Atomic();
+	mt_heap_walk(map_free, &m);
+	mt_pages_walk(map_free, &m);
+	Unatomic();
+
+	for ( i = 0 ; i < ncells ; i++ )
+	{
+		used = m.cell_size - min(m.free[i], m.cell_size);
+		if ( !used )
+			map[i] = '.';
+		else if ( used == m.cell_size )
+			map[i] = '#';
+		else
+			map[i] = used <= m.cell_size / 2 ? ':' : '+';
+	}
+	map[ncells] = 0;
+	Free(m.free);
+}
+
+/* Funciones internas */
+
+#ifdef MALLOC_TRACE
+
+/*
+--------------------------------------------------------------------------------
+record - agrega un registro al anillo de trazas, si está activo
+--------------------------------------------------------------------------------
+*/
+
+static void
+record(void *caller, void *addr, unsigned size)
+{
+	mtrace_rec_t *r;
+
+	if ( !tracing )
+		return;
+	r = &trace[trace_count++ % TRACE_SIZE];
+	r->time = mt_rdtsc();
+	r->caller = (unsigned) caller;
+	r->addr = (unsigned) addr;
+	r->size = size;
+}
+
+#endif
+
+/*
+--------------------------------------------------------------------------------
+grow - agrega al heap una región de páginas suficiente para nbytes
+--------------------------------------------------------------------------------
+*/
+
+static bool
+grow(unsigned nbytes)
+{
+	unsigned order = mt_pages_order(max(nbytes + PAGE_SIZE, HEAP_GROW));
+	void *p;
+
+	if ( !(p = mt_alloc_pages(order, 0)) )
+		return false;
+	mt_heap_add(p, PAGE_SIZE << order);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+count_free - acumula un bloque libre en las estadísticas
+--------------------------------------------------------------------------------
+*/
+
+static void
+count_free(void *arg, char *addr, unsigned size)
+{
+	HeapInfo_t *info = arg;
+
+	info->free += size;
+	info->free_blocks++;
+	if ( size > info->largest_free )
+		info->largest_free = size;
+}
+
+/*
+--------------------------------------------------------------------------------
+map_free - reparte los bytes de un bloque libre entre las celdas del mapa
+--------------------------------------------------------------------------------
+*/
+
+static void
+map_free(void *arg, char *addr, unsigned size)
+{
+	map_t *m = arg;
+	unsigned offset = addr - m->start, end = offset + size, cell_end;
+	unsigned i;
+
+	for ( i = offset / m->cell_size ; offset < end && i < m->ncells ; i++, offset = cell_end )
+	{
+		cell_end = min((i + 1) * m->cell_size, end);
+		m->free[i] += cell_end - offset;
+	}
+}
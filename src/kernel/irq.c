@@ -52,6 +52,13 @@ static interrupt_handler interrupt[NUM_INTS-NUM_EXCEPT];
 static void 
 unhandled_exception(unsigned num, unsigned error, mt_regs_t *regs)
 {
+	// Una excepción en ring 3 termina la tarea de usuario
+	if ( (regs->cs & 3) == 3 )
+	{
+		printk("Excepcion %d en %s, eip %x, error %d\n", num, GetName(mt_curr_task), regs->eip, error);
+		mt_exit_frame(regs, -1);
+		return;
+	}
 	Panic("Excepcion %d no manejada, error %d", num, error);
 }
 
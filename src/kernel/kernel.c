@@ -2,22 +2,100 @@
 #include <apps.h>
 
 #define CLOCKIRQ		0						/* interrupcion de timer */
-#define INTFL			0x200					/* bit de habilitación de interrupciones en los flags */
 #define MSPERTICK 		10						/* 100 Hz */
-#define QUANTUM			10						/* 100 mseg */
+#define SCHED_LATENCY	20						/* 200 mseg */
+#define MIN_SLICE		2						/* 20 mseg */
+#define MAX_SLICE		40						/* 400 mseg */
+#define HOG_FACTOR		2
+#define MAX_BOOST		4
+#define MB_INFO_MODS	0x08					/* hay módulos en boot_info_t */
+#define ID_BITS			16						/* bits del índice en un id de tarea */
+#define MAX_SLOTS		(1 << ID_BITS)			/* máximo de tareas */
+#define MAX_GEN			(-1U >> ID_BITS)		/* máxima generación */
+#define MIN_SLOTS		64						/* tamaño inicial de la tabla */
+#define NO_SLOT			-1U
+#define MAX_SHARES		(16 * DEFAULT_SHARES)	/* máximo peso de un grupo */
+
+// Entrada de la tabla de ids de tareas
+typedef struct
+{
+	Task_t *		task;						// NULL si está libre
+	unsigned		gen;						// generación, cambia al liberarla
+	unsigned		next_free;					// lista de entradas libres
+}
+task_slot_t;
+
+// Buzón de mensajes asincrónicos de una tarea, ver SetMailbox(). Las entradas
+// son una cabecera mt_mail_t seguida del mensaje, en un buffer circular.
+struct mt_mailbox_t
+{
+	unsigned		max;						// capacidad en mensajes
+	unsigned		msg_size;					// tamaño máximo de un mensaje
+	unsigned		slot;						// tamaño de cada entrada
+	MailPolicy_t	policy;						// qué hacer si está lleno
+	unsigned		head;						// entrada más vieja
+	unsigned		count;						// mensajes en el buzón
+	unsigned		dropped;					// mensajes descartados
+	TaskQueue_t		put_q;						// remitentes esperando lugar
+	char *			buf;
+};
+
+typedef struct
+{
+	TaskId_t		from;						// remitente, puede haber terminado
+	unsigned		size;
+}
+mt_mail_t;
+
+// Grupo de tareas, ver CreateGroup()
+struct TaskGroup_t
+{
+	char *			name;						// primer campo, para GetName()
+	TaskGroup_t *	parent;						// NULL en la raíz
+	TaskGroup_t *	next;						// lista de grupos
+	unsigned		ntasks;						// tareas del grupo
+	unsigned		nchildren;					// subgrupos
+	unsigned		shares;						// fracción de la CPU del padre
+	unsigned		weight;						// producto de las fracciones hasta la raíz
+	unsigned		quota;						// ticks por período, 0 si no hay cuota
+	unsigned		period;						// período en ticks
+	unsigned		used;						// ticks usados en el período actual
+	Time_t			refill;						// tick en que empieza el próximo período
+	bool			throttled;					// agotó la cuota del período
+	unsigned		nthrottled;					// veces que agotó la cuota
+	Time_t			usage;						// ticks usados en total
+};
 
 Task_t * volatile mt_curr_task;					/* tarea en ejecucion */
 Task_t * volatile mt_last_task;					/* tarea anterior */
 Task_t * volatile mt_fpu_task;					/* tarea que tiene el coprocesador */
+bool mt_fast_switch = true;						/* cambio de contexto con mt_switch_fast() */
+bool mt_fast_locks = true;						/* caminos rápidos de semáforos y mutexes */
 
 static Time_t volatile timer_ticks;				/* ticks ocurridos desde el arranque */
 static unsigned usec_counts;					/* cuentas de delay por microsegundo */
 static volatile unsigned ticks_to_run;			/* ranura de tiempo */
+static unsigned sched_latency = SCHED_LATENCY;	/* parámetros del scheduler, en ticks */
+static unsigned min_slice = MIN_SLICE;
+static unsigned max_slice = MAX_SLICE;
+static unsigned hog_factor = HOG_FACTOR;
+static unsigned sched_max_boost = MAX_BOOST;
 static TaskQueue_t ready_q;						/* cola de tareas ready */
 static TaskQueue_t terminated_q;				/* cola de tareas terminadas */
+static TaskQueue_t throttled_q = { "cuota" };	/* tareas listas de grupos limitados */
+static Task_t *idle_task;						/* tarea nula */
+
+static TaskGroup_t root_group = { "raiz", .shares = DEFAULT_SHARES, .weight = DEFAULT_SHARES };
+static TaskGroup_t *group_list = &root_group;	/* lista de grupos */
+static unsigned num_groups = 1;					/* cantidad de grupos */
 
 static Task_t *task_list;						/* lista de tareas existentes */
 static unsigned num_tasks;						/* cantidad de tareas existentes */
+static task_slot_t *task_slots;					/* tabla de ids de tareas */
+static unsigned num_slots;						/* tamaño de la tabla */
+static unsigned free_slot = NO_SLOT;			/* lista de entradas libres */
+static Cache_t task_cache = MT_CACHE("tasks", Task_t, NULL, NULL);
+static Cache_t group_cache = MT_CACHE("groups", TaskGroup_t, NULL, NULL);
 
 static void scheduler(void);
 
@@ -26,18 +104,44 @@ static void ready(Task_t *task, bool success);
 
 static unsigned msecs_to_ticks(unsigned msecs);
 static unsigned ticks_to_msecs(unsigned ticks);
+static Time_t expiry(unsigned msecs);
+static void delay_until(Time_t ticks);			/* dormir hasta un tick absoluto */
 
+static unsigned slice(Task_t *task);			/* ranura de tiempo de una tarea */
 static void count_down(volatile unsigned *cnt);	/* lazo para hacer delays en microsegundos */
 
 static void free_terminated(void);				/* libera tareas terminadas */
+static void free_task(void *arg);				/* libera una tarea, ver RcuDefer() */
+static void *mem_alloc(Task_t *task, unsigned size, void *caller);	/* implementación de Malloc() */
+static void release_mem(Task_t *task);			/* libera o desvincula los bloques de una tarea */
+static void mem_unlink(mt_mem_t *m);			/* desvincula un bloque de su tarea */
 static void clockint(unsigned irq);				/* manejador interrupcion de timer */
 
-static void task_list_add(Task_t *task);		/* agregar a la lista de tareas existentes */
+static bool task_list_add(Task_t *task);		/* agregar a la lista de tareas existentes */
 static void task_list_remove(Task_t *task);		/* quitar de la lista de tareas existentes */
+static Task_t *task_from_id(TaskId_t id);		/* tarea correspondiente a un id */
+static void attach(Task_t *task, Task_t *parent);	/* vincular a otra tarea */
+static void detach(Task_t *task);				/* desvincular de la tarea vinculante */
+static bool throttled(TaskGroup_t *group);		/* el grupo o un ancestro agotó su cuota */
+static void charge(Task_t *task);				/* contar un tick a los grupos de una tarea */
+static void refill(void);						/* renovar las cuotas de los grupos */
+static void set_weight(TaskGroup_t *group);		/* recalcular el peso de un subárbol */
+static void switch_to(Task_t *task, bool donate);	/* pasar la CPU a una tarea */
+static void handoff(Task_t *task);				/* pasar la CPU sin pasar por ready_q */
+static bool accepts(Task_t *to);				/* la tarea espera un mensaje nuestro */
+static void copy_msg(Task_t *to, void *msg, unsigned size);	/* copiar a una tarea en Receive() */
+static bool deliver(Task_t *to, void *msg, unsigned size);	/* entregar a una tarea en Receive() */
+static void await_msg(Task_t **from, void *msg, unsigned *size);	/* prepararse para recibir */
+static bool got_msg(Task_t **from, unsigned *size);	/* resultado de la recepción */
+static bool take_mail(mt_mailbox_t *mb, Task_t **from, void *msg, unsigned *size);
+static mt_mail_t *mail(mt_mailbox_t *mb, unsigned n);	/* n-ésima entrada del buzón */
 
 static int null_task(void *arg);				/* tarea nula */
 static int run_shell(void *arg);				/* tarea que dispara un shell repetidamente */
 
+// La parte caliente de Task_t ocupa dos líneas de cache (ver kernel.h)
+_Static_assert(__builtin_offsetof(Task_t, from) == 2 * CACHE_LINE, "la parte caliente de Task_t no ocupa dos lineas de cache");
+
 // Stackframe inicial de una tarea
 typedef struct
 {
@@ -57,12 +161,26 @@ typedef struct
 }
 DeleteStack_t;
 
+// Cabecera de los bloques alocados con Malloc(). Mantiene la alineación a
+// 8 bytes de malloc().
+struct mt_mem_t
+{
+	mt_mem_t *		next;						// lista de bloques de la tarea
+	mt_mem_t *		prev;
+	Task_t *		owner;						// tarea que lo alocó, o NULL
+	unsigned		size;						// bytes pedidos
+};
+
 // Información que el bootloader pasa al kernel
 struct boot_info_t
 {
 	unsigned		flags;
 	unsigned		lowmem_kb;
 	unsigned		himem_kb;
+	unsigned		boot_device;
+	char *			cmdline;
+	unsigned		mods_count;
+	void *			mods_addr;
 	/* etc */
 };
 
@@ -80,7 +198,7 @@ usarse pero	no cargarse, ni siquiera con los mismos valores que tienen.
 void
 mt_main(unsigned magic, boot_info_t *info)
 {
-	unsigned i;
+	unsigned i, reserved_end = 0, mem_end;
 	Task_t *t;
 
 	// Esto funciona aunque el módulo de consola no esté inicializado
@@ -91,15 +209,33 @@ mt_main(unsigned magic, boot_info_t *info)
 	print0("Inicializando GDT e IDT\n");
 	mt_setup_gdt_idt();
 
-	// Inicializar el heap pasándole el tamaño de la memoria disponible por
-	// encima de 1 MB según lo informa el bootloader.
-	print0("Inicializando heap. Memoria superior: %u kB\n", info->himem_kb);
-	mt_setup_heap(info->himem_kb * 1024);
+	// Registrar los programas de usuario cargados como módulos por el
+	// bootloader, la memoria que ocupan queda fuera del heap.
+	if ( info->flags & MB_INFO_MODS )
+	{
+		print0("Registrando programas de usuario\n");
+		reserved_end = mt_setup_programs(info->mods_count, info->mods_addr);
+	}
+
+	// Habilitar la paginación. La memoria superior empieza en 1 MB y su
+	// tamaño lo informa el bootloader.
+	print0("Habilitando paginacion. Memoria superior: %u kB\n", info->himem_kb);
+	mem_end = mt_setup_paging(0x100000 + info->himem_kb * 1024);
+
+	// Inicializar el alocador de páginas, sobre el que trabajan el heap y
+	// los stacks, con la memoria que queda por encima del kernel y los
+	// módulos.
+	print0("Inicializando memoria: %u kB\n", (mem_end - 0x100000) / 1024);
+	mt_setup_pages(mem_end, reserved_end);
 
 	// Inicializar sistema de interrupciones
 	print0("Configurando interrupciones y excepciones\n");
 	mt_setup_interrupts();
 
+	// Inicializar system calls para los programas de usuario
+	print0("Inicializando system calls\n");
+	mt_setup_syscalls();
+
 	// Configurar el timer, colocar el manejador de interrupción
 	// correspondiente y habilitar la interrupción
 	print0("Configurando timer: %u ms/tick\n", MSPERTICK);
@@ -113,16 +249,21 @@ mt_main(unsigned magic, boot_info_t *info)
 
 	// Inicializar la tarea actual
 	print0("Inicializando la tarea actual\n");
-	mt_curr_task = malloc(sizeof(Task_t));
+	// Alinear a línea de cache, como las tareas de task_cache
+	mt_curr_task = (Task_t *) (((unsigned) malloc(sizeof(Task_t) + CACHE_LINE) + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
 	memset(mt_curr_task, 0, sizeof(Task_t));
 	mt_curr_task->send_queue.name = "init";
 	mt_curr_task->state = TaskCurrent;
 	mt_curr_task->priority = DEFAULT_PRIO;
+	mt_curr_task->max_boost = sched_max_boost;
 	mt_curr_task->protected = true;
+	mt_curr_task->group = &root_group;				// la heredan las demás
+	root_group.ntasks = 1;
+	mt_set_tls(mt_curr_task->tls_keys);
 
 	// Iniciar tarea nula. Va a ser la primera en la lista de tareas.
 	print0("Crear y correr la tarea nula\n");
-	t = CreateTask(null_task, 0, NULL, "idle", MIN_PRIO);
+	t = idle_task = CreateTask(null_task, 0, NULL, "idle", MIN_PRIO);
 	Protect(t);
 	Ready(t);
 
@@ -179,6 +320,13 @@ Si la tarea actual no es dueña del coprocesador, levanta el bit TS en CR0 para
 se genere la excepción 7 la próxima vez que se ejecute una instrucción de
 coprocesador.
 Guarda y restaura el contexto propio del usuario, si existe.
+
+Entre tareas de la misma prioridad se prefieren las de mayor boost. Una tarea
+gana boost cada vez que se despierta después de bloquearse (ver ready()) y lo
+pierde de a uno cada vez que agota su ranura de tiempo (ver clockint()), o
+todo junto cuando cede la CPU con Yield(), de modo que las tareas interactivas desplazan enseguida a las que consumen CPU
+sin bloquearse. La ranura se reparte la latencia del scheduler entre las
+tareas listas, y es más larga para las tareas sin boost (ver slice()).
 --------------------------------------------------------------------------------
 */
 
@@ -193,16 +341,25 @@ mt_select_task(void)
 		if ( mt_curr_task->atomic_level )		/* No molestar */
 			return false;
 
-		/* Analizar prioridades y ranura de tiempo */
-		ready_task = mt_peeklast(&ready_q);
-		if ( !ready_task || ready_task->priority < mt_curr_task->priority ||
-			(ticks_to_run && ready_task->priority == mt_curr_task->priority) )
-			return false;
+		/* Si su grupo agotó la cuota, esperar el próximo período */
+		if ( throttled(mt_curr_task->group) )
+			mt_enqueue(mt_curr_task, &throttled_q);
+		else
+		{
+			/* Analizar prioridades y ranura de tiempo */
+			ready_task = mt_peeklast(&ready_q);
+			if ( !ready_task || mt_prio_cmp(ready_task, mt_curr_task) < 0 ||
+				(ticks_to_run && !mt_prio_cmp(ready_task, mt_curr_task)) )
+				return false;
+			mt_enqueue(mt_curr_task, &ready_q);
+		}
 
 		/* La tarea actual pierde la CPU */
 		mt_curr_task->state = TaskReady;
-		mt_enqueue(mt_curr_task, &ready_q);
+		mt_curr_task->nivcsw++;
 	}
+	else
+		mt_curr_task->nvcsw++;
 
 	/* Obtener la próxima tarea, si es la misma no hay nada que hacer */
 	ready_task = mt_getlast(&ready_q);
@@ -210,6 +367,25 @@ mt_select_task(void)
 	if ( ready_task == mt_curr_task )
 		return false;
 
+	switch_to(ready_task, false);
+	return true;
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+switch_to - hace los cambios para que una tarea tome la CPU, que completa
+	mt_switch_fast() o mt_context_switch(). La tarea ya está en TaskCurrent.
+
+Si donate es true la tarea continúa la ranura de tiempo de la actual, ver
+handoff().
+--------------------------------------------------------------------------------
+*/
+
+static void
+switch_to(Task_t *task, bool donate)
+{
 	/* Guardar contexto adicional */
 	if ( mt_curr_task->save )
 		mt_curr_task->save();
@@ -219,7 +395,7 @@ mt_select_task(void)
 
 	/* Cambiar la tarea actual */
 	mt_last_task = mt_curr_task;
-	mt_curr_task = ready_task;
+	mt_curr_task = task;
 
 	/* Si la tarea actual es dueña del coprocesador aritmético,
 	   bajar el bit TS en CR0. En caso contrario, levantarlo para que
@@ -229,11 +405,17 @@ mt_select_task(void)
 	else
 		mt_stts();
 
-	/* Inicializar ranura de tiempo */
-	ticks_to_run = QUANTUM;
+	/* Inicializar ranura de tiempo, o usar lo que queda de la cedida */
+	if ( !donate || !ticks_to_run )
+		ticks_to_run = slice(mt_curr_task);
+	mt_curr_task->slice = ticks_to_run;
+
+	/* Stack de kernel para interrupciones y system calls desde ring 3 */
+	mt_tss.esp0 = (unsigned) mt_curr_task->stack_end;
 
-	/* Reponer TLS */
+	/* Reponer TLS y apuntar GS a las claves de la tarea */
 	TLS = mt_curr_task->tls;
+	mt_set_tls(mt_curr_task->tls_keys);
 
 	/* Actualizar terminal actual */
 	mt_input_setcurrent(mt_curr_task->consnum);
@@ -241,11 +423,41 @@ mt_select_task(void)
 	/* Reponer contexto adicional */
 	if ( mt_curr_task->restore )
 		mt_curr_task->restore();
-
-	return true;
 }
 
-/* Funciones internas */
+/*
+--------------------------------------------------------------------------------
+handoff - pasa la CPU directamente a una tarea que se despierta, sin pasar por
+	ready_q, cediéndole el resto de la ranura de tiempo.
+
+La tarea actual ya debe estar bloqueada, y la que se despierta bloqueada en
+Receive(). Si hay una tarea lista que debe ejecutar antes, o la que se despierta
+está limitada por la cuota de su grupo, se sigue el camino normal de ready().
+Se llama con interrupciones deshabilitadas.
+--------------------------------------------------------------------------------
+*/
+
+static void
+handoff(Task_t *task)
+{
+	Task_t *top = mt_peeklast(&ready_q);
+
+	if ( mt_int_level || throttled(task->group) || (top && mt_prio_cmp(top, task) > 0) )
+	{
+		ready(task, true);
+		scheduler();
+		return;
+	}
+	mt_dequeue_time(task);
+	task->success = true;
+	task->state = TaskCurrent;
+	mt_curr_task->nvcsw++;
+	switch_to(task, true);
+	if ( mt_fast_switch )
+		mt_switch_fast();
+	else
+		mt_context_switch();
+}
 
 /*
 --------------------------------------------------------------------------------
@@ -288,6 +500,58 @@ ticks_to_msecs(unsigned ticks)
 	return ticks * MSPERTICK;
 }
 
+/*
+--------------------------------------------------------------------------------
+expiry - tick en que vence una espera de msecs milisegundos
+
+Se cuenta un tick más porque el tick en curso ya empezó, de modo que la espera
+dura al menos msecs.
+--------------------------------------------------------------------------------
+*/
+
+static Time_t
+expiry(unsigned msecs)
+{
+	return timer_ticks + msecs_to_ticks(msecs) + 1;
+}
+
+/*
+--------------------------------------------------------------------------------
+delay_until - pone a la tarea actual a dormir hasta un tick absoluto, que
+	debe ser posterior al actual. Se llama con interrupciones deshabilitadas.
+--------------------------------------------------------------------------------
+*/
+
+static void
+delay_until(Time_t ticks)
+{
+	block(mt_curr_task, TaskDelaying);
+	mt_enqueue_time(mt_curr_task, ticks);
+	scheduler();
+}
+
+/*
+--------------------------------------------------------------------------------
+slice - ranura de tiempo de una tarea que toma la CPU
+
+La latencia del scheduler se reparte entre la tarea y las que quedan listas,
+multiplicada por hog_factor para las tareas sin boost, que corren más tiempo
+pero ceden la CPU a las interactivas de su misma prioridad, y por el peso del
+grupo de la tarea (ver SetGroupShares()).
+--------------------------------------------------------------------------------
+*/
+
+static unsigned
+slice(Task_t *task)
+{
+	unsigned ticks = sched_latency / (ready_q.count + 1);
+
+	if ( !task->boost )
+		ticks *= hog_factor;
+	ticks = ticks * task->group->weight / DEFAULT_SHARES;
+	return min(max(ticks, min_slice), max_slice);
+}
+
 /*
 --------------------------------------------------------------------------------
 count_down - lazo contador para hacer pequeños delays en microsegundos
@@ -319,6 +583,8 @@ block(Task_t *task, TaskState_t state)
 --------------------------------------------------------------------------------
 ready - desbloquea una tarea y la pone en la cola de ready
 
+Si la tarea estaba bloqueada incrementa su boost, ver mt_select_task().
+Si su grupo agotó la cuota, espera en throttled_q al próximo período.
 Si la tarea estaba bloqueada en WaitQueue, Send o Receive, el argumento
 success determina el status de retorno de la funcion que la bloqueo.
 --------------------------------------------------------------------------------
@@ -332,7 +598,9 @@ ready(Task_t *task, bool success)
 
 	mt_dequeue(task);
 	mt_dequeue_time(task);
-	mt_enqueue(task, &ready_q);
+	if ( task->state != TaskCurrent && task->boost < task->max_boost )
+		task->boost++;								// se había bloqueado
+	mt_enqueue(task, throttled(task->group) ? &throttled_q : &ready_q);
 	task->success = success;
 	task->state = TaskReady;
 }
@@ -340,6 +608,11 @@ ready(Task_t *task, bool success)
 /*
 --------------------------------------------------------------------------------
 free_terminated - elimina las tareas terminadas.
+free_task - libera una tarea terminada
+
+Las tareas terminadas ya salieron de task_list, pero algún lector que la
+recorre sin exclusión puede estar viéndolas (ver GetTasks()). Se liberan al
+terminar el período de gracia de RCU.
 --------------------------------------------------------------------------------
 */
 
@@ -347,7 +620,6 @@ static void
 free_terminated(void)
 {
 	Task_t *task;
-	char *name;
 
 	while ( true )
 	{
@@ -356,15 +628,118 @@ free_terminated(void)
 		Unatomic();
 		if ( !task )
 			break;
-		Atomic();
-		if ( (name = GetName(task)) )
-			free(name);
-		free(task->stack);
-		if ( task->math_data )
-			free(task->math_data);
-		free(task);
+		RcuDefer(&task->rcu, free_task, task);
+	}
+	mt_rcu_poll();
+}
+
+static void
+free_task(void *arg)
+{
+	Task_t *task = arg;
+
+	Atomic();
+	mt_name_free(GetName(task));
+	mt_free_stack(task->stack);
+	mt_free_stack(task->ustack);
+	if ( task->math_data )
+		free(task->math_data);
+	mt_free_fibers(task);
+	Unatomic();
+	if ( task->image )
+		mt_release_image(task->image);
+	CacheFree(&task_cache, task);
+}
+
+/*
+--------------------------------------------------------------------------------
+mem_alloc - aloca un bloque con su cabecera y lo agrega a la lista de una
+	tarea, o retorna NULL si la tarea alcanzó su límite o no hay memoria.
+	Si task es NULL el bloque no se cuenta a ninguna tarea, y si no hay
+	memoria se detiene el sistema.
+--------------------------------------------------------------------------------
+*/
+
+static void *
+mem_alloc(Task_t *task, unsigned size, void *caller)
+{
+	mt_mem_t *m = NULL;
+
+	free_terminated();
+	Atomic();
+	if ( task && task->mem_limit &&
+			(task->mem_current > task->mem_limit || size > task->mem_limit - task->mem_current) )
+	{
+		Unatomic();
+		return NULL;
+	}
+	if ( size <= ~0U - sizeof(mt_mem_t) )
+		m = mt_malloc(sizeof(mt_mem_t) + size, caller);
+	if ( !m )
+	{
+		if ( !task )
+			Panic("Error malloc");
 		Unatomic();
+		return NULL;
+	}
+	m->size = size;
+	m->prev = NULL;
+	if ( (m->owner = task) )
+	{
+		if ( (m->next = task->mem_list) )
+			m->next->prev = m;
+		task->mem_list = m;
+		if ( (task->mem_current += size) > task->mem_peak )
+			task->mem_peak = task->mem_current;
+	}
+	Unatomic();
+	return m + 1;
+}
+
+/*
+--------------------------------------------------------------------------------
+release_mem - libera los bloques de una tarea que termina, si lo pidió con
+	SetMemReclaim(), o los desvincula para que al liberarlos no se use su
+	bloque de control.
+--------------------------------------------------------------------------------
+*/
+
+static void
+release_mem(Task_t *task)
+{
+	mt_mem_t *m;
+
+	Atomic();
+	while ( (m = task->mem_list) )
+	{
+		mem_unlink(m);
+		if ( task->mem_reclaim )
+			mt_free(m, __builtin_return_address(0));
 	}
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+mem_unlink - quita un bloque de la lista de su tarea y lo descuenta
+--------------------------------------------------------------------------------
+*/
+
+static void
+mem_unlink(mt_mem_t *m)
+{
+	Task_t *task = m->owner;
+
+	if ( !task )
+		return;
+	if ( m->next )
+		m->next->prev = m->prev;
+	if ( m->prev )
+		m->prev->next = m->next;
+	else
+		task->mem_list = m->next;
+	task->mem_current -= m->size;
+	m->owner = NULL;
 }
 
 /*
@@ -375,6 +750,9 @@ Se llama cuando se bloquea la tarea actual o se despierta cualquier tarea.
 No hace nada si se llama desde una interrupcion, porque las interrupciones
 pueden despertar tareas pero recien se cambia contexto al retornar de la
 interrupcion de primer nivel.
+Como se llama desde C, normalmente cambia de contexto con mt_switch_fast(),
+que guarda solamente los registros que C preserva. mt_fast_switch permite
+volver a mt_context_switch(), que simula una interrupción, para comparar.
 --------------------------------------------------------------------------------
 */
 
@@ -382,16 +760,21 @@ static void
 scheduler(void)
 {
 	if ( !mt_int_level && mt_select_task() )
-		mt_context_switch();
+	{
+		if ( mt_fast_switch )
+			mt_switch_fast();
+		else
+			mt_context_switch();
+	}
 }
 
 /*
 --------------------------------------------------------------------------------
 clockint - interrupcion de tiempo real
 
-Despierta a las tareas de la cola de tiempo que tengan su cuenta de ticks
-agotada, y decrementa la cuenta de la primera que quede en la cola.
-Decrementa la ranura de tiempo de la tarea actual.
+Despierta a las tareas de la cola de tiempo cuyo vencimiento ya llegó.
+Decrementa la ranura de tiempo de la tarea actual, y su boost si la agota.
+Cuenta el tick a los grupos de la tarea actual y renueva las cuotas.
 --------------------------------------------------------------------------------
 */
 
@@ -401,15 +784,16 @@ clockint(unsigned irq)
 	Task_t *task;
 
 	++timer_ticks;
-	if ( ticks_to_run )
-		ticks_to_run--;
-	while ( (task = mt_peekfirst_time()) && !task->ticks )
+	if ( ticks_to_run && !--ticks_to_run && mt_curr_task->boost && !mt_curr_task->queue )
+		mt_curr_task->boost--;						// agotó su ranura
+	if ( mt_curr_task != idle_task )
+		charge(mt_curr_task);
+	refill();
+	while ( (task = mt_peekfirst_time()) && task->expiry <= timer_ticks )
 	{
 		mt_getfirst_time();
 		ready(task, false);
 	}
-	if ( task )
-		task->ticks--;
 }
 
 /*
@@ -439,25 +823,58 @@ task_list_add - Agregar una tarea al principio de la lista de tareas.
 La tarea se pone en la cabeza de la lista. Acaba de ser creada y viene con los
 punteros a próximo y siguiente en NULL. La primera tarea que se inserta es la
 tarea nula, que nunca se quita. Por lo tanto, será siempre la última.
+También se le asigna un id, tomando una entrada libre de la tabla de ids, que
+se agranda al doble cuando no quedan. El id combina el índice de la entrada con
+su generación, que cambia cada vez que se libera, de modo que los ids de las
+tareas que ya terminaron dejan de ser válidos.
+Retorna false, sin agregar la tarea, si la tabla de ids está completa.
 --------------------------------------------------------------------------------
 */
 
-static void
+static bool
 task_list_add(Task_t *task)
 {
+	task_slot_t *slots;
+	unsigned i, n;
+
+	if ( free_slot == NO_SLOT )
+	{
+		if ( num_slots == MAX_SLOTS )
+			return false;
+		n = num_slots ? 2 * num_slots : MIN_SLOTS;
+		slots = mt_kalloc(n * sizeof(task_slot_t));
+		if ( task_slots )
+		{
+			memcpy(slots, task_slots, num_slots * sizeof(task_slot_t));
+			Free(task_slots);
+		}
+		for ( i = n ; i-- > num_slots ; free_slot = i )
+		{
+			slots[i].gen = 1;
+			slots[i].next_free = free_slot;
+		}
+		task_slots = slots;
+		num_slots = n;
+	}
+	i = free_slot;
+	free_slot = task_slots[i].next_free;
+	task_slots[i].task = task;
+	task->id = task_slots[i].gen << ID_BITS | i;
+
 	num_tasks++;
 
 	if ( !task_list )
 	{
 		// Primera inserción, tarea nula
 		task_list = task;
-		return;
+		return true;
 	}
 
-	// Insertar en la cabeza
+	// Insertar en la cabeza, publicando la tarea para los lectores de RCU
 	task->list_next = task_list;
 	task_list->list_prev = task;
-	task_list = task;
+	RcuAssign(task_list, task);
+	return true;
 }
 
 /*
@@ -465,13 +882,22 @@ task_list_add(Task_t *task)
 task_list_remove - Quitar una tarea de la lista de tareas.
 
 La lista no está vacía y la tarea que se va a sacar no es la última (lugar
-ocupado por la tarea nula).
+ocupado por la tarea nula). Se libera la entrada de su id.
 --------------------------------------------------------------------------------
 */
 
 static void
 task_list_remove(Task_t *task)
 {
+	unsigned i = task->id & (MAX_SLOTS - 1);
+	task_slot_t *slot = &task_slots[i];
+
+	slot->task = NULL;
+	if ( slot->gen++ == MAX_GEN )				// el id 0 no es válido
+		slot->gen = 1;
+	slot->next_free = free_slot;
+	free_slot = i;
+
 	num_tasks--;
 
 	if ( task == task_list )
@@ -487,6 +913,167 @@ task_list_remove(Task_t *task)
 	task->list_next->list_prev = task->list_prev;
 }
 
+/*
+--------------------------------------------------------------------------------
+task_from_id - tarea correspondiente a un id, o NULL si el id no es válido
+
+Se llama en modo atómico, para que la tarea no termine mientras se la usa.
+--------------------------------------------------------------------------------
+*/
+
+static Task_t *
+task_from_id(TaskId_t id)
+{
+	unsigned i = id & (MAX_SLOTS - 1);
+
+	if ( i >= num_slots || task_slots[i].gen != id >> ID_BITS )
+		return NULL;
+	return task_slots[i].task;
+}
+
+/*
+--------------------------------------------------------------------------------
+attach, detach - agregar y quitar una tarea de la lista de tareas vinculadas
+	a otra, que permite recorrerlas sin recorrer todas las tareas.
+--------------------------------------------------------------------------------
+*/
+
+static void
+attach(Task_t *task, Task_t *parent)
+{
+	task->attached_to = parent;
+	task->sibling_prev = NULL;
+	if ( (task->sibling_next = parent->children) )
+		task->sibling_next->sibling_prev = task;
+	parent->children = task;
+	parent->nattached++;
+}
+
+static void
+detach(Task_t *task)
+{
+	Task_t *parent = task->attached_to;
+
+	if ( task->sibling_next )
+		task->sibling_next->sibling_prev = task->sibling_prev;
+	if ( task->sibling_prev )
+		task->sibling_prev->sibling_next = task->sibling_next;
+	else
+		parent->children = task->sibling_next;
+	task->sibling_next = task->sibling_prev = NULL;
+	parent->nattached--;
+}
+
+/*
+--------------------------------------------------------------------------------
+throttled - indica si un grupo o alguno de sus ancestros agotó su cuota
+--------------------------------------------------------------------------------
+*/
+
+static bool
+throttled(TaskGroup_t *group)
+{
+	for ( ; group ; group = group->parent )
+		if ( group->throttled )
+			return true;
+	return false;
+}
+
+/*
+--------------------------------------------------------------------------------
+charge - cuenta un tick a los grupos de una tarea, desde el suyo hasta la raíz
+
+El grupo que agota su cuota queda limitado hasta el próximo período, y las
+tareas listas suyas y de sus subgrupos pasan a throttled_q. La tarea actual
+deja la CPU al retornar de la interrupción, ver mt_select_task().
+--------------------------------------------------------------------------------
+*/
+
+static void
+charge(Task_t *task)
+{
+	TaskGroup_t *group;
+	Task_t *t, *next;
+	bool limited = false;
+
+	for ( group = task->group ; group ; group = group->parent )
+	{
+		group->usage++;
+		if ( group->quota && ++group->used >= group->quota && !group->throttled )
+		{
+			group->throttled = limited = true;
+			group->nthrottled++;
+		}
+	}
+	if ( !limited )
+		return;
+	for ( t = ready_q.head ; t ; t = next )
+	{
+		next = t->next;
+		if ( throttled(t->group) )
+		{
+			mt_dequeue(t);
+			mt_enqueue(t, &throttled_q);
+		}
+	}
+}
+
+/*
+--------------------------------------------------------------------------------
+refill - renueva las cuotas de los grupos cuyo período terminó
+
+Las tareas de throttled_q que ya no están limitadas vuelven a ready_q.
+--------------------------------------------------------------------------------
+*/
+
+static void
+refill(void)
+{
+	TaskGroup_t *group;
+	Task_t *t, *next;
+	bool released = false;
+
+	for ( group = group_list ; group ; group = group->next )
+		if ( (group->quota || group->throttled) && group->refill <= timer_ticks )
+		{
+			group->used = 0;
+			group->refill = timer_ticks + group->period;
+			if ( group->throttled )
+			{
+				group->throttled = false;
+				released = true;
+			}
+		}
+	if ( !released )
+		return;
+	for ( t = throttled_q.head ; t ; t = next )
+	{
+		next = t->next;
+		if ( !throttled(t->group) )
+		{
+			mt_dequeue(t);
+			mt_enqueue(t, &ready_q);
+		}
+	}
+}
+
+/*
+--------------------------------------------------------------------------------
+set_weight - recalcula el peso de un grupo y de sus subgrupos
+--------------------------------------------------------------------------------
+*/
+
+static void
+set_weight(TaskGroup_t *group)
+{
+	TaskGroup_t *g;
+
+	group->weight = min(max(group->parent->weight * group->shares / DEFAULT_SHARES, 1), MAX_SHARES);
+	for ( g = group_list ; g ; g = g->next )
+		if ( g->parent == group )
+			set_weight(g);
+}
+
 /*
 --------------------------------------------------------------------------------
 wrapper - ejecuta el cuerpo de una tarea y llama a Exit() con su status de salida
@@ -510,6 +1097,7 @@ un puntero para pasar como argumento, nombre, prioridad inicial.
 Toma memoria para crear el stack y lo inicializa para que retorne
 a Exit().
 Está inicialmente suspendida, para ejecutarla llamar a Ready().
+Retorna NULL si se alcanzó la cantidad máxima de tareas.
 --------------------------------------------------------------------------------
 */
 
@@ -520,18 +1108,21 @@ CreateTask(TaskFunc_t func, unsigned stacksize, void *arg, const char *name, uns
 	InitialStack_t *s;
 
 	/* alocar bloque de control */
-	task = Malloc(sizeof(Task_t));
-	task->send_queue.name = StrDup(name);
+	task = CacheAlloc(&task_cache);
+	memset(task, 0, sizeof(Task_t));
+	task->send_queue.name = mt_name_dup(name);
 	task->priority = priority;
+	task->max_boost = sched_max_boost;
 	task->tls = TLS;							// hereda TLS actual
 	task->consnum = mt_curr_task->consnum;		// hereda número de consola
+	task->group = mt_curr_task->group;			// hereda grupo
 
-	/* alocar stack */
+	/* alocar stack, con memoria física solamente para la página del tope */
 	if ( stacksize < MIN_STACK )				// garantizar tamaño mínimo
 		stacksize = MIN_STACK;
-	else
-		stacksize &= ~3;						// redondear a multiplos de 4
-	task->stack = Malloc(stacksize);			// malloc alinea adecuadamente
+	stacksize = (stacksize + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	task->stack = mt_alloc_stack(stacksize);
+	task->stack_end = task->stack + stacksize;
 
 	/*
 	Inicializar el stack simulando que wrapper(func, arg) fue interrumpida
@@ -541,7 +1132,7 @@ CreateTask(TaskFunc_t func, unsigned stacksize, void *arg, const char *name, uns
 	empuja al stack cuando se produce una interrupción. Los demás carecen
 	de importancia, porque wrapper() todavía no comenzó a ejecutar.
 	*/
-	s = (InitialStack_t *)(task->stack + stacksize) - 1;
+	s = (InitialStack_t *)task->stack_end - 1;
 
 	s->regs.eip = (unsigned) wrapper;			// simular interrupción
 	s->regs.cs = MT_CS;							// .
@@ -553,7 +1144,13 @@ CreateTask(TaskFunc_t func, unsigned stacksize, void *arg, const char *name, uns
 
 	// Agregar a lista de tareas
 	Atomic();
-	task_list_add(task);
+	if ( !task_list_add(task) )
+	{
+		Unatomic();
+		free_task(task);
+		return NULL;
+	}
+	task->group->ntasks++;
 	Unatomic();
 
 	return task;
@@ -566,7 +1163,9 @@ DeleteTask - elimina una tarea creada con CreateTask.
 Si es la tarea actual ejecuta Exit(), en caso contrario se modifica su
 contexto para que ejecute Exit() la próxima vez que recupere el contexto,
 con interrupciones habilitadas y en modo preemptivo. Si está bloqueada se
-la despierta, haciendo fracasar una posible función bloqueante.
+la despierta, haciendo fracasar una posible función bloqueante. Si dejó la CPU
+con mt_switch_fast() su contexto no tiene el formato de una interrupción, y se
+arma uno nuevo debajo en su stack.
 --------------------------------------------------------------------------------
 */
 
@@ -579,16 +1178,39 @@ DeleteTask(Task_t *task, int status)
 	if ( !mt_curr_task->protected && task->protected )
 		return false;
 	bool ints = SetInts(false);
-	task->esp->eip = (unsigned) Exit;				// la tarea va a ejecutar Exit()
+	if ( task->fast_frame )							// armar un contexto de interrupción
+	{
+		task->esp = (mt_regs_t *) ((char *) task->esp - sizeof(mt_regs_t));
+		task->fast_frame = false;
+	}
+	mt_exit_frame(task->esp, status);				// la tarea va a ejecutar Exit()
 	task->atomic_level = 0;							// en modo preemptivo
-	task->esp->eflags = INTFL;						// con interrupciones habilitadas
-	((DeleteStack_t *)task->esp)->status = status;	// argumento de Exit()
 	ready(task, false);
 	scheduler();
 	SetInts(ints);
 	return true;
 }
 
+/*
+--------------------------------------------------------------------------------
+mt_exit_frame - modifica el contexto guardado de una tarea para que ejecute
+	Exit(status) cuando lo recupere, con interrupciones habilitadas.
+
+Si la tarea fue interrumpida en ring 3 el contexto incluye el stack de usuario,
+que ocupa el lugar de la dirección de retorno y el argumento de Exit(). Como
+el retorno es a ring 0, iret no lo recupera.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_exit_frame(mt_regs_t *regs, int status)
+{
+	regs->eip = (unsigned) Exit;
+	regs->cs = MT_CS;
+	regs->eflags = INTFL;
+	((DeleteStack_t *)regs)->status = status;
+}
+
 /*
 --------------------------------------------------------------------------------
 Protect - protege una tarea contra DeleteTask()
@@ -622,8 +1244,9 @@ Attach(Task_t *task)
 		Unatomic();
 		return false;
 	}
-	mt_curr_task->nattached++;
-	task->attached_to = mt_curr_task;
+	bool ints = SetInts(false);
+	attach(task, mt_curr_task);
+	SetInts(ints);
 	Unatomic();
 	return true;
 }
@@ -634,7 +1257,7 @@ Detach(Task_t *task)
 	if ( task->attached_to != mt_curr_task )
 		return false;
 	bool ints = SetInts(false);
-	mt_curr_task->nattached--;
+	detach(task);
 	if ( task->state == TaskZombie )
 	{
 		ready(task, true);
@@ -733,6 +1356,283 @@ SetCleanup(Task_t *task, Cleanup_t cleanup)
 	return true;
 }
 
+/*
+--------------------------------------------------------------------------------
+SetMemLimit - establece la cantidad máxima de bytes que una tarea puede tener
+	alocados con Malloc() y StrDup(), o cero para no limitarla.
+
+Al alcanzar el límite Malloc() y StrDup() retornan NULL. El límite no afecta a
+los bloques ya alocados.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetMemLimit(Task_t *task, unsigned limit)
+{
+	if ( !mt_curr_task->protected && task->protected )
+		return false;
+	task->mem_limit = limit;
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetMemReclaim - establece si los bloques que una tarea alocó con Malloc() y
+	StrDup() y no liberó se liberan cuando termina.
+
+Solamente es seguro si la tarea no comparte esos bloques con otras tareas que
+la sobreviven, por ejemplo mensajes alocados por ella o chunks de arenas sin
+dueña en las que alocó. Los objetos del kernel
+que crea (colas, pipes, arenas, nombres, etc.) se alocan con mt_kalloc() y
+no se cuentan como bloques de la tarea.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetMemReclaim(Task_t *task, bool reclaim)
+{
+	if ( !mt_curr_task->protected && task->protected )
+		return false;
+	task->mem_reclaim = reclaim;
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetMaxBoost - establece el boost máximo que puede ganar una tarea al bloquearse
+
+Cero la trata siempre como una tarea que consume CPU. Si el boost actual supera
+el nuevo máximo se lo reduce, reencolando la tarea si está en una cola.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetMaxBoost(Task_t *task, unsigned max_boost)
+{
+	TaskQueue_t *queue;
+
+	if ( !mt_curr_task->protected && task->protected )
+		return false;
+	bool ints = SetInts(false);
+	task->max_boost = max_boost;
+	if ( task->boost > max_boost )
+	{
+		task->boost = max_boost;
+		if ( (queue = task->queue) )			// re-encolar según el nuevo boost
+		{
+			mt_dequeue(task);
+			mt_enqueue(task, queue);
+		}
+	}
+	SetInts(ints);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+GetSchedParams, SetSchedParams - parámetros del scheduler
+
+Los tiempos están en milisegundos y se redondean a ticks. max_boost se aplica
+a las tareas que se crean después, ver SetMaxBoost(). SetSchedParams() retorna
+false si los parámetros son inválidos.
+--------------------------------------------------------------------------------
+*/
+
+void
+GetSchedParams(SchedParams_t *params)
+{
+	params->latency = ticks_to_msecs(sched_latency);
+	params->min_slice = ticks_to_msecs(min_slice);
+	params->max_slice = ticks_to_msecs(max_slice);
+	params->hog_factor = hog_factor;
+	params->max_boost = sched_max_boost;
+}
+
+bool
+SetSchedParams(const SchedParams_t *params)
+{
+	if ( !params->min_slice || params->min_slice > params->max_slice || !params->hog_factor )
+		return false;
+	bool ints = SetInts(false);
+	sched_latency = msecs_to_ticks(params->latency);
+	min_slice = msecs_to_ticks(params->min_slice);
+	max_slice = msecs_to_ticks(params->max_slice);
+	hog_factor = params->hog_factor;
+	sched_max_boost = params->max_boost;
+	SetInts(ints);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+CreateGroup, DeleteGroup - creación y destrucción de grupos de tareas
+
+Los grupos forman un árbol. Si parent es NULL el grupo nuevo se crea dentro
+del grupo de la tarea actual, de modo que una tarea no puede salir de la cuota
+de su grupo creando otro. Las tareas nuevas entran en el grupo de la tarea que
+las crea, ver SetGroup(). DeleteGroup() falla si el grupo tiene tareas o
+subgrupos, y con la raíz.
+--------------------------------------------------------------------------------
+*/
+
+TaskGroup_t *
+CreateGroup(const char *name, TaskGroup_t *parent)
+{
+	TaskGroup_t *group = CacheAlloc(&group_cache);
+
+	memset(group, 0, sizeof(TaskGroup_t));
+	group->name = mt_name_dup(name);
+	group->shares = DEFAULT_SHARES;
+	bool ints = SetInts(false);
+	group->parent = parent ? parent : mt_curr_task->group;
+	group->parent->nchildren++;
+	set_weight(group);
+	group->next = group_list;
+	group_list = group;
+	num_groups++;
+	SetInts(ints);
+	return group;
+}
+
+bool
+DeleteGroup(TaskGroup_t *group)
+{
+	TaskGroup_t **g;
+
+	bool ints = SetInts(false);
+	if ( group == &root_group || group->ntasks || group->nchildren )
+	{
+		SetInts(ints);
+		return false;
+	}
+	for ( g = &group_list ; *g != group ; g = &(*g)->next )
+		;
+	*g = group->next;
+	group->parent->nchildren--;
+	num_groups--;
+	SetInts(ints);
+	mt_name_free(group->name);
+	CacheFree(&group_cache, group);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetGroup, GetGroup - grupo de una tarea
+
+Si la tarea está lista se la reencola según el estado de su nuevo grupo.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetGroup(Task_t *task, TaskGroup_t *group)
+{
+	if ( !mt_curr_task->protected && task->protected )
+		return false;
+	bool ints = SetInts(false);
+	task->group->ntasks--;
+	task->group = group;
+	group->ntasks++;
+	if ( task->state == TaskReady )
+	{
+		mt_dequeue(task);
+		mt_enqueue(task, throttled(group) ? &throttled_q : &ready_q);
+	}
+	if ( task == mt_curr_task || task->state == TaskReady )
+		scheduler();
+	SetInts(ints);
+	return true;
+}
+
+TaskGroup_t *
+GetGroup(Task_t *task)
+{
+	return task->group;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetGroupQuota - establece la cuota de CPU de un grupo
+
+El grupo y sus subgrupos pueden usar en conjunto hasta quota milisegundos de
+CPU en cada período; al agotarla sus tareas dejan de ejecutar hasta el período
+siguiente, aunque tengan más prioridad que las demás. Una cuota cero elimina el
+límite. Retorna false si la cuota supera al período, o para la raíz.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetGroupQuota(TaskGroup_t *group, unsigned quota, unsigned period)
+{
+	if ( group == &root_group || (quota && (!period || quota > period)) )
+		return false;
+	bool ints = SetInts(false);
+	group->quota = quota ? msecs_to_ticks(quota) : 0;
+	group->period = msecs_to_ticks(period);
+	group->used = 0;
+	group->refill = timer_ticks;					// renovar o liberar en el próximo tick
+	SetInts(ints);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetGroupShares - establece la fracción de CPU de un grupo respecto de su padre
+
+Las fracciones son relativas a DEFAULT_SHARES, y se multiplican desde la raíz
+para obtener el peso del grupo, que escala la ranura de tiempo de sus tareas
+(ver slice()): a igual prioridad, las tareas de un grupo con la mitad de peso
+ejecutan la mitad del tiempo. Retorna false si shares es cero o mayor que
+MAX_SHARES, o para la raíz.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetGroupShares(TaskGroup_t *group, unsigned shares)
+{
+	if ( group == &root_group || !shares || shares > MAX_SHARES )
+		return false;
+	bool ints = SetInts(false);
+	group->shares = shares;
+	set_weight(group);
+	SetInts(ints);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+GetGroups - devuelve información sobre todos los grupos
+
+El array está alocado dinámicamente, liberar llamando a Free().
+--------------------------------------------------------------------------------
+*/
+
+GroupInfo_t *
+GetGroups(unsigned *ngroups)
+{
+	TaskGroup_t *group;
+	GroupInfo_t *gi, *info;
+
+	Atomic();
+	*ngroups = num_groups;
+	for ( group = group_list, gi = info = mt_kalloc(num_groups * sizeof(GroupInfo_t)) ; group ; group = group->next, gi++ )
+	{
+		gi->group = group;
+		gi->parent = group->parent;
+		gi->ntasks = group->ntasks;
+		gi->shares = group->shares;
+		gi->weight = group->weight;
+		gi->quota = ticks_to_msecs(group->quota);
+		gi->period = ticks_to_msecs(group->period);
+		gi->used = ticks_to_msecs(group->used);
+		gi->throttled = group->throttled;
+		gi->nthrottled = group->nthrottled;
+		gi->usage = group->usage * MSPERTICK;
+	}
+	Unatomic();
+	return info;
+}
+
 /*
 --------------------------------------------------------------------------------
 GetInfo - devuelve información sobre una tarea
@@ -744,6 +1644,7 @@ GetInfo(Task_t *task, TaskInfo_t *info)
 {
 	bool ints = SetInts(false);
 	info->task = task;
+	info->id = task->id;
 	info->consnum = task->consnum;
 	info->priority = task->priority;
 	switch ( info->state = task->state )
@@ -766,8 +1667,22 @@ GetInfo(Task_t *task, TaskInfo_t *info)
 			break;
 	}
 	info->is_timeout = task->in_time_q;
-	info->timeout = ticks_to_msecs(task->ticks);
+	info->timeout = task->in_time_q ? ticks_to_msecs(task->expiry - timer_ticks) : 0;
+	info->period = ticks_to_msecs(task->period);
+	info->overruns = task->overruns;
+	info->fibers = mt_fiber_count(task);
+	info->group = task->group;
+	info->mail = task->mailbox ? task->mailbox->count : 0;
+	info->mail_dropped = task->mailbox ? task->mailbox->dropped : 0;
 	info->protected = task->protected;
+	info->stack_pages = mt_stack_pages(task->stack) + mt_stack_pages(task->ustack);
+	info->mem_current = task->mem_current;
+	info->mem_peak = task->mem_peak;
+	info->mem_limit = task->mem_limit;
+	info->boost = task->boost;
+	info->slice = ticks_to_msecs(task->slice);
+	info->nvcsw = task->nvcsw;
+	info->nivcsw = task->nivcsw;
 	SetInts(ints);
 }
 
@@ -777,6 +1692,8 @@ GetTasks - devuelve información sobre las tareas existentes
 
 Retorna un array de estructuras de tipo TaskInfo_t, una por tarea, y la cantidad
 de tareas. El array está alocado dinámicamente, liberar llamando a Free().
+Recorre la lista de tareas como lector de RCU, sin impedir el desalojo; las
+tareas que se crean o terminan mientras tanto pueden aparecer o no.
 --------------------------------------------------------------------------------
 */
 
@@ -785,12 +1702,19 @@ GetTasks(unsigned *ntasks)
 {
 	Task_t *t;
 	TaskInfo_t *ti, *info;
+	unsigned max, n;
 
-	Atomic();
-	*ntasks = num_tasks;
-	for ( t = task_list, ti = info = Malloc(num_tasks * sizeof(TaskInfo_t)) ; t ; t = t->list_next, ti++ )
-		GetInfo(t, ti);
-	Unatomic();
+	RcuReadLock();
+	max = num_tasks;
+	ti = info = mt_kalloc(max * sizeof(TaskInfo_t));
+	for ( n = 0, t = RcuDeref(task_list) ; t && n < max ; t = RcuDeref(t->list_next) )
+		if ( t->state != TaskTerminated )
+		{
+			GetInfo(t, ti++);
+			n++;
+		}
+	RcuReadUnlock();
+	*ntasks = n;
 	return info;
 }
 
@@ -831,6 +1755,165 @@ Suspend(Task_t *task)
 	return true;
 }
 
+/*
+--------------------------------------------------------------------------------
+GetTaskId - devuelve el id de una tarea
+GetTask - devuelve la tarea correspondiente a un id, o NULL si no es válido
+
+El id de una tarea deja de ser válido cuando la tarea termina, y no se repite
+hasta que se reutilice 65535 veces la misma entrada de la tabla de ids, de modo
+que a diferencia de un puntero se puede guardar y verificar en cualquier
+momento, en tiempo constante. El puntero que retorna GetTask() puede quedar
+inválido si la tarea termina después; las funciones que reciben un id en
+lugar de un puntero lo verifican en modo atómico.
+--------------------------------------------------------------------------------
+*/
+
+TaskId_t
+GetTaskId(Task_t *task)
+{
+	return task->id;
+}
+
+Task_t *
+GetTask(TaskId_t id)
+{
+	Task_t *task;
+
+	Atomic();
+	task = task_from_id(id);
+	Unatomic();
+	return task;
+}
+
+/*
+--------------------------------------------------------------------------------
+DeleteTaskId, AttachId, DetachId, SetPriorityId, GetInfoId, ReadyId, SuspendId,
+JoinId, JoinTimedId, SendId, SendTimedId - variantes de las funciones
+correspondientes que reciben un id de tarea. Fracasan si el id no es válido.
+--------------------------------------------------------------------------------
+*/
+
+bool
+DeleteTaskId(TaskId_t id, int status)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && DeleteTask(task, status);
+	Unatomic();
+	return success;
+}
+
+bool
+AttachId(TaskId_t id)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && Attach(task);
+	Unatomic();
+	return success;
+}
+
+bool
+DetachId(TaskId_t id)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && Detach(task);
+	Unatomic();
+	return success;
+}
+
+bool
+SetPriorityId(TaskId_t id, unsigned priority)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && SetPriority(task, priority);
+	Unatomic();
+	return success;
+}
+
+bool
+GetInfoId(TaskId_t id, TaskInfo_t *info)
+{
+	Task_t *task;
+
+	Atomic();
+	if ( (task = task_from_id(id)) )
+		GetInfo(task, info);
+	Unatomic();
+	return task != NULL;
+}
+
+bool
+ReadyId(TaskId_t id)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && Ready(task);
+	Unatomic();
+	return success;
+}
+
+bool
+SuspendId(TaskId_t id)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && Suspend(task);
+	Unatomic();
+	return success;
+}
+
+bool
+JoinId(TaskId_t id, int *status)
+{
+	return JoinTimedId(id, status, FOREVER);
+}
+
+bool
+JoinTimedId(TaskId_t id, int *status, unsigned msecs)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && JoinTimed(task, status, msecs);
+	Unatomic();
+	return success;
+}
+
+bool
+SendId(TaskId_t id, void *msg, unsigned size)
+{
+	return SendTimedId(id, msg, size, FOREVER);
+}
+
+bool
+SendTimedId(TaskId_t id, void *msg, unsigned size, unsigned msecs)
+{
+	Task_t *task;
+	bool success;
+
+	Atomic();
+	success = (task = task_from_id(id)) && SendTimed(task, msg, size, msecs);
+	Unatomic();
+	return success;
+}
+
 /*
 --------------------------------------------------------------------------------
 CurrentTask - retorna la tarea actual
@@ -858,35 +1941,121 @@ Pause(void)
 /*
 --------------------------------------------------------------------------------
 Yield - cede voluntariamente la CPU
+
+La tarea pierde todo su boost antes de volver a la cola de ready, de modo que
+queda detrás de todas las tareas listas de su misma prioridad, como si no
+existiera el boost. Si no hay ninguna, sigue corriendo.
+--------------------------------------------------------------------------------
+*/
+
+void
+Yield(void)
+{
+	bool ints = SetInts(false);
+	mt_curr_task->boost = 0;
+	ready(mt_curr_task, false);
+	scheduler();
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+Delay - pone a la tarea actual a dormir durante una cantidad de milisegundos
+--------------------------------------------------------------------------------
+*/
+
+void
+Delay(unsigned msecs)
+{
+	bool ints = SetInts(false);
+	if ( msecs )
+	{
+		block(mt_curr_task, TaskDelaying);
+		if ( msecs != FOREVER )
+			mt_enqueue_time(mt_curr_task, expiry(msecs));
+	}
+	else
+		ready(mt_curr_task, false);
+	scheduler();
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+DelayUntil - pone a la tarea actual a dormir hasta un tiempo absoluto
+
+El tiempo está en milisegundos desde el arranque, como lo devuelve Time(), y se
+redondea al tick siguiente. A diferencia de una serie de llamadas a Delay(), una
+serie de vencimientos absolutos no acumula el tiempo de ejecución ni los
+redondeos. Retorna false sin dormir si el tiempo ya pasó.
+--------------------------------------------------------------------------------
+*/
+
+bool
+DelayUntil(Time_t deadline)
+{
+	bool ints = SetInts(false);
+	Time_t now = ticks_to_msecs(timer_ticks);
+	bool success = deadline > now;
+
+	if ( success )
+		delay_until(timer_ticks + msecs_to_ticks(min(deadline - now, FOREVER - MSPERTICK)));
+	SetInts(ints);
+	return success;
+}
+
+/*
+--------------------------------------------------------------------------------
+SetPeriod - establece el período de la tarea actual en milisegundos
+
+El primer vencimiento es un período después de la llamada, ver
+WaitNextPeriod(). El período se redondea a ticks; cero lo desactiva.
 --------------------------------------------------------------------------------
 */
 
 void
-Yield(void)
+SetPeriod(unsigned msecs)
 {
-	Ready(mt_curr_task);
+	bool ints = SetInts(false);
+	mt_curr_task->period = msecs_to_ticks(msecs);
+	mt_curr_task->deadline = timer_ticks + mt_curr_task->period;
+	mt_curr_task->overruns = 0;
+	SetInts(ints);
 }
 
 /*
 --------------------------------------------------------------------------------
-Delay - pone a la tarea actual a dormir durante una cantidad de milisegundos
+WaitNextPeriod - espera el próximo vencimiento del período de la tarea actual
+
+Cada vencimiento se calcula a partir del anterior, no del momento en que se
+llama, de modo que el período no deriva. Si la tarea ya pasó uno o más
+vencimientos (overrun), los saltea manteniendo la fase y espera el siguiente.
+Retorna la cantidad de vencimientos salteados, que se acumulan en el campo
+overruns de TaskInfo_t. Si la tarea no tiene período retorna sin esperar.
 --------------------------------------------------------------------------------
 */
 
-void
-Delay(unsigned msecs)
+unsigned
+WaitNextPeriod(void)
 {
+	Task_t *task = mt_curr_task;
+	unsigned missed = 0;
+
 	bool ints = SetInts(false);
-	if ( msecs )
+	if ( task->period )
 	{
-		block(mt_curr_task, TaskDelaying);
-		if ( msecs != FOREVER )
-			mt_enqueue_time(mt_curr_task, msecs_to_ticks(msecs));
+		if ( timer_ticks > task->deadline )
+		{
+			missed = ((unsigned) (timer_ticks - task->deadline) + task->period - 1) / task->period;
+			task->deadline += (Time_t) missed * task->period;
+			task->overruns += missed;
+		}
+		if ( task->deadline > timer_ticks )
+			delay_until(task->deadline);
+		task->deadline += task->period;
 	}
-	else
-		ready(mt_curr_task, false);
-	scheduler();
 	SetInts(ints);
+	return missed;
 }
 
 /*
@@ -938,7 +2107,7 @@ JoinTimed(Task_t *task, int *status, unsigned msecs)
 	if ( task->state == TaskZombie )			// está esperando nuestro Join()
 	{
 		*status = task->join_status;
-		mt_curr_task->nattached--;
+		detach(task);
 		ready(task, true);
 		scheduler();
 		SetInts(ints);
@@ -956,13 +2125,10 @@ JoinTimed(Task_t *task, int *status, unsigned msecs)
 	mt_curr_task->join = task;
 	mt_curr_task->state = TaskJoining;
 	if ( msecs != FOREVER )
-		mt_enqueue_time(mt_curr_task, msecs_to_ticks(msecs));
+		mt_enqueue_time(mt_curr_task, expiry(msecs));
 	scheduler();
-	if ( (success = mt_curr_task->success) )
-	{
+	if ( (success = mt_curr_task->success) )		// la tarea ya se desvinculó
 		*status = mt_curr_task->join_status;
-		mt_curr_task->nattached--;
-	}
 	SetInts(ints);
 	return success;
 }
@@ -972,7 +2138,9 @@ JoinTimed(Task_t *task, int *status, unsigned msecs)
 Exit - finaliza la tarea actual
 
 Todas las tareas creadas con CreateTask retornan a esta funcion que las mata.
-Esta funcion nunca retorna. Ejecuta un manejador de cleanup si ha sido instalado.
+Esta funcion nunca retorna. Ejecuta un manejador de cleanup si ha sido instalado,
+destruye las arenas y las fibras asociadas a la tarea y libera los bloques que
+alocó y no liberó, si se pidió con SetMemReclaim().
 La tarea ingresa en la cola de tareas terminadas, para su posterior limpieza.
 --------------------------------------------------------------------------------
 */
@@ -981,6 +2149,7 @@ void
 Exit(int status)
 {
 	Task_t *t;
+	mt_mailbox_t *mb;
 
 	if ( mt_curr_task->exiting )
 		Panic ("Exit recursivo");
@@ -989,25 +2158,33 @@ Exit(int status)
 
 	if ( mt_curr_task->cleanup )
 		mt_curr_task->cleanup();					// no debe llamar a Exit()
+	if ( mt_curr_task->rcu_nesting )				// salir de la lectura de RCU
+	{
+		mt_curr_task->rcu_nesting = 1;
+		RcuReadUnlock();
+	}
+	mt_delete_arenas(mt_curr_task);					// arenas de la tarea
+	mt_exit_fibers(mt_curr_task);					// fibras de la tarea
+	if ( mt_curr_task->mailbox )					// el buzón se libera más abajo
+		mt_disown(mt_curr_task->mailbox);
+	release_mem(mt_curr_task);						// bloques de la tarea
 
 	Atomic();
-	if ( mt_curr_task->nattached )					// desvincular tareas vinculadas
-		for ( t = task_list ; t ; t = t->list_next )
-			if ( t->attached_to == mt_curr_task )
-			{
-				bool ints = SetInts(false);
-				t->attached_to = NULL;
-				if ( t->state == TaskZombie )
-					ready(t, true);
-				SetInts(ints);
-			}
 	mt_cli();
+	while ( (t = mt_curr_task->children) )			// desvincular tareas vinculadas
+	{
+		detach(t);
+		t->attached_to = NULL;
+		if ( t->state == TaskZombie )
+			ready(t, true);
+	}
 	if ( (t = mt_curr_task->attached_to) )			// estamos vinculados
 	{
 		if ( t->state == TaskJoining && t->join == mt_curr_task )
 		{
 			// t ya ejecutó Join() y nos está esperando
 			t->join_status = status;
+			detach(mt_curr_task);
 			ready(t, true);
 		}
 		else
@@ -1021,9 +2198,16 @@ Exit(int status)
 			while ( !mt_curr_task->success );
 	}
 	FlushQueue(&mt_curr_task->send_queue, false);	// no recibimos más mensajes
+	if ( (mb = mt_curr_task->mailbox) )				// ni en el buzón
+	{
+		mt_curr_task->mailbox = NULL;
+		FlushQueue(&mb->put_q, false);
+		Free(mb);
+	}
 	if ( mt_fpu_task == mt_curr_task )				// liberar el coprocesador
 		mt_fpu_task = NULL;
 	task_list_remove(mt_curr_task);					// quitar de la lista de tareas
+	mt_curr_task->group->ntasks--;					// y de su grupo
 	mt_curr_task->state = TaskTerminated;			// terminar
 	mt_curr_task->priority = 0;						// para encolar más rápido
 	mt_enqueue(mt_curr_task, &terminated_q);		// al recolector de basura
@@ -1116,6 +2300,24 @@ TLS - puntero a datos locales de la tarea actual
 
 void *TLS;
 
+/*
+--------------------------------------------------------------------------------
+mt_tls_clear - borra una clave de TLS en todas las tareas existentes
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_tls_clear(unsigned key)
+{
+	Task_t *task;
+
+	bool ints = SetInts(false);
+	for ( task = task_list ; task ; task = task->list_next )
+		task->tls_keys[key] = NULL;
+	mt_curr_task->tls_keys[key] = NULL;			// puede no estar en la lista
+	SetInts(ints);
+}
+
 /*
 --------------------------------------------------------------------------------
 CreateQueue - crea una cola de tareas
@@ -1125,9 +2327,9 @@ CreateQueue - crea una cola de tareas
 TaskQueue_t *
 CreateQueue(const char *name)
 {
-	TaskQueue_t *queue = Malloc(sizeof(TaskQueue_t));
+	TaskQueue_t *queue = mt_kalloc(sizeof(TaskQueue_t));
 
-	queue->name = StrDup(name);
+	queue->name = mt_kstrdup(name);
 	return queue;
 }
 
@@ -1173,7 +2375,7 @@ WaitQueueTimed(TaskQueue_t *queue, unsigned msecs)
 	block(mt_curr_task, TaskWaiting);
 	mt_enqueue(mt_curr_task, queue);
 	if ( msecs != FOREVER )
-		mt_enqueue_time(mt_curr_task, msecs_to_ticks(msecs));
+		mt_enqueue_time(mt_curr_task, expiry(msecs));
 	scheduler();
 	success = mt_curr_task->success;
 	SetInts(ints);
@@ -1250,20 +2452,8 @@ SendTimed(Task_t *to, void *msg, unsigned size, unsigned msecs)
 
 	bool ints = SetInts(false);
 
-	if ( to->state == TaskReceiving && (!to->from || to->from == mt_curr_task) )
+	if ( deliver(to, msg, size) )
 	{
-		to->from = mt_curr_task;
-		if ( to->msg && msg )
-		{
-			if ( size > to->size )
-				Panic("Buffer insuficiente para transmitir mensaje a %s, %u > %u", GetName(to), size, to->size);
-			to->size = size;
-			memcpy(to->msg, msg, size);
-		}
-		else
-			to->size = 0;
-		ready(to, true);
-		scheduler();
 		SetInts(ints);
 		return true;
 	}
@@ -1279,7 +2469,7 @@ SendTimed(Task_t *to, void *msg, unsigned size, unsigned msecs)
 	mt_curr_task->state = TaskSending;
 	mt_enqueue(mt_curr_task, &to->send_queue);
 	if ( msecs != FOREVER )
-		mt_enqueue_time(mt_curr_task, msecs_to_ticks(msecs));
+		mt_enqueue_time(mt_curr_task, expiry(msecs));
 	scheduler();
 	success = mt_curr_task->success;
 
@@ -1288,9 +2478,55 @@ SendTimed(Task_t *to, void *msg, unsigned size, unsigned msecs)
 }
 
 
+/*
+--------------------------------------------------------------------------------
+accepts - indica si una tarea está bloqueada en Receive() esperando un mensaje
+	de la tarea actual
+copy_msg - le copia el mensaje, sin despertarla
+deliver - si la tarea espera el mensaje se lo entrega y la despierta
+
+Se llaman con interrupciones deshabilitadas.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+accepts(Task_t *to)
+{
+	return to->state == TaskReceiving && (!to->from || to->from == mt_curr_task);
+}
+
+static void
+copy_msg(Task_t *to, void *msg, unsigned size)
+{
+	to->from = mt_curr_task;
+	if ( to->msg && msg )
+	{
+		if ( size > to->size )
+			Panic("Buffer insuficiente para transmitir mensaje a %s, %u > %u", GetName(to), size, to->size);
+		to->size = size;
+		memcpy(to->msg, msg, size);
+	}
+	else
+		to->size = 0;
+}
+
+static bool
+deliver(Task_t *to, void *msg, unsigned size)
+{
+	if ( !accepts(to) )
+		return false;
+	copy_msg(to, msg, size);
+	ready(to, true);
+	scheduler();
+	return true;
+}
+
 /*
 --------------------------------------------------------------------------------
 Receive, ReceiveCond, ReceiveTimed - recibir un mensaje
+
+Si la tarea tiene un buzón (ver SetMailbox()) se toman primero los mensajes
+que haya en él, y después los de las tareas bloqueadas en Send().
 --------------------------------------------------------------------------------
 */
 
@@ -1311,9 +2547,17 @@ ReceiveTimed(Task_t **from, void *msg, unsigned *size, unsigned msecs)
 {
 	bool success;
 	Task_t *sender;
+	mt_mailbox_t *mb;
 
 	bool ints = SetInts(false);
 
+	if ( (mb = mt_curr_task->mailbox) && mb->count && take_mail(mb, from, msg, size) )
+	{
+		scheduler();
+		SetInts(ints);
+		return true;
+	}
+
 	if ( from && *from )
 		sender = (*from)->queue == &mt_curr_task->send_queue ? *from : NULL;
 	else
@@ -1346,25 +2590,293 @@ ReceiveTimed(Task_t **from, void *msg, unsigned *size, unsigned msecs)
 		return false;
 	}
 
+	await_msg(from, msg, size);
+	if ( msecs != FOREVER )
+		mt_enqueue_time(mt_curr_task, expiry(msecs));
+	scheduler();
+	success = got_msg(from, size);
+
+	SetInts(ints);
+	return success;
+}
+
+/*
+--------------------------------------------------------------------------------
+await_msg - bloquea a la tarea actual en Receive(), sin cambiar de contexto
+got_msg - completa Receive() cuando la tarea se despierta
+
+Se llaman con interrupciones deshabilitadas.
+--------------------------------------------------------------------------------
+*/
+
+static void
+await_msg(Task_t **from, void *msg, unsigned *size)
+{
 	mt_curr_task->from = from ? *from : NULL;
 	mt_curr_task->msg = msg;
 	mt_curr_task->size = size ? *size : 0;
 	mt_curr_task->state = TaskReceiving;
-	if ( msecs != FOREVER )
-		mt_enqueue_time(mt_curr_task, msecs_to_ticks(msecs));
-	scheduler();
-	if ( (success = mt_curr_task->success) )
+}
+
+static bool
+got_msg(Task_t **from, unsigned *size)
+{
+	if ( !mt_curr_task->success )
+		return false;
+	if ( size )
+		*size = mt_curr_task->size;
+	if ( from )
+		*from = mt_curr_task->from;
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+Call - envía un pedido a una tarea y espera su respuesta
+ReplyWait - responde un pedido y espera el siguiente
+
+Call() equivale a Send() seguido de Receive() de la misma tarea, y ReplyWait()
+a Send() de la respuesta seguido de Receive() del próximo pedido, pero si la
+otra tarea ya está esperando el mensaje le pasan la CPU directamente, sin pasar
+por la cola de tareas listas, y le ceden el resto de la ranura de tiempo (ver
+handoff()). Así un pedido y su respuesta entre un cliente que llama a Call() y
+un servidor bloqueado en ReplyWait() cuestan dos cambios de contexto.
+ReplyWait() con to en NULL solamente espera un pedido, para el primero.
+--------------------------------------------------------------------------------
+*/
+
+bool
+Call(Task_t *to, void *msg, unsigned size, void *reply, unsigned *reply_size)
+{
+	Task_t *from = to;
+	bool success;
+
+	bool ints = SetInts(false);
+	if ( !accepts(to) )
 	{
-		if ( size )
-			*size = mt_curr_task->size;
-		if ( from )
-			*from = mt_curr_task->from;
+		SetInts(ints);
+		return Send(to, msg, size) && Receive(&from, reply, reply_size);
 	}
+	copy_msg(to, msg, size);
+	await_msg(&from, reply, reply_size);
+	handoff(to);
+	success = got_msg(&from, reply_size);
+	SetInts(ints);
+	return success;
+}
+
+bool
+ReplyWait(Task_t *to, void *reply, unsigned size, Task_t **from, void *msg, unsigned *msg_size)
+{
+	mt_mailbox_t *mb = mt_curr_task->mailbox;
+	bool success;
 
+	bool ints = SetInts(false);
+	if ( !to || !accepts(to) )
+	{
+		SetInts(ints);
+		return (!to || Send(to, reply, size)) && Receive(from, msg, msg_size);
+	}
+	copy_msg(to, reply, size);
+	if ( (mb && mb->count) || mt_peeklast(&mt_curr_task->send_queue) )
+	{
+		// Hay pedidos pendientes, no hay que bloquearse
+		ready(to, true);
+		SetInts(ints);
+		return Receive(from, msg, msg_size);
+	}
+	await_msg(from, msg, msg_size);
+	handoff(to);
+	success = got_msg(from, msg_size);
 	SetInts(ints);
 	return success;
 }
 
+/*
+--------------------------------------------------------------------------------
+SetMailbox - crea, reemplaza o elimina el buzón de la tarea actual
+
+El buzón guarda hasta nmsgs mensajes de hasta msg_size bytes, que otras tareas
+envían con PostMessage() sin esperar a que la tarea llame a Receive(). La
+política determina qué pasa cuando está lleno: con MailBlock el remitente
+espera lugar, con MailDrop se descarta el mensaje más viejo y con MailFail
+PostMessage() retorna false. Con nmsgs cero se elimina el buzón, y los
+remitentes que esperaban lugar retornan false. Retorna false si el buzón
+actual tiene mensajes sin leer, o si no se puede alocar el nuevo: el buzón
+se cuenta como memoria de la tarea (ver SetMemLimit()) hasta que termina.
+--------------------------------------------------------------------------------
+*/
+
+bool
+SetMailbox(unsigned nmsgs, unsigned msg_size, MailPolicy_t policy)
+{
+	mt_mailbox_t *mb, *old;
+	unsigned slot = (sizeof(mt_mail_t) + msg_size + 3) & ~3;
+
+	if ( nmsgs && (slot * nmsgs) / nmsgs != slot )
+		return false;
+	if ( (mb = nmsgs ? Malloc(sizeof(mt_mailbox_t) + slot * nmsgs) : NULL) )
+	{
+		mb->max = nmsgs;
+		mb->msg_size = msg_size;
+		mb->slot = slot;
+		mb->policy = policy;
+		mb->put_q.name = GetName(mt_curr_task);
+		mb->buf = (char *) (mb + 1);
+	}
+	else if ( nmsgs )
+		return false;
+
+	bool ints = SetInts(false);
+	if ( (old = mt_curr_task->mailbox) && old->count )
+	{
+		SetInts(ints);
+		Free(mb);
+		return false;
+	}
+	mt_curr_task->mailbox = mb;
+	if ( old )
+		FlushQueue(&old->put_q, false);
+	SetInts(ints);
+	Free(old);
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+PostMessage, PostMessageTimed - enviar un mensaje sin esperar al receptor
+
+Si el receptor está bloqueado en Receive() esperando un mensaje nuestro se lo
+entrega directamente, como Send(); si no, se copia en su buzón y se retorna.
+Si el buzón está lleno se aplica su política, ver SetMailbox(); con MailBlock
+PostMessageTimed() puede salir por timeout. Retorna false si el receptor no
+tiene buzón, si el mensaje excede el tamaño de sus entradas o si no se pudo
+depositar.
+--------------------------------------------------------------------------------
+*/
+
+bool
+PostMessage(Task_t *to, void *msg, unsigned size)
+{
+	return PostMessageTimed(to, msg, size, FOREVER);
+}
+
+bool
+PostMessageTimed(Task_t *to, void *msg, unsigned size, unsigned msecs)
+{
+	mt_mailbox_t *mb;
+	mt_mail_t *m;
+	Time_t deadline = msecs != FOREVER ? expiry(msecs) : 0;
+
+	bool ints = SetInts(false);
+	while ( true )
+	{
+		if ( !(mb = to->mailbox) || (msg && size > mb->msg_size) )
+			break;
+		if ( deliver(to, msg, size) )
+		{
+			SetInts(ints);
+			return true;
+		}
+		if ( mb->count == mb->max )
+		{
+			if ( mb->policy == MailFail || (mb->policy == MailBlock && !msecs) )
+				break;
+			if ( mb->policy == MailDrop )
+			{
+				mb->head = (mb->head + 1) % mb->max;
+				mb->count--;
+				mb->dropped++;
+			}
+			else
+			{
+				// Esperar que el receptor libere lugar
+				if ( deadline && deadline <= timer_ticks )
+					break;
+				block(mt_curr_task, TaskSending);
+				mt_enqueue(mt_curr_task, &mb->put_q);
+				if ( deadline )
+					mt_enqueue_time(mt_curr_task, deadline);
+				scheduler();
+				if ( !mt_curr_task->success )
+					break;
+				continue;
+			}
+		}
+		m = mail(mb, mb->count++);
+		m->from = mt_curr_task->id;
+		m->size = msg ? size : 0;
+		if ( m->size )
+			memcpy(m + 1, msg, size);
+		SetInts(ints);
+		return true;
+	}
+	SetInts(ints);
+	return false;
+}
+
+/*
+--------------------------------------------------------------------------------
+mail - n-ésima entrada del buzón, contando desde la más vieja
+--------------------------------------------------------------------------------
+*/
+
+static mt_mail_t *
+mail(mt_mailbox_t *mb, unsigned n)
+{
+	return (mt_mail_t *) (mb->buf + ((mb->head + n) % mb->max) * mb->slot);
+}
+
+/*
+--------------------------------------------------------------------------------
+take_mail - saca del buzón el mensaje más viejo, o el más viejo del remitente
+	indicado en *from, y despierta a un remitente que esperaba lugar.
+
+Se llama con interrupciones deshabilitadas. Si el remitente ya terminó se
+devuelve NULL en *from. Sacar un mensaje que no es el más viejo corre los
+siguientes.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+take_mail(mt_mailbox_t *mb, Task_t **from, void *msg, unsigned *size)
+{
+	TaskId_t id = from && *from ? (*from)->id : 0;
+	mt_mail_t *m;
+	unsigned i;
+	Task_t *t;
+
+	for ( i = 0 ; i < mb->count && id && mail(mb, i)->from != id ; i++ )
+		;
+	if ( i == mb->count )
+		return false;
+
+	m = mail(mb, i);
+	if ( from )
+		*from = task_from_id(m->from);
+	if ( msg && m->size )
+	{
+		if ( size )
+		{
+			if ( m->size > *size )
+				Panic("Buffer insuficiente para recibir mensaje, %u > %u", m->size, *size);
+			memcpy(msg, m + 1, *size = m->size);
+		}
+	}
+	else if ( size )
+		*size = 0;
+
+	if ( !i )
+		mb->head = (mb->head + 1) % mb->max;
+	else
+		for ( ; i < mb->count - 1 ; i++ )
+			memcpy(mail(mb, i), mail(mb, i + 1), mb->slot);
+	mb->count--;
+	if ( (t = mt_getlast(&mb->put_q)) )
+		ready(t, true);
+	return true;
+}
+
 /*
 --------------------------------------------------------------------------------
 GetName - devuelve el nombre de cualquier objeto creado mediante una función
@@ -1393,6 +2905,16 @@ Time(void)
 /*
 --------------------------------------------------------------------------------
 Malloc, StrDup, Free - manejo de memoria dinamica
+
+Cada bloque lleva una cabecera que lo enlaza en la lista de bloques de la tarea
+que lo alocó, para contar los bytes que tiene alocados cada tarea (ver
+GetInfo()), aplicar su límite (ver SetMemLimit()) y liberarlos o desvincularlos
+cuando termina (ver SetMemReclaim()). Malloc() y StrDup() retornan NULL si la
+tarea alcanzó su límite o si no hay memoria suficiente en el heap.
+
+La memoria interna del kernel se aloca con mt_kalloc() y mt_kstrdup(), que no
+la cuentan a ninguna tarea, nunca retornan NULL y detienen el sistema si se
+agota el heap. Se libera con Free().
 --------------------------------------------------------------------------------
 */
 
@@ -1401,11 +2923,26 @@ Malloc(unsigned size)
 {
 	void *p;
 
-	free_terminated();
-	Atomic();
-	if ( !(p = malloc(size)) )
-		Panic("Error malloc");
-	Unatomic();
+	if ( (p = mem_alloc(mt_curr_task, size, __builtin_return_address(0))) )
+		memset(p, 0, size);
+	return p;
+}
+
+/*
+mt_task_alloc aloca sin inicializar un bloque a cargo de una tarea, que puede
+no ser la actual, con las mismas condiciones que Malloc(). Ver arena.c.
+*/
+void *
+mt_task_alloc(Task_t *task, unsigned size)
+{
+	return mem_alloc(task, size, __builtin_return_address(0));
+}
+
+void *
+mt_kalloc(unsigned size)
+{
+	void *p = mem_alloc(NULL, size, __builtin_return_address(0));
+
 	memset(p, 0, size);
 	return p;
 }
@@ -1415,13 +2952,20 @@ StrDup(const char *str)
 {
 	char *p;
 
+	if ( !str || !(p = mem_alloc(mt_curr_task, strlen(str) + 1, __builtin_return_address(0))) )
+		return NULL;
+	strcpy(p, str);
+	return p;
+}
+
+char *
+mt_kstrdup(const char *str)
+{
+	char *p;
+
 	if ( !str )
 		return NULL;
-	free_terminated();
-	Atomic();
-	if ( !(p = malloc(strlen(str) + 1)) )
-		Panic("Error strdup");
-	Unatomic();
+	p = mem_alloc(NULL, strlen(str) + 1, __builtin_return_address(0));
 	strcpy(p, str);
 	return p;
 }
@@ -1429,10 +2973,31 @@ StrDup(const char *str)
 void
 Free(void *mem)
 {
+	mt_mem_t *m = (mt_mem_t *) mem - 1;
+
 	if ( !mem )
 		return;
 	Atomic();
-	free(mem);
+	mem_unlink(m);
+	mt_free(m, __builtin_return_address(0));
+	Unatomic();
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_disown - desvincula un bloque alocado con Malloc() de la tarea que lo
+	alocó, para que deje de contarse y no se libere cuando la tarea termina.
+
+Se usa para la memoria que una tarea aloca a su cargo y luego pasa al
+kernel, que la libera aunque la tarea haya terminado.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_disown(void *mem)
+{
+	Atomic();
+	mem_unlink((mt_mem_t *) mem - 1);
 	Unatomic();
 }
 
@@ -13,12 +13,24 @@ math_handler(unsigned except_num, unsigned error, mt_regs_t *regs)
 	// Bajar el bit
 	mt_clts();
 
+	// El i386 también levanta el bit en los cambios de tarea por hardware,
+	// como el del manejador de fallos de página (ver paging.c). En ese caso
+	// la tarea actual puede ser la dueña del coprocesador.
+	if ( mt_fpu_task == mt_curr_task )
+		return;
+
 	// Si alguien usó el coprocesador antes, guardar el estado. 
 	// Si no, resetearlo.
 	if ( mt_fpu_task )
 	{
+		// Memoria del kernel, no se cuenta a la tarea (ver Malloc())
 		if ( !mt_fpu_task->math_data )
-			mt_fpu_task->math_data = Malloc(CP_SIZE);
+		{
+			Atomic();
+			if ( !(mt_fpu_task->math_data = malloc(CP_SIZE)) )
+				Panic("Error malloc");
+			Unatomic();
+		}
 		mt_fsave(mt_fpu_task->math_data);
 	}
 	else
@@ -0,0 +1,18 @@
+#include <kernel.h>
+
+/*
+Offsets de estructuras usados por el código assembler. Este archivo no forma
+parte del kernel: el makefile lo compila a assembler y extrae de la salida
+include/offsets.h, de modo que los campos pueden reordenarse sin actualizar
+interrupts.S ni libasm.S.
+*/
+
+#define OFFSET(sym, type, field) \
+	__asm__ __volatile__("\n->" #sym " %c0" :: "i" (__builtin_offsetof(type, field)))
+
+void
+offsets(void)
+{
+	OFFSET(Task_t_ESP, Task_t, esp);
+	OFFSET(Task_t_FAST, Task_t, fast_frame);
+}
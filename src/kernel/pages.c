@@ -0,0 +1,361 @@
+#include <kernel.h>
+
+/*
+	Alocador de páginas (buddy system).
+
+	Toda la memoria por encima del kernel y de los módulos cargados por el
+	bootloader se administra en bloques de 2^n páginas físicamente
+	contiguas, alineados a su tamaño. Un bloque libre se divide por la
+	mitad hasta obtener el orden pedido, y al liberarlo se une con su
+	compañero (la otra mitad del bloque del orden siguiente) mientras ese
+	compañero también esté libre. Ambas operaciones cuestan O(MAX_ORDER).
+
+	La memoria se divide en dos zonas: la zona DMA, debajo de 16 MB, que es
+	lo único que alcanzan los controladores DMA del bus ISA, y la zona
+	normal. Los pedidos comunes se sirven de la zona normal y recurren a la
+	zona DMA solamente cuando la normal se agota; los pedidos con PAGES_DMA
+	se sirven siempre de la zona DMA. Los bloques nunca cruzan el límite
+	entre zonas.
+
+	Sobre este alocador trabajan el heap (ver heap.c), que le pide regiones
+	para el alocador de bytes y le pasa directamente los pedidos grandes, y
+	los stacks de las tareas (ver paging.c), que toman de a una página.
+
+	Cada página tiene un descriptor con el orden y el estado del bloque
+	que comienza en ella. Las listas de bloques libres se enlazan en la
+	memoria de los mismos bloques, que está mapeada por identidad.
+*/
+
+#define MAX_ORDER		12						// bloques de hasta 16 MB
+#define DMA_LIMIT		0x1000000				// fin de la zona DMA
+
+#define INDEX(p)		(((char *) (p) - mem_start) / PAGE_SIZE)
+
+// Estado de la página inicial de un bloque
+enum { PAGE_NONE, PAGE_FREE, PAGE_USED };
+
+typedef struct
+{
+	unsigned char	state;
+	unsigned char	order;
+	unsigned char	flags;						// flags del pedido
+}
+page_t;
+
+typedef struct free_block free_block_t;
+
+struct free_block
+{
+	free_block_t *	next;
+	free_block_t *	prev;
+};
+
+typedef struct
+{
+	char *			start;
+	char *			end;
+	unsigned		nfree;						// páginas libres
+	free_block_t *	lists[MAX_ORDER + 1];		// bloques libres por orden
+}
+zone_t;
+
+static zone_t zones[2];							// DMA y normal
+static page_t *pages;							// descriptores
+static char *mem_start, *mem_end;				// memoria administrada
+
+static void add_range(zone_t *z, char *start, char *end);
+static void insert_free(zone_t *z, char *block, unsigned order);
+static void remove_free(zone_t *z, char *block, unsigned order);
+static zone_t *zone_of(char *p);
+
+/*
+--------------------------------------------------------------------------------
+mt_setup_pages - inicializa el alocador de páginas
+
+Recibe el fin de la memoria física y el fin de la memoria reservada por
+encima del kernel (módulos del bootloader), o cero si no hay.
+Los descriptores de las páginas ocupan el comienzo de la memoria
+administrada.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_setup_pages(unsigned end, unsigned reserved_end)
+{
+	extern char _end;					// fin del segmento de datos, ver mtask.map
+	unsigned start, npages;
+
+	start = (max((unsigned) &_end, reserved_end) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	end &= ~(PAGE_SIZE - 1);
+
+	// Descriptores al comienzo, sin contarse a sí mismos
+	npages = (end - start) / PAGE_SIZE;
+	pages = (page_t *) start;
+	memset(pages, 0, npages * sizeof(page_t));
+	start += (npages * sizeof(page_t) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	mem_start = (char *) start;
+	mem_end = (char *) end;
+
+	zones[ZONE_DMA].start = mem_start;
+	zones[ZONE_DMA].end = zones[ZONE_NORMAL].start = (char *) max(start, min(end, DMA_LIMIT));
+	zones[ZONE_NORMAL].end = mem_end;
+	add_range(&zones[ZONE_DMA], zones[ZONE_DMA].start, zones[ZONE_DMA].end);
+	add_range(&zones[ZONE_NORMAL], zones[ZONE_NORMAL].start, zones[ZONE_NORMAL].end);
+
+	mt_heap.size = end - start;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_alloc_pages - aloca un bloque de 2^order páginas contiguas
+
+Con PAGES_DMA el bloque está en la zona DMA. El resto de los flags se guardan
+con el bloque, ver mt_pages_flags(). Retorna NULL si no hay memoria.
+--------------------------------------------------------------------------------
+*/
+
+void *
+mt_alloc_pages(unsigned order, unsigned flags)
+{
+	zone_t *z;
+	char *block = NULL;
+	unsigned k;
+	int zi;
+
+	if ( order > MAX_ORDER )
+		return NULL;
+
+	bool ints = SetInts(false);
+	for ( zi = flags & PAGES_DMA ? ZONE_DMA : ZONE_NORMAL ; !block && zi >= ZONE_DMA ; zi-- )
+		for ( z = &zones[zi], k = order ; k <= MAX_ORDER ; k++ )
+			if ( z->lists[k] )
+			{
+				block = (char *) z->lists[k];
+				remove_free(z, block, k);
+
+				// Devolver las mitades que sobran
+				while ( k > order )
+				{
+					k--;
+					insert_free(z, block + (PAGE_SIZE << k), k);
+				}
+
+				pages[INDEX(block)] = (page_t) { PAGE_USED, order, flags };
+				z->nfree -= 1 << order;
+				break;
+			}
+	SetInts(ints);
+
+	return block;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_free_pages - libera un bloque alocado con mt_alloc_pages()
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_free_pages(void *p)
+{
+	char *block = p, *buddy;
+	zone_t *z = zone_of(block);
+	page_t *pg;
+	unsigned order;
+
+	bool ints = SetInts(false);
+	if ( !z || ((unsigned) block & (PAGE_SIZE - 1)) || (pg = &pages[INDEX(block)])->state != PAGE_USED )
+		Panic("mt_free_pages: bloque invalido %x", block);
+	order = pg->order;
+	pg->state = PAGE_NONE;
+	z->nfree += 1 << order;
+
+	// Unir con los compañeros libres
+	for ( ; order < MAX_ORDER ; order++ )
+	{
+		buddy = (char *) ((unsigned) block ^ (PAGE_SIZE << order));
+		if ( buddy < z->start || buddy >= z->end )
+			break;
+		pg = &pages[INDEX(buddy)];
+		if ( pg->state != PAGE_FREE || pg->order != order )
+			break;
+		remove_free(z, buddy, order);
+		block = min(block, buddy);
+	}
+	insert_free(z, block, order);
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_pages_order - orden del menor bloque que contiene size bytes
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_pages_order(unsigned size)
+{
+	unsigned order;
+
+	for ( order = 0 ; (PAGE_SIZE << order) < size && order <= MAX_ORDER ; order++ )
+		;
+	return order;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_pages_flags - flags con que se alocó el bloque que comienza en p, y su
+	orden en *order. Retorna cero si p no es el comienzo de un bloque alocado.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_pages_flags(void *p, unsigned *order)
+{
+	page_t *pg;
+
+	if ( (char *) p < mem_start || (char *) p >= mem_end || ((unsigned) p & (PAGE_SIZE - 1)) )
+		return 0;
+	pg = &pages[INDEX(p)];
+	if ( pg->state != PAGE_USED )
+		return 0;
+	*order = pg->order;
+	return pg->flags | PAGES_USED;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_pages_walk - recorre los bloques libres, sin orden
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_pages_walk(void (*func)(void *arg, char *addr, unsigned size), void *arg)
+{
+	zone_t *z;
+	free_block_t *b;
+	unsigned k;
+
+	for ( z = zones ; z < zones + 2 ; z++ )
+		for ( k = 0 ; k <= MAX_ORDER ; k++ )
+			for ( b = z->lists[k] ; b ; b = b->next )
+				func(arg, (char *) b, PAGE_SIZE << k);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_pages_info - páginas libres de una zona y límites de la memoria
+	administrada.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_pages_info(unsigned zone, char **start, char **end)
+{
+	if ( start )
+		*start = mem_start;
+	if ( end )
+		*end = mem_end;
+	return zones[zone].nfree;
+}
+
+/*
+--------------------------------------------------------------------------------
+AllocPages - aloca memoria físicamente contigua y alineada a su tamaño
+
+El tamaño se redondea a una potencia de 2 de páginas. Si dma es true la
+memoria está debajo de 16 MB. Retorna NULL si no hay memoria.
+--------------------------------------------------------------------------------
+*/
+
+void *
+AllocPages(unsigned size, bool dma)
+{
+	return mt_alloc_pages(mt_pages_order(size), dma ? PAGES_DMA : 0);
+}
+
+/*
+--------------------------------------------------------------------------------
+FreePages - libera memoria alocada con AllocPages()
+--------------------------------------------------------------------------------
+*/
+
+void
+FreePages(void *pages)
+{
+	mt_free_pages(pages);
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+add_range - agrega a una zona los mayores bloques alineados que caben en un
+	rango de memoria.
+--------------------------------------------------------------------------------
+*/
+
+static void
+add_range(zone_t *z, char *start, char *end)
+{
+	unsigned k;
+
+	while ( start < end )
+	{
+		for ( k = MAX_ORDER ; k ; k-- )
+			if ( !((unsigned) start & ((PAGE_SIZE << k) - 1)) && start + (PAGE_SIZE << k) <= end )
+				break;
+		insert_free(z, start, k);
+		z->nfree += 1 << k;
+		start += PAGE_SIZE << k;
+	}
+}
+
+/*
+--------------------------------------------------------------------------------
+insert_free, remove_free - manejo de las listas de bloques libres
+--------------------------------------------------------------------------------
+*/
+
+static void
+insert_free(zone_t *z, char *block, unsigned order)
+{
+	free_block_t *b = (free_block_t *) block;
+
+	pages[INDEX(block)] = (page_t) { PAGE_FREE, order, 0 };
+	b->prev = NULL;
+	if ( (b->next = z->lists[order]) )
+		b->next->prev = b;
+	z->lists[order] = b;
+}
+
+static void
+remove_free(zone_t *z, char *block, unsigned order)
+{
+	free_block_t *b = (free_block_t *) block;
+
+	pages[INDEX(block)].state = PAGE_NONE;
+	if ( b->next )
+		b->next->prev = b->prev;
+	if ( b->prev )
+		b->prev->next = b->next;
+	else
+		z->lists[order] = b->next;
+}
+
+/*
+--------------------------------------------------------------------------------
+zone_of - zona que contiene una dirección, o NULL
+--------------------------------------------------------------------------------
+*/
+
+static zone_t *
+zone_of(char *p)
+{
+	zone_t *z;
+
+	for ( z = zones ; z < zones + 2 ; z++ )
+		if ( p >= z->start && p < z->end )
+			return z;
+	return NULL;
+}
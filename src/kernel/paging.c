@@ -0,0 +1,339 @@
+#include <kernel.h>
+
+/*
+	Paginación.
+
+	La memoria física se mapea por identidad con páginas grandes de 4 MB
+	(PSE), de modo que el kernel, el heap y los programas de usuario siguen
+	usando las mismas direcciones que sin paginación y ocupan muy pocas
+	entradas de la TLB. Todas las páginas son accesibles desde ring 3, porque
+	los programas de usuario comparten el espacio de direcciones del kernel.
+
+	Los stacks de las tareas se alocan en una región virtual separada, por
+	encima de la memoria física, mapeada con páginas de 4 KB. Debajo de cada
+	stack hay una página de guarda que nunca se mapea, y las páginas del stack
+	se respaldan con memoria física recién cuando se tocan por primera vez
+	(demand-zero), salvo la del tope que se mapea al alocarlo. Una tarea que
+	nunca profundiza su stack ocupa una sola página física.
+
+	Los fallos de página entran por una compuerta de tarea (ver gdt_idt.c) y
+	se atienden en un TSS propio con su propio stack, porque el fallo puede
+	producirse al empujar datos en el stack de la tarea actual, incluyendo el
+	contexto que empuja el i386 al atender una interrupción. El contexto de
+	la tarea interrumpida queda guardado en mt_tss.
+
+	Un desborde detectado en la página de guarda termina la tarea. No se
+	detectan los desbordes que saltan la página de guarda entera, por ejemplo
+	un arreglo local de más de 4 KB que nunca se toca cerca de su comienzo.
+
+	Los marcos físicos para los stacks se toman del alocador de páginas (ver
+	pages.c), preferentemente fuera de la zona DMA.
+*/
+
+#define PG_PRESENT		0x001					// página presente
+#define PG_WRITE		0x002					// escritura permitida
+#define PG_USER			0x004					// accesible desde ring 3
+#define PG_LARGE		0x080					// página de 4 MB
+#define PG_FLAGS		(PG_PRESENT | PG_WRITE | PG_USER)
+
+#define PF_PROT			0x01					// el fallo fue de protección
+
+#define CPUID_PSE		0x08					// bit de PSE en edx
+
+#define ENTRIES			1024					// entradas por tabla
+#define STACK_BASE		0xC0000000				// comienzo de la región de stacks
+#define STACK_TABLES	16						// tablas de la región (64 MB)
+#define STACK_PAGES		(STACK_TABLES * ENTRIES)
+
+#define PAGE_INDEX(addr)	(((unsigned) (addr) - STACK_BASE) / PAGE_SIZE)
+#define PAGE_ADDR(i)		((char *) STACK_BASE + (i) * PAGE_SIZE)
+
+// Estado de las páginas de la región de stacks
+enum { PAGE_FREE, PAGE_GUARD, PAGE_STACK };
+
+static unsigned page_dir[ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static unsigned stack_pt[STACK_PAGES] __attribute__((aligned(PAGE_SIZE)));
+static unsigned char page_state[STACK_PAGES];
+static unsigned next_page;						// comienzo de la próxima búsqueda
+static unsigned mapped_end;						// fin de la memoria mapeada por identidad
+
+static int find_free(unsigned from, unsigned npages);
+static void map_page(unsigned i);
+static void kill_current(int status);
+
+/*
+--------------------------------------------------------------------------------
+mt_setup_paging - inicializa las tablas de páginas y habilita la paginación
+
+Recibe el fin de la memoria física y retorna el fin de la memoria mapeada,
+que puede ser menor si la memoria invade la región de stacks.
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_setup_paging(unsigned mem_end)
+{
+	unsigned regs[3], i;
+
+	mt_cpuid(1, regs);
+	if ( !(regs[2] & CPUID_PSE) )
+		Panic("El procesador no soporta paginas de 4 MB");
+
+	// Mapear por identidad la memoria física
+	if ( mem_end > STACK_BASE )
+		mem_end = STACK_BASE;
+	for ( i = 0 ; i * PAGE_SIZE_LARGE < mem_end ; i++ )
+		page_dir[i] = (i * PAGE_SIZE_LARGE) | PG_LARGE | PG_FLAGS;
+
+	// Tablas de la región de stacks, inicialmente vacías
+	for ( i = 0 ; i < STACK_TABLES ; i++ )
+		page_dir[STACK_BASE / PAGE_SIZE_LARGE + i] = (unsigned) &stack_pt[i * ENTRIES] | PG_FLAGS;
+
+	// El i386 carga CR3 del TSS al cambiar de tarea
+	mt_tss.cr3 = mt_pf_tss.cr3 = (unsigned) page_dir;
+	mt_enable_paging(page_dir);
+
+	return mapped_end = mem_end;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_alloc_stack - aloca un stack en la región de stacks
+
+Reserva las páginas necesarias para size bytes más una página de guarda
+debajo, y mapea solamente la página del tope. Retorna la dirección más baja
+del stack, que termina en la dirección retornada más size redondeado a
+páginas.
+--------------------------------------------------------------------------------
+*/
+
+void *
+mt_alloc_stack(unsigned size)
+{
+	unsigned npages = (size + PAGE_SIZE - 1) / PAGE_SIZE + 1;
+	unsigned i;
+	int start;
+
+	bool ints = SetInts(false);
+	if ( (start = find_free(next_page, npages)) < 0 && (start = find_free(0, npages)) < 0 )
+		Panic("mt_alloc_stack: no hay espacio para un stack de %u bytes", size);
+	page_state[start] = PAGE_GUARD;
+	for ( i = 1 ; i < npages ; i++ )
+		page_state[start + i] = PAGE_STACK;
+	next_page = start + npages;
+	map_page(start + npages - 1);
+	SetInts(ints);
+
+	return PAGE_ADDR(start + 1);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_free_stack - libera un stack alocado con mt_alloc_stack(), y la memoria
+	física de las páginas que se usaron.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_free_stack(void *stack)
+{
+	unsigned i;
+
+	if ( !stack )
+		return;
+
+	bool ints = SetInts(false);
+	i = PAGE_INDEX(stack);
+	page_state[i - 1] = PAGE_FREE;
+	for ( ; i < STACK_PAGES && page_state[i] == PAGE_STACK ; i++ )
+	{
+		page_state[i] = PAGE_FREE;
+		if ( !(stack_pt[i] & PG_PRESENT) )
+			continue;
+		mt_free_pages((void *) (stack_pt[i] & ~(PAGE_SIZE - 1)));
+		stack_pt[i] = 0;
+		mt_invlpg(PAGE_ADDR(i));
+	}
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_stack_pages - cantidad de páginas de un stack respaldadas con memoria física
+--------------------------------------------------------------------------------
+*/
+
+unsigned
+mt_stack_pages(void *stack)
+{
+	unsigned i, n = 0;
+
+	if ( !stack )
+		return 0;
+	for ( i = PAGE_INDEX(stack) ; i < STACK_PAGES && page_state[i] == PAGE_STACK ; i++ )
+		if ( stack_pt[i] & PG_PRESENT )
+			n++;
+	return n;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_user_range - verifica que un rango de direcciones recibido de ring 3 sea
+	accesible
+
+El rango debe estar en la memoria mapeada por identidad o en páginas de stack
+alocadas, que pueden no estar respaldadas todavía. Como los programas de
+usuario comparten el espacio de direcciones del kernel, esto no protege la
+memoria del kernel; sólo evita que un puntero inválido provoque un fallo de
+página en ring 0.
+--------------------------------------------------------------------------------
+*/
+
+bool
+mt_user_range(const void *p, unsigned size)
+{
+	unsigned addr = (unsigned) p, i;
+
+	if ( !size )
+		return true;
+	if ( addr + size < addr )
+		return false;
+	if ( addr + size <= mapped_end )
+		return true;
+	if ( addr < STACK_BASE )
+		return false;
+	for ( i = PAGE_INDEX(addr) ; i <= PAGE_INDEX(addr + size - 1) ; i++ )
+		if ( i >= STACK_PAGES || page_state[i] != PAGE_STACK )
+			return false;
+	return true;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_user_string - verifica que un string recibido de ring 3 sea accesible
+	hasta su terminador
+--------------------------------------------------------------------------------
+*/
+
+bool
+mt_user_string(const char *s)
+{
+	const char *end;
+
+	for ( ;; )
+	{
+		end = (const char *) (((unsigned) s | (PAGE_SIZE - 1)) + 1);
+		if ( !mt_user_range(s, end - s) )
+			return false;
+		for ( ; s < end ; s++ )
+			if ( !*s )
+				return true;
+	}
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_page_fault - manejador de fallos de página
+
+Se ejecuta en la tarea de fallos de página con interrupciones deshabilitadas,
+llamado desde mt_page_fault_entry en interrupts.S. Respalda las páginas de
+stack que se tocan por primera vez. Cualquier otro fallo termina la tarea
+actual, o detiene el sistema si se produce dentro de una interrupción o con
+interrupciones deshabilitadas en ring 0.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_page_fault(unsigned error)
+{
+	unsigned addr = mt_cr2(), i = PAGE_INDEX(addr);
+	bool guard = false;
+
+	if ( addr >= STACK_BASE && i < STACK_PAGES )
+	{
+		if ( page_state[i] == PAGE_STACK && !(error & PF_PROT) )
+		{
+			map_page(i);
+			return;
+		}
+		guard = page_state[i] == PAGE_GUARD;
+	}
+
+	if ( (mt_tss.cs & 3) != 3 && (!guard || mt_int_level || !(mt_tss.eflags & INTFL)) )
+	{
+		if ( guard )
+			Panic("Desborde de stack, eip %x", mt_tss.eip);
+		Panic("Fallo de pagina en %x, eip %x, error %u", addr, mt_tss.eip, error);
+	}
+
+	// Evitar que printk() cambie de contexto desde esta tarea
+	mt_int_level++;
+	if ( guard )
+		printk("Desborde de stack en %s, eip %x\n", GetName(mt_curr_task), mt_tss.eip);
+	else
+		printk("Fallo de pagina en %s, direccion %x, eip %x\n", GetName(mt_curr_task), addr, mt_tss.eip);
+	mt_int_level--;
+
+	kill_current(-1);
+}
+
+/* Funciones internas */
+
+/*
+--------------------------------------------------------------------------------
+find_free - busca npages páginas libres consecutivas a partir de from.
+	Retorna la primera, o -1 si no hay.
+--------------------------------------------------------------------------------
+*/
+
+static int
+find_free(unsigned from, unsigned npages)
+{
+	unsigned i, n;
+
+	for ( i = from, n = 0 ; i < STACK_PAGES ; i++ )
+		if ( page_state[i] != PAGE_FREE )
+			n = 0;
+		else if ( ++n == npages )
+			return i + 1 - npages;
+	return -1;
+}
+
+/*
+--------------------------------------------------------------------------------
+map_page - respalda una página de la región de stacks con un marco en cero
+--------------------------------------------------------------------------------
+*/
+
+static void
+map_page(unsigned i)
+{
+	void *frame;
+
+	if ( !(frame = mt_alloc_pages(0, 0)) )
+		Panic("No hay memoria para stacks");
+	memset(frame, 0, PAGE_SIZE);
+	stack_pt[i] = (unsigned) frame | PG_FLAGS;
+}
+
+/*
+--------------------------------------------------------------------------------
+kill_current - modifica el contexto de la tarea interrumpida por el fallo de
+	página para que ejecute Exit(status) en el tope de su stack de kernel.
+--------------------------------------------------------------------------------
+*/
+
+static void
+kill_current(int status)
+{
+	unsigned *sp = (unsigned *) mt_curr_task->stack_end - 2;
+
+	sp[0] = 0;									// dirección de retorno (no se usa)
+	sp[1] = status;								// argumento de Exit()
+	mt_curr_task->atomic_level = 0;
+	mt_tss.esp = (unsigned) sp;
+	mt_tss.ss = MT_DS;
+	mt_tss.eip = (unsigned) Exit;
+	mt_tss.cs = MT_CS;
+	mt_tss.eflags = INTFL;
+}
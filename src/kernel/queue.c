@@ -7,9 +7,9 @@ static TaskQueue_t time_q;
 mt_enqueue - pone una tarea a esperar en una cola de tareas
 
 La cola está ordenada por prioridad, y entre tareas de la misma prioridad por
-el tiempo que llevan esperando. La última tarea de una cola es la de mayor
-prioridad, y si hay más de una con la misma prioridad, la que lleva mayor tiempo
-esperando.
+boost (ver mt_prio_cmp()) y por el tiempo que llevan esperando. La última tarea
+de una cola es la de mayor prioridad, y si hay más de una con la misma
+prioridad, la que lleva mayor tiempo esperando.
 --------------------------------------------------------------------------------
 */
 
@@ -19,7 +19,7 @@ mt_enqueue(Task_t *task, TaskQueue_t *queue)
 	Task_t *ta;
 
 	/* Buscar donde insertar */
-	for ( ta = queue->head ; ta && task->priority > ta->priority ; ta = ta->next )
+	for ( ta = queue->head ; ta && mt_prio_cmp(task, ta) > 0 ; ta = ta->next )
 		;
 	if ( ta )		/* insertar antes de ta */
 	{
@@ -42,6 +42,7 @@ mt_enqueue(Task_t *task, TaskQueue_t *queue)
 		task->next = task->prev = NULL;
 	}
 	task->queue = queue;
+	queue->count++;
 }
 
 /*
@@ -67,6 +68,7 @@ mt_dequeue(Task_t *task)
 		queue->tail = task->prev;
 	task->next = task->prev = NULL;
 	task->queue = NULL;
+	queue->count--;
 }
 
 /*
@@ -98,6 +100,7 @@ mt_getlast(TaskQueue_t *queue)
 		queue->head = NULL;
 	task->prev = task->next = NULL;
 	task->queue = NULL;
+	queue->count--;
 	return task;
 }
 
@@ -105,48 +108,44 @@ mt_getlast(TaskQueue_t *queue)
 --------------------------------------------------------------------------------
 mt_enqueue_time - pone una tarea en la cola de tiempo.
 
-Las tareas estan ordenados por el tiempo de despertarse, en forma diferencial.
-El campo ticks de cada tarea se usa para almacenar los ticks de tiempo real 
-que transcurren entre el tiempo de despertarse de cada tarea y la 
-anterior en la cola. La primera tarea a despertar es la primera de la cola, y
-su campo de ticks en un momento determinado indica cuantos ticks le faltan para
-despertarse. La interrupcion de tiempo real decrementa el campo de ticks de la
-primera tarea de la cola. Si el campo llega a cero, despierta a esta tarea
-y a todas las que le sigan que tambien tengan el campo de ticks en cero.
+Las tareas estan ordenadas por el tick absoluto en que vencen, que se guarda en
+el campo expiry de cada tarea, y entre las que vencen en el mismo tick por orden
+de llegada. La primera tarea a despertar es la primera de la cola. La
+interrupcion de tiempo real despierta a las tareas del comienzo de la cola
+cuyo vencimiento ya llegó. La búsqueda comienza por el final, porque las esperas
+nuevas suelen vencer después de las que ya están en la cola.
 --------------------------------------------------------------------------------
 */
 
 void 
-mt_enqueue_time(Task_t *task, unsigned ticks)
+mt_enqueue_time(Task_t *task, Time_t expiry)
 {
 	Task_t *ta;
 
 	/* Buscar donde insertar */
-	for ( ta = time_q.head ; ta && ticks > ta->ticks ;
-			ticks -= ta->ticks, ta = ta->time_next )
+	for ( ta = time_q.tail ; ta && ta->expiry > expiry ; ta = ta->time_prev )
 		;
-	if ( ta )		/* insertar antes de ta */
+	if ( ta )		/* insertar después de ta */
 	{
-		if ( (task->time_prev = ta->time_prev) )
-			ta->time_prev->time_next = task;
+		if ( (task->time_next = ta->time_next) )
+			ta->time_next->time_prev = task;
 		else
-			time_q.head = task;
-		ta->time_prev = task;
-		task->time_next = ta;
-		ta->ticks -= ticks;
+			time_q.tail = task;
+		ta->time_next = task;
+		task->time_prev = ta;
 	}
-	else if ( (ta = time_q.tail) )	/* insertar al final de la cola */
+	else if ( (ta = time_q.head) )	/* insertar al principio de la cola */
 	{
-		ta->time_next = time_q.tail = task;
-		task->time_prev = ta;
-		task->time_next = NULL;
+		ta->time_prev = time_q.head = task;
+		task->time_next = ta;
+		task->time_prev = NULL;
 	}
 	else						/* la cola esta vacia */
 	{
 		time_q.head = time_q.tail = task;
 		task->time_next = task->time_prev = NULL;
 	}
-	task->ticks = ticks;
+	task->expiry = expiry;
 	task->in_time_q = true;
 }
 
@@ -166,10 +165,7 @@ mt_dequeue_time(Task_t *task)
 	else
 		time_q.head = task->time_next;
 	if ( task->time_next )
-	{
-		task->time_next->ticks += task->ticks;
 		task->time_next->time_prev = task->time_prev;
-	}
 	else
 		time_q.tail = task->time_prev;
 	task->time_next = task->time_prev = NULL;
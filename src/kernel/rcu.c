@@ -0,0 +1,159 @@
+#include <kernel.h>
+
+/*
+Lectura sin exclusión de estructuras que se leen mucho más de lo que se
+modifican, al estilo RCU (read-copy-update).
+
+Los lectores recorren la estructura entre RcuReadLock() y RcuReadUnlock(), sin
+Atomic() ni deshabilitar interrupciones, y pueden ser desalojados. Los
+escritores se excluyen entre ellos como siempre, publican los punteros con
+RcuAssign() y no liberan lo que sacan de la estructura: lo pasan a RcuDefer(),
+que llama a una función cuando terminó el período de gracia, es decir cuando
+salieron de su sección todos los lectores que podían estar viéndolo.
+
+Los lectores se cuentan en dos fases, en una sola palabra que actualizan con
+lock cmpxchg: cada lector suma uno a la cuenta de la fase actual al entrar y
+la resta al salir. El cambio de fase se hace con interrupciones deshabilitadas,
+que en un solo procesador alcanza para que no se mezcle con un lector.
+
+Las funciones diferidas se juntan en rcu_next; cuando la fase anterior está
+vacía se cambia de fase y pasan a rcu_wait, donde esperan que se vacíe la fase
+en la que estaban todos los lectores de ese momento. Las funciones se llaman
+desde mt_rcu_poll(), que llama la tarea nula y cada alocación de memoria (ver
+free_terminated()).
+*/
+
+#define PHASE			0x80000000				// fase actual
+#define ONE(p)			((p) ? 0x10000 : 1)		// un lector en la fase p
+#define COUNT(v, p)		(((p) ? (v) >> 16 : (v)) & 0x7FFF)
+
+static volatile unsigned rcu_state;				// fase y lectores por fase
+static RcuHead_t *rcu_next;						// esperan el próximo cambio de fase
+static RcuHead_t *rcu_wait;						// esperan que se vacíe la fase anterior
+
+/*
+--------------------------------------------------------------------------------
+RcuReadLock, RcuReadUnlock - entrar y salir de una sección de lectura
+
+Pueden anidarse, y llamarse desde manejadores de interrupciones. Dentro de la
+sección la tarea puede ser desalojada, pero no debe bloquearse por tiempo
+indefinido porque demora todas las liberaciones diferidas.
+--------------------------------------------------------------------------------
+*/
+
+void
+RcuReadLock(void)
+{
+	Task_t *task = mt_curr_task;
+	unsigned v, p;
+
+	if ( task->rcu_nesting++ )
+		return;
+	do
+		p = ((v = rcu_state) & PHASE) != 0;
+	while ( !mt_cmpxchg(&rcu_state, v, v + ONE(p)) );
+	task->rcu_phase = p;
+}
+
+void
+RcuReadUnlock(void)
+{
+	Task_t *task = mt_curr_task;
+	unsigned v, p = task->rcu_phase;
+
+	if ( !task->rcu_nesting )
+		Panic("RcuReadUnlock fuera de una seccion de lectura");
+	if ( --task->rcu_nesting )
+		return;
+
+	// Desde acá una interrupción puede entrar y salir de su propia sección
+	// en la fase actual y pisar rcu_phase; se resta en la fase leída antes.
+	do
+		v = rcu_state;
+	while ( !mt_cmpxchg(&rcu_state, v, v - ONE(p)) );
+}
+
+/*
+--------------------------------------------------------------------------------
+RcuDefer - difiere una llamada hasta el fin del período de gracia
+
+Llama a func(arg) cuando ningún lector que estuviera en una sección de lectura
+al llamar a RcuDefer() siga en ella. head es espacio para encolar la llamada,
+normalmente un campo del objeto que se va a liberar. Puede llamarse desde
+manejadores de interrupciones; func se llama siempre desde una tarea.
+--------------------------------------------------------------------------------
+*/
+
+void
+RcuDefer(RcuHead_t *head, RcuFunc_t func, void *arg)
+{
+	head->func = func;
+	head->arg = arg;
+
+	bool ints = SetInts(false);
+	head->next = rcu_next;
+	rcu_next = head;
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+RcuSynchronize - espera que termine un período de gracia
+
+No puede llamarse desde una sección de lectura.
+--------------------------------------------------------------------------------
+*/
+
+static void
+synchronized(void *arg)
+{
+	*(volatile bool *) arg = true;
+}
+
+void
+RcuSynchronize(void)
+{
+	volatile bool done = false;
+	RcuHead_t head;
+
+	if ( mt_curr_task->rcu_nesting )
+		Panic("RcuSynchronize en una seccion de lectura");
+	RcuDefer(&head, synchronized, (void *) &done);
+	while ( mt_rcu_poll(), !done )
+		Delay(1);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_rcu_poll - avanza los períodos de gracia y llama a las funciones diferidas
+	cuyo período terminó. Se llama desde una tarea.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_rcu_poll(void)
+{
+	RcuHead_t *head, *next;
+	unsigned old;
+
+	bool ints = SetInts(false);
+	old = !(rcu_state & PHASE);
+	if ( (head = rcu_wait) && !COUNT(rcu_state, old) )
+		rcu_wait = NULL;
+	else
+		head = NULL;
+	if ( !rcu_wait && rcu_next && !COUNT(rcu_state, old) )
+	{
+		// Cambiar de fase; los lectores actuales quedan en la anterior
+		rcu_wait = rcu_next;
+		rcu_next = NULL;
+		rcu_state ^= PHASE;
+	}
+	SetInts(ints);
+
+	for ( ; head ; head = next )
+	{
+		next = head->next;
+		head->func(head->arg);
+	}
+}
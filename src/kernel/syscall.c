@@ -0,0 +1,411 @@
+#include <kernel.h>
+#include <syscalls.h>
+
+#define MSR_SYSENTER_CS		0x174
+#define MSR_SYSENTER_ESP	0x175
+#define MSR_SYSENTER_EIP	0x176
+
+#define CPUID_SEP			0x800		/* sysenter/sysexit, bit 11 de edx */
+
+typedef Time_t (*syscall_t)(unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+static unsigned features;				/* capacidades informadas a los programas */
+
+static Time_t sys_features(void);
+static Task_t *sys_create_task(unsigned wrapper, TaskFunc_t func, unsigned stacksize,
+					void *arg, const char *name, unsigned priority);
+static void sys_put_string(const char *str);
+
+/*
+Tabla de system calls. Las funciones de la API se llaman directamente. La
+cadena args describe cada argumento que se copia del stack del llamador:
+'i' no se verifica, 'p' es un puntero a una palabra o a un objeto del kernel,
+'o' un puntero a una estructura de size bytes, 's' es un string, 'b' un buffer
+cuyo tamaño es el argumento siguiente, 'r' un buffer de recepción cuyo tamaño
+está en la palabra apuntada por el argumento siguiente y 'm' un mensaje cuyo
+tamaño retorna msg_size para el argumento anterior (una cola o un canal).
+Los punteros nulos se aceptan; la API los interpreta.
+
+Atomic() y Unatomic() no están en la tabla: un programa de usuario podría
+deshabilitar el cambio de contexto indefinidamente.
+*/
+
+typedef unsigned (*msg_size_t)(void *);
+
+static const struct
+{
+	void *			func;
+	const char *	args;
+	unsigned		size;			// tamaño de los argumentos 'o'
+	void *			msg_size;		// tamaño de los argumentos 'm'
+}
+systab[NUM_SYSCALLS] =
+{
+	[SYS_Features] =			{ sys_features,				"" },
+
+	[SYS_CreateTask] =			{ sys_create_task,			"iiiisi" },
+	[SYS_DeleteTask] =			{ DeleteTask,				"pi" },
+	[SYS_Protect] =				{ Protect,					"p" },
+	[SYS_Attach] =				{ Attach,					"p" },
+	[SYS_Detach] =				{ Detach,					"p" },
+	[SYS_SetPriority] =			{ SetPriority,				"pi" },
+	[SYS_SetConsole] =			{ SetConsole,				"pi" },
+	[SYS_GetInfo] =				{ GetInfo,					"po",		sizeof(TaskInfo_t) },
+	[SYS_GetTasks] =			{ GetTasks,					"p" },
+	[SYS_Ready] =				{ Ready,					"p" },
+	[SYS_Suspend] =				{ Suspend,					"p" },
+	[SYS_CurrentTask] =			{ CurrentTask,				"" },
+	[SYS_Pause] =				{ Pause,					"" },
+	[SYS_Yield] =				{ Yield,					"" },
+	[SYS_Delay] =				{ Delay,					"i" },
+	[SYS_UDelay] =				{ UDelay,					"i" },
+	[SYS_Join] =				{ Join,						"pp" },
+	[SYS_JoinCond] =			{ JoinCond,					"pp" },
+	[SYS_JoinTimed] =			{ JoinTimed,				"ppi" },
+	[SYS_Exit] =				{ Exit,						"i" },
+
+	[SYS_CreateQueue] =			{ CreateQueue,				"s" },
+	[SYS_DeleteQueue] =			{ DeleteQueue,				"p" },
+	[SYS_WaitQueue] =			{ WaitQueue,				"p" },
+	[SYS_WaitQueueTimed] =		{ WaitQueueTimed,			"pi" },
+	[SYS_SignalQueue] =			{ SignalQueue,				"p" },
+	[SYS_FlushQueue] =			{ FlushQueue,				"pi" },
+
+	[SYS_Send] =				{ Send,						"pbi" },
+	[SYS_SendCond] =			{ SendCond,					"pbi" },
+	[SYS_SendTimed] =			{ SendTimed,				"pbii" },
+	[SYS_Receive] =				{ Receive,					"prp" },
+	[SYS_ReceiveCond] =			{ ReceiveCond,				"prp" },
+	[SYS_ReceiveTimed] =		{ ReceiveTimed,				"prpi" },
+
+	[SYS_GetName] =				{ GetName,					"p" },
+	[SYS_Time] =				{ Time,						"" },
+	[SYS_Malloc] =				{ Malloc,					"i" },
+	[SYS_StrDup] =				{ StrDup,					"s" },
+	[SYS_Free] =				{ Free,						"p" },
+
+	[SYS_CreateSem] =			{ CreateSem,				"si" },
+	[SYS_DeleteSem] =			{ DeleteSem,				"p" },
+	[SYS_WaitSem] =				{ WaitSem,					"p" },
+	[SYS_WaitSemCond] =			{ WaitSemCond,				"p" },
+	[SYS_WaitSemTimed] =		{ WaitSemTimed,				"pi" },
+	[SYS_SignalSem] =			{ SignalSem,				"p" },
+	[SYS_ValueSem] =			{ ValueSem,					"p" },
+	[SYS_FlushSem] =			{ FlushSem,					"pi" },
+
+	[SYS_CreateMutex] =			{ CreateMutex,				"s" },
+	[SYS_DeleteMutex] =			{ DeleteMutex,				"p" },
+	[SYS_EnterMutex] =			{ EnterMutex,				"p" },
+	[SYS_EnterMutexCond] =		{ EnterMutexCond,			"p" },
+	[SYS_EnterMutexTimed] =		{ EnterMutexTimed,			"pi" },
+	[SYS_LeaveMutex] =			{ LeaveMutex,				"p" },
+
+	[SYS_CreateMonitor] =		{ CreateMonitor,			"s" },
+	[SYS_DeleteMonitor] =		{ DeleteMonitor,			"p" },
+	[SYS_EnterMonitor] =		{ EnterMonitor,				"p" },
+	[SYS_EnterMonitorCond] =	{ EnterMonitorCond,			"p" },
+	[SYS_EnterMonitorTimed] =	{ EnterMonitorTimed,		"pi" },
+	[SYS_LeaveMonitor] =		{ LeaveMonitor,				"p" },
+	[SYS_CreateCondition] =		{ CreateCondition,			"sp" },
+	[SYS_DeleteCondition] =		{ DeleteCondition,			"p" },
+	[SYS_WaitCondition] =		{ WaitCondition,			"p" },
+	[SYS_WaitConditionTimed] =	{ WaitConditionTimed,		"pi" },
+	[SYS_SignalCondition] =		{ SignalCondition,			"p" },
+	[SYS_BroadcastCondition] =	{ BroadcastCondition,		"p" },
+
+	[SYS_CreatePipe] =			{ CreatePipe,				"si" },
+	[SYS_DeletePipe] =			{ DeletePipe,				"p" },
+	[SYS_GetPipe] =				{ GetPipe,					"pbi" },
+	[SYS_GetPipeCond] =			{ GetPipeCond,				"pbi" },
+	[SYS_GetPipeTimed] =		{ GetPipeTimed,				"pbii" },
+	[SYS_PutPipe] =				{ PutPipe,					"pbi" },
+	[SYS_PutPipeCond] =			{ PutPipeCond,				"pbi" },
+	[SYS_PutPipeTimed] =		{ PutPipeTimed,				"pbii" },
+	[SYS_AvailPipe] =			{ AvailPipe,				"p" },
+
+	[SYS_CreateMsgQueue] =		{ CreateMsgQueue,			"sii" },
+	[SYS_DeleteMsgQueue] =		{ DeleteMsgQueue,			"p" },
+	[SYS_GetMsgQueue] =			{ GetMsgQueue,				"pm",		0,	mt_msgqueue_size },
+	[SYS_GetMsgQueueCond] =		{ GetMsgQueueCond,			"pm",		0,	mt_msgqueue_size },
+	[SYS_GetMsgQueueTimed] =	{ GetMsgQueueTimed,			"pmi",		0,	mt_msgqueue_size },
+	[SYS_PutMsgQueue] =			{ PutMsgQueue,				"pm",		0,	mt_msgqueue_size },
+	[SYS_PutMsgQueueCond] =		{ PutMsgQueueCond,			"pm",		0,	mt_msgqueue_size },
+	[SYS_PutMsgQueueTimed] =	{ PutMsgQueueTimed,			"pmi",		0,	mt_msgqueue_size },
+	[SYS_AvailMsgQueue] =		{ AvailMsgQueue,			"p" },
+
+	[SYS_PutString] =			{ sys_put_string,			"s" },
+	[SYS_GetChar] =				{ getch,					"" },
+	[SYS_GetCharCond] =			{ getch_cond,				"" },
+	[SYS_GetCharTimed] =		{ getch_timed,				"i" },
+
+	[SYS_CreateArena] =			{ CreateArena,				"sip" },
+	[SYS_DeleteArena] =			{ DeleteArena,				"p" },
+	[SYS_ArenaAlloc] =			{ ArenaAlloc,				"pi" },
+	[SYS_ArenaMark] =			{ ArenaMark,				"p" },
+	[SYS_ArenaRelease] =		{ ArenaRelease,				"pi" },
+
+	[SYS_SetMemLimit] =			{ SetMemLimit,				"pi" },
+	[SYS_SetMemReclaim] =		{ SetMemReclaim,			"pi" },
+
+	[SYS_SetMaxBoost] =			{ SetMaxBoost,				"pi" },
+	[SYS_GetSchedParams] =		{ GetSchedParams,			"o",		sizeof(SchedParams_t) },
+	[SYS_SetSchedParams] =		{ SetSchedParams,			"o",		sizeof(SchedParams_t) },
+
+	[SYS_DelayUntil] =			{ DelayUntil,				"ii" },
+	[SYS_SetPeriod] =			{ SetPeriod,				"i" },
+	[SYS_WaitNextPeriod] =		{ WaitNextPeriod,			"" },
+
+	[SYS_GetTaskId] =			{ GetTaskId,				"p" },
+	[SYS_GetTask] =				{ GetTask,					"i" },
+	[SYS_DeleteTaskId] =		{ DeleteTaskId,				"ii" },
+	[SYS_AttachId] =			{ AttachId,					"i" },
+	[SYS_DetachId] =			{ DetachId,					"i" },
+	[SYS_SetPriorityId] =		{ SetPriorityId,			"ii" },
+	[SYS_GetInfoId] =			{ GetInfoId,				"io",		sizeof(TaskInfo_t) },
+	[SYS_ReadyId] =				{ ReadyId,					"i" },
+	[SYS_SuspendId] =			{ SuspendId,				"i" },
+	[SYS_JoinId] =				{ JoinId,					"ip" },
+	[SYS_JoinTimedId] =			{ JoinTimedId,				"ipi" },
+	[SYS_SendId] =				{ SendId,					"ibi" },
+	[SYS_SendTimedId] =			{ SendTimedId,				"ibii" },
+	[SYS_SetMailbox] =			{ SetMailbox,				"iii" },
+	[SYS_PostMessage] =			{ PostMessage,				"pbi" },
+	[SYS_PostMessageTimed] =	{ PostMessageTimed,			"pbii" },
+	[SYS_Call] =				{ Call,						"pbirp" },
+	[SYS_ReplyWait] =			{ ReplyWait,				"pbiprp" },
+	[SYS_CreateFlags] =			{ CreateFlags,				"si" },
+	[SYS_DeleteFlags] =			{ DeleteFlags,				"p" },
+	[SYS_SetFlags] =			{ SetFlags,					"pi" },
+	[SYS_ClearFlags] =			{ ClearFlags,				"pi" },
+	[SYS_GetFlags] =			{ GetFlags,					"p" },
+	[SYS_WaitFlags] =			{ WaitFlags,				"piii" },
+	[SYS_WaitFlagsCond] =		{ WaitFlagsCond,			"piii" },
+	[SYS_WaitFlagsTimed] =		{ WaitFlagsTimed,			"piiii" },
+	[SYS_CreateMsgQueueV] =		{ CreateMsgQueueV,			"si" },
+	[SYS_DeleteMsgQueueV] =		{ DeleteMsgQueueV,			"p" },
+	[SYS_GetMsgV] =				{ GetMsgV,					"pbi" },
+	[SYS_GetMsgVCond] =			{ GetMsgVCond,				"pbi" },
+	[SYS_GetMsgVTimed] =		{ GetMsgVTimed,				"pbii" },
+	[SYS_PutMsgV] =				{ PutMsgV,					"pbi" },
+	[SYS_PutMsgVCond] =			{ PutMsgVCond,				"pbi" },
+	[SYS_PutMsgVTimed] =		{ PutMsgVTimed,				"pbii" },
+	[SYS_PeekMsgV] =			{ PeekMsgV,					"p" },
+	[SYS_AvailMsgV] =			{ AvailMsgV,				"p" },
+	[SYS_CreateChunkedPipe] =	{ CreateChunkedPipe,		"si" },
+	[SYS_SplicePipe] =			{ SplicePipe,				"ppi" },
+	[SYS_CreateChannel] =		{ CreateChannel,			"siii" },
+	[SYS_DeleteChannel] =		{ DeleteChannel,			"p" },
+	[SYS_Subscribe] =			{ Subscribe,				"p" },
+	[SYS_Unsubscribe] =			{ Unsubscribe,				"p" },
+	[SYS_Publish] =				{ Publish,					"pm",		0,	mt_channel_size },
+	[SYS_PublishCond] =			{ PublishCond,				"pm",		0,	mt_channel_size },
+	[SYS_PublishTimed] =		{ PublishTimed,				"pmi",		0,	mt_channel_size },
+	[SYS_GetChannel] =			{ GetChannel,				"pm",		0,	mt_subscriber_size },
+	[SYS_GetChannelCond] =		{ GetChannelCond,			"pm",		0,	mt_subscriber_size },
+	[SYS_GetChannelTimed] =		{ GetChannelTimed,			"pmi",		0,	mt_subscriber_size },
+	[SYS_GetChannelLag] =		{ GetChannelLag,			"p" },
+	[SYS_CreateTLSKey] =		{ CreateTLSKey,				"" },
+	[SYS_DeleteTLSKey] =		{ DeleteTLSKey,				"i" },
+	[SYS_GetTLS] =				{ GetTLS,					"i" },
+	[SYS_SetTLS] =				{ SetTLS,					"ii" },
+};
+
+/*
+--------------------------------------------------------------------------------
+mt_setup_syscalls - inicializa el mecanismo de system calls
+
+La interrupción SYSCALL_INT está siempre disponible (ver gdt_idt.c). Si el
+procesador soporta sysenter, se programan los MSR correspondientes.
+SYSENTER_ESP apunta a mt_tss.esp0, de donde mt_sysenter_entry obtiene el
+stack de kernel de la tarea actual.
+--------------------------------------------------------------------------------
+*/
+
+void
+mt_setup_syscalls(void)
+{
+	unsigned regs[3], signature;
+
+	signature = mt_cpuid(1, regs);
+
+	// Los Pentium Pro anteriores al modelo 3 stepping 3 informan SEP sin soportarlo
+	if ( !(regs[2] & CPUID_SEP) || (signature & 0xFFF) < 0x633 )
+		return;
+
+	mt_wrmsr(MSR_SYSENTER_CS, MT_CS, 0);
+	mt_wrmsr(MSR_SYSENTER_ESP, (unsigned) &mt_tss.esp0, 0);
+	mt_wrmsr(MSR_SYSENTER_EIP, (unsigned) mt_sysenter_entry, 0);
+	features |= SYSFEAT_SYSENTER;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_syscall - despacha una system call
+
+Llamada desde sysentry.S con interrupciones habilitadas. Copia los argumentos
+del stack del llamador y llama a la función correspondiente. Las funciones
+que retornan 32 bits dejan basura en edx, que el llamador ignora.
+El bloque de argumentos y los punteros que contiene se verifican antes de
+usarlos, para que un fallo de página no ocurra en ring 0. Una system call
+inexistente o con argumentos inválidos termina la tarea.
+--------------------------------------------------------------------------------
+*/
+
+static bool
+valid_arg(unsigned num, char type, unsigned prev, unsigned arg, unsigned next)
+{
+	if ( !arg )
+		return true;
+	switch ( type )
+	{
+		case 'p':
+			return mt_user_range((void *) arg, sizeof(unsigned));
+		case 'o':
+			return mt_user_range((void *) arg, systab[num].size);
+		case 's':
+			return mt_user_string((char *) arg);
+		case 'b':
+			return mt_user_range((void *) arg, next);
+		case 'r':
+			return !next || (mt_user_range((void *) next, sizeof(unsigned)) &&
+				mt_user_range((void *) arg, *(unsigned *) next));
+		case 'm':
+			return !prev || mt_user_range((void *) arg, ((msg_size_t) systab[num].msg_size)((void *) prev));
+		default:
+			return true;
+	}
+}
+
+Time_t
+mt_syscall(unsigned num, unsigned *args)
+{
+	unsigned a[MAX_SYSARGS + 1], nargs, i;
+	const char *types;
+
+	if ( num >= NUM_SYSCALLS || !systab[num].func )
+	{
+		printk("System call %u inexistente\n", num);
+		Exit(-1);
+	}
+
+	types = systab[num].args;
+	nargs = strlen(types);
+	if ( !mt_user_range(args, nargs * sizeof(unsigned)) )
+	{
+		printk("System call %u: argumentos inaccesibles\n", num);
+		Exit(-1);
+	}
+
+	memset(a, 0, sizeof a);
+	memcpy(a, args, nargs * sizeof(unsigned));
+	for ( i = 0 ; i < nargs ; i++ )
+		if ( !valid_arg(num, types[i], i ? a[i - 1] : 0, a[i], a[i + 1]) )
+		{
+			printk("System call %u: argumento %u inválido\n", num, i + 1);
+			Exit(-1);
+		}
+
+	return ((syscall_t) systab[num].func)(a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_create_user_task - crea una tarea que ejecuta en ring 3
+
+La tarea tiene un stack de kernel, usado por las interrupciones y system calls,
+y un stack de usuario. El stack de kernel se inicializa simulando que la tarea
+fue interrumpida en ring 3 antes de ejecutar su primera instrucción en entry.
+El stack de usuario se completa con mt_user_push() antes de ponerla en ready.
+Está inicialmente suspendida, como las creadas por CreateTask(), y retorna
+NULL en los mismos casos.
+--------------------------------------------------------------------------------
+*/
+
+Task_t *
+mt_create_user_task(mt_image_t *image, unsigned entry, unsigned stacksize, const char *name, unsigned priority)
+{
+	Task_t *task;
+	mt_user_regs_t *s;
+
+	if ( !(task = CreateTask(NULL, KERN_STKSIZE, NULL, name, priority)) )
+		return NULL;
+
+	if ( stacksize < MIN_STACK )				// garantizar tamaño mínimo
+		stacksize = MIN_STACK;
+	stacksize = (stacksize + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	task->ustack = mt_alloc_stack(stacksize);
+
+	Atomic();
+	image->refs++;
+	task->image = image;
+	Unatomic();
+
+	s = (mt_user_regs_t *) task->stack_end - 1;
+	memset(s, 0, sizeof *s);
+	s->regs.eip = entry;
+	s->regs.cs = MT_UCS;
+	s->regs.eflags = INTFL;
+	s->esp = (unsigned) (task->ustack + stacksize);
+	s->ss = MT_UDS;
+	task->esp = &s->regs;
+
+	return task;
+}
+
+/*
+--------------------------------------------------------------------------------
+mt_user_push - empuja datos en el stack de usuario de una tarea que todavía
+	no comenzó a ejecutar. Retorna la dirección de los datos en el stack.
+--------------------------------------------------------------------------------
+*/
+
+void *
+mt_user_push(Task_t *task, const void *data, unsigned size)
+{
+	mt_user_regs_t *s = (mt_user_regs_t *) task->esp;
+
+	s->esp -= (size + 3) & ~3;
+	if ( s->esp < (unsigned) task->ustack + sizeof(unsigned) )
+		Panic("mt_user_push: stack de usuario insuficiente en %s", GetName(task));
+	memcpy((void *) s->esp, data, size);
+	return (void *) s->esp;
+}
+
+/* System calls propias */
+
+static Time_t
+sys_features(void)
+{
+	return features;
+}
+
+/*
+Los programas de usuario pasan la dirección de un wrapper propio que
+llama a func(arg) y después a Exit(), como wrapper() en kernel.c.
+*/
+
+static Task_t *
+sys_create_task(unsigned wrapper, TaskFunc_t func, unsigned stacksize,
+	void *arg, const char *name, unsigned priority)
+{
+	Task_t *task;
+	unsigned frame[3];
+
+	if ( !mt_curr_task->image )					// solamente desde ring 3
+		return NULL;
+
+	if ( !(task = mt_create_user_task(mt_curr_task->image, wrapper, stacksize, name, priority)) )
+		return NULL;
+	frame[0] = 0;								// dirección de retorno (no se usa)
+	frame[1] = (unsigned) func;					// primer argumento del wrapper
+	frame[2] = (unsigned) arg;					// segundo argumento del wrapper
+	mt_user_push(task, frame, sizeof frame);
+
+	return task;
+}
+
+static void
+sys_put_string(const char *str)
+{
+	printk("%s", str);
+}
@@ -0,0 +1,84 @@
+#include <kernel.h>
+
+/*
+Datos locales de las tareas indexados por clave, además del puntero TLS.
+
+Cada tarea tiene un arreglo de MAX_TLS_KEYS punteros en su bloque de control.
+En el cambio de contexto mt_set_tls() apunta a ese arreglo la base del
+segmento MT_TLS y recarga GS, de modo que el costo del cambio no depende de la
+cantidad de claves, y GetTLS() y SetTLS() son un solo acceso relativo a GS.
+
+Las claves se asignan con un mapa de bits. Al crear una clave se borra el valor
+que hubiera dejado en las tareas existentes una clave anterior con el mismo
+número; las tareas nuevas empiezan con todas las claves en NULL.
+*/
+
+static unsigned tls_keys;						// claves asignadas
+
+/*
+--------------------------------------------------------------------------------
+CreateTLSKey, DeleteTLSKey - asignación y liberación de claves de TLS.
+
+La clave vale NULL en todas las tareas. Si no quedan claves libres es un error
+fatal.
+--------------------------------------------------------------------------------
+*/
+
+TLSKey_t
+CreateTLSKey(void)
+{
+	TLSKey_t key;
+
+	bool ints = SetInts(false);
+	for ( key = 0 ; key < MAX_TLS_KEYS && (tls_keys & (1U << key)) ; key++ )
+		;
+	if ( key == MAX_TLS_KEYS )
+		Panic("CreateTLSKey: no hay claves libres");
+	tls_keys |= 1U << key;
+	SetInts(ints);
+
+	mt_tls_clear(key);
+	return key;
+}
+
+void
+DeleteTLSKey(TLSKey_t key)
+{
+	if ( key >= MAX_TLS_KEYS )
+		return;
+
+	bool ints = SetInts(false);
+	tls_keys &= ~(1U << key);
+	SetInts(ints);
+}
+
+/*
+--------------------------------------------------------------------------------
+GetTLS, SetTLS - leen y escriben el valor de una clave en la tarea actual.
+
+GetTLS retorna NULL si la clave es inválida. Desde ring 3 se accede por system
+call, porque los bloques de control están en memoria del kernel. GS siempre
+tiene MT_TLS dentro del kernel: es un segmento de ring 0, que ring 3 no puede
+cargar, y la entrada al kernel recarga GS (ver mt_kernel_segs() en
+interrupts.S).
+--------------------------------------------------------------------------------
+*/
+
+void *
+GetTLS(TLSKey_t key)
+{
+	void *value;
+
+	if ( key >= MAX_TLS_KEYS )
+		return NULL;
+	__asm__ __volatile__("movl %%gs:(,%1,4), %0" : "=r" (value) : "r" (key));
+	return value;
+}
+
+void
+SetTLS(TLSKey_t key, void *value)
+{
+	if ( key >= MAX_TLS_KEYS )
+		return;
+	__asm__ __volatile__("movl %1, %%gs:(,%0,4)" :: "r" (key), "r" (value) : "memory");
+}
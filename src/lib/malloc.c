@@ -1,4 +1,7 @@
 // Adaptado del libro "El lenguaje de programación C" de Kernighan y Ritchie
+// Alocador first fit, ver makefile (ALLOCATOR)
+
+#ifdef ALLOCATOR_kr
 
 #include <kernel.h>
 
@@ -14,59 +17,35 @@ union header
 	double align;						/* forzar alineacion a 8 bytes */
 };
 
-static Header *freep;
-static Header base;
+static Header base = { { &base, 0 } };	// bloque centinela de tamaño 0, nunca se aloca
+static Header *freep = &base;
+
+static void insert(Header *bp);
 
-// Inicialización del heap. Recibe como argumento el tamaño en bytes de la 
-// memoria superior (por encima de 1MB).
-void 
-mt_setup_heap(unsigned himem_size)
+// Agregar una región de memoria al heap, tomada del alocador de páginas.
+// Las regiones no se devuelven.
+void
+mt_heap_add(void *start, unsigned size)
 {
-	extern char _end;					// fin del segmento de datos, ver mtask.map
-	unsigned heapaddr, heapsize;
-
-	// Determinar dirección y tamaño del heap
-	heapaddr = ((unsigned) &_end + sizeof(Header) - 1) / sizeof(Header);
-	heapaddr *= sizeof(Header);
-	heapsize = himem_size - (heapaddr - 0x100000);
-
-	// Inicializar lista de bloques libres
-	base.ptr = freep = &base;			// bloque centinela de tamaño 0, nunca se aloca
-	Header *ap = (Header *) heapaddr;	// bloque libre inicial, contiene todo el heap
-	ap->size = heapsize / sizeof(Header);
-	free(ap + 1);
+	Header *up = start;
+
+	up->size = size / sizeof(Header);
+	insert(up);
 }
 
 // Liberar un bloque de memoria
 void
-free(void *ap)
+mt_block_free(void *ap)
 {
-	Header *bp, *p;
+	Header *bp = (Header *) ap - 1;		/* point to block header */
 
-	bp = (Header *) ap - 1;				/* point to block header */
-	for ( p = freep; !(bp > p && bp < p->ptr); p = p->ptr )
-		if ( p >= p->ptr && (bp > p || bp < p->ptr) )
-			break;						/* freed block at start or end of arena */
-	if ( bp + bp->size == p->ptr ) 		/* join to upper nbr */
-	{
-		bp->size += p->ptr->size;
-		bp->ptr = p->ptr->ptr;
-	}
-	else
-		bp->ptr = p->ptr;
-	if ( p + p->size == bp ) 			/* join to lower nbr */
-	{
-		p->size += bp->size;
-		p->ptr = bp->ptr;
-	}
-	else
-		p->ptr = bp;
-	freep = p;
+	mt_heap_free(bp->size * sizeof(Header));
+	insert(bp);
 }
 
 // Alocar un bloque de memoria
 void *
-malloc(unsigned nbytes)
+mt_block_alloc(unsigned nbytes)
 {
 	Header *p, *prevp;
 	unsigned nunits = (nbytes + sizeof(Header) - 1) / sizeof(Header) + 1;
@@ -84,9 +63,50 @@ malloc(unsigned nbytes)
 				p->size = nunits;
 			}
 			freep = prevp;
+			mt_heap_alloc(nbytes, nunits * sizeof(Header));
 			return p + 1;
 		}
 		if ( p == freep )				/* wrapped around free list */
 			return 0;					/* none left */
 	}
 }
+
+// Recorrer los bloques libres en orden de direcciones
+void
+mt_heap_walk(void (*func)(void *arg, char *addr, unsigned size), void *arg)
+{
+	Header *p;
+
+	for ( p = base.ptr ; p != &base ; p = p->ptr )
+		func(arg, (char *) p, p->size * sizeof(Header));
+}
+
+/* Funciones internas */
+
+// Agregar un bloque a la lista de bloques libres
+static void
+insert(Header *bp)
+{
+	Header *p;
+
+	for ( p = freep; !(bp > p && bp < p->ptr); p = p->ptr )
+		if ( p >= p->ptr && (bp > p || bp < p->ptr) )
+			break;						/* freed block at start or end of arena */
+	if ( bp + bp->size == p->ptr ) 		/* join to upper nbr */
+	{
+		bp->size += p->ptr->size;
+		bp->ptr = p->ptr->ptr;
+	}
+	else
+		bp->ptr = p->ptr;
+	if ( p + p->size == bp ) 			/* join to lower nbr */
+	{
+		p->size += bp->size;
+		p->ptr = bp->ptr;
+	}
+	else
+		p->ptr = bp;
+	freep = p;
+}
+
+#endif
@@ -0,0 +1,297 @@
+// Alocador por clases de tamaño (segregated fit), ver makefile (ALLOCATOR)
+
+#ifdef ALLOCATOR_segfit
+
+#include <kernel.h>
+
+/*
+	Los bloques libres se guardan en listas segregadas por tamaño, con el
+	esquema de dos niveles de TLSF (Two-Level Segregated Fit):
+
+	- Los bloques de menos de SMALL_SIZE bytes tienen una lista por cada
+	  tamaño múltiplo de ALIGN (nivel 0), de modo que los pedidos chicos
+	  se satisfacen con un bloque de tamaño exacto.
+	- Los mayores se dividen por potencias de 2 (primer nivel) y cada
+	  potencia en SL_COUNT rangos iguales (segundo nivel).
+
+	Un mapa de bits por nivel indica qué listas tienen bloques, de modo que
+	encontrar una lista adecuada cuesta un par de instrucciones bsf, sin
+	recorrer nada. Malloc busca en la primera lista cuyos bloques seguro
+	alcanzan (good fit), y si sobra lo suficiente divide el bloque.
+
+	Cada bloque tiene una cabecera con su tamaño y un tamaño del bloque
+	físico anterior que solamente es válido cuando ese bloque está libre
+	(boundary tag). Así la liberación une el bloque con sus vecinos libres en
+	tiempo constante.
+
+	El heap se compone de regiones que se piden al alocador de páginas a
+	medida que hacen falta (ver heap.c). Al final de cada región hay un
+	bloque de tamaño cero siempre ocupado que sirve de centinela. Una región
+	que queda completamente libre se devuelve al alocador de páginas, salvo
+	que sea la única memoria libre que le queda al heap.
+*/
+
+#define ALIGN			8						// alineación de los bloques
+#define SL_LOG2			5						// log2 de rangos por potencia de 2
+#define SL_COUNT		(1 << SL_LOG2)
+#define FL_SHIFT		(SL_LOG2 + 3)			// log2(ALIGN) == 3
+#define SMALL_SIZE		(1 << FL_SHIFT)			// límite de los bloques chicos
+#define FL_COUNT		(32 - FL_SHIFT + 1)
+
+#define BLOCK_FREE		0x1						// el bloque está libre
+#define PREV_FREE		0x2						// el bloque anterior está libre
+#define FIRST_BLOCK		0x4						// primer bloque de una región
+#define FLAGS			(BLOCK_FREE | PREV_FREE | FIRST_BLOCK)
+
+#define KEEP_FREE		0x10000					// memoria libre que se conserva
+
+typedef struct block block_t;
+
+struct block
+{
+	unsigned		prev_size;					// tamaño del anterior si está libre
+	unsigned		size;						// tamaño incluyendo cabecera y flags
+	block_t *		next_free;					// solamente en bloques libres
+	block_t *		prev_free;					// .
+};
+
+#define HEADER			(2 * sizeof(unsigned))	// prev_size y size
+#define MIN_BLOCK		sizeof(block_t)
+
+#define SIZE(b)			((b)->size & ~FLAGS)
+#define NEXT(b)			((block_t *) ((char *) (b) + SIZE(b)))
+#define PREV(b)			((block_t *) ((char *) (b) - (b)->prev_size))
+#define PAYLOAD(b)		((void *) ((char *) (b) + HEADER))
+#define BLOCK(p)		((block_t *) ((char *) (p) - HEADER))
+
+typedef struct region region_t;
+
+// Cabecera de una región del heap
+struct region
+{
+	region_t *		next;
+	region_t *		prev;
+	unsigned		size;
+	unsigned		pad;						// alineación del primer bloque
+};
+
+static region_t *regions;						// regiones del heap
+static unsigned heap_free;						// bytes en bloques libres
+static unsigned fl_map;							// listas de primer nivel no vacías
+static unsigned sl_map[FL_COUNT];				// listas de segundo nivel no vacías
+static block_t *lists[FL_COUNT][SL_COUNT];		// listas de bloques libres
+
+static void mapping(unsigned size, unsigned *fl, unsigned *sl);
+static block_t *find_block(unsigned size);
+static void insert_block(block_t *b);
+static void remove_block(block_t *b);
+static void release_region(region_t *r);
+
+// Agregar una región de memoria al heap, tomada del alocador de páginas
+void
+mt_heap_add(void *start, unsigned size)
+{
+	region_t *r = start;
+	block_t *b = (block_t *) (r + 1);
+
+	// Un bloque libre con toda la región, seguido del centinela
+	b->size = (size - sizeof(region_t) - HEADER) | BLOCK_FREE | FIRST_BLOCK;
+	NEXT(b)->size = PREV_FREE;
+	NEXT(b)->prev_size = SIZE(b);
+	insert_block(b);
+	heap_free += SIZE(b);
+
+	r->size = size;
+	r->prev = NULL;
+	if ( (r->next = regions) )
+		r->next->prev = r;
+	regions = r;
+}
+
+// Liberar un bloque de memoria
+void
+mt_block_free(void *ap)
+{
+	block_t *b, *next;
+
+	if ( !ap )
+		return;
+
+	b = BLOCK(ap);
+	b->size |= BLOCK_FREE;
+	heap_free += SIZE(b);
+	mt_heap_free(SIZE(b));
+
+	// Unir con el anterior
+	if ( b->size & PREV_FREE )
+	{
+		block_t *prev = PREV(b);
+		remove_block(prev);
+		prev->size += SIZE(b);
+		b = prev;
+	}
+
+	// Unir con el siguiente
+	next = NEXT(b);
+	if ( next->size & BLOCK_FREE )
+	{
+		remove_block(next);
+		b->size += SIZE(next);
+		next = NEXT(b);
+	}
+
+	// Devolver la región si quedó vacía y sobra memoria en el resto
+	if ( (b->size & FIRST_BLOCK) && !SIZE(next) && heap_free - SIZE(b) >= KEEP_FREE )
+	{
+		heap_free -= SIZE(b);
+		release_region((region_t *) b - 1);
+		return;
+	}
+
+	insert_block(b);
+	next->prev_size = SIZE(b);
+	next->size |= PREV_FREE;
+}
+
+// Alocar un bloque de memoria
+void *
+mt_block_alloc(unsigned nbytes)
+{
+	unsigned size = (nbytes + HEADER + ALIGN - 1) & ~(ALIGN - 1);
+	block_t *b, *rest;
+
+	if ( size < MIN_BLOCK )
+		size = MIN_BLOCK;
+	if ( size < nbytes || !(b = find_block(size)) )
+		return 0;						/* none left */
+	remove_block(b);
+
+	// Devolver el sobrante si alcanza para otro bloque
+	if ( SIZE(b) - size >= MIN_BLOCK )
+	{
+		rest = (block_t *) ((char *) b + size);
+		rest->size = (SIZE(b) - size) | BLOCK_FREE;
+		b->size = size | (b->size & (PREV_FREE | FIRST_BLOCK));
+		insert_block(rest);
+		NEXT(rest)->prev_size = SIZE(rest);
+	}
+	else
+	{
+		b->size &= ~BLOCK_FREE;
+		NEXT(b)->size &= ~PREV_FREE;
+	}
+
+	heap_free -= SIZE(b);
+	mt_heap_alloc(nbytes, SIZE(b));
+	return PAYLOAD(b);
+}
+
+// Recorrer los bloques libres en orden de direcciones
+void
+mt_heap_walk(void (*func)(void *arg, char *addr, unsigned size), void *arg)
+{
+	region_t *r;
+	block_t *b;
+
+	for ( r = regions ; r ; r = r->next )
+		for ( b = (block_t *) (r + 1) ; SIZE(b) ; b = NEXT(b) )
+			if ( b->size & BLOCK_FREE )
+				func(arg, (char *) b, SIZE(b));
+}
+
+/* Funciones internas */
+
+// Lista que corresponde a un tamaño
+static void
+mapping(unsigned size, unsigned *fl, unsigned *sl)
+{
+	unsigned msb;
+
+	if ( size < SMALL_SIZE )
+	{
+		*fl = 0;
+		*sl = size / ALIGN;
+		return;
+	}
+	msb = 31 - __builtin_clz(size);
+	*fl = msb - FL_SHIFT + 1;
+	*sl = (size >> (msb - SL_LOG2)) ^ SL_COUNT;
+}
+
+// Buscar un bloque libre de al menos size bytes, sin sacarlo de su lista
+static block_t *
+find_block(unsigned size)
+{
+	unsigned fl, sl, map;
+	block_t *b;
+
+	// Redondear hacia arriba al comienzo del rango siguiente, para que
+	// cualquier bloque de la lista encontrada alcance
+	if ( size >= SMALL_SIZE )
+	{
+		unsigned round = (1 << (31 - __builtin_clz(size) - SL_LOG2)) - 1;
+		mapping(size + round < size ? ~0U : size + round, &fl, &sl);
+	}
+	else
+		mapping(size, &fl, &sl);
+
+	// Primero en el mismo rango de primer nivel, si no en el siguiente
+	// rango de primer nivel que tenga bloques
+	if ( fl < FL_COUNT && !(map = sl_map[fl] & (~0U << sl)) && fl + 1 < FL_COUNT )
+		if ( (map = fl_map & (~0U << (fl + 1))) )
+			map = sl_map[fl = __builtin_ctz(map)];
+	if ( fl < FL_COUNT && map )
+		return lists[fl][__builtin_ctz(map)];
+
+	// Último recurso: algún bloque suficiente en la lista del tamaño pedido
+	mapping(size, &fl, &sl);
+	for ( b = lists[fl][sl] ; b ; b = b->next_free )
+		if ( SIZE(b) >= size )
+			return b;
+	return NULL;
+}
+
+// Agregar un bloque libre a su lista
+static void
+insert_block(block_t *b)
+{
+	unsigned fl, sl;
+
+	mapping(SIZE(b), &fl, &sl);
+	b->prev_free = NULL;
+	if ( (b->next_free = lists[fl][sl]) )
+		b->next_free->prev_free = b;
+	lists[fl][sl] = b;
+	fl_map |= 1 << fl;
+	sl_map[fl] |= 1 << sl;
+}
+
+// Devolver una región vacía al alocador de páginas
+static void
+release_region(region_t *r)
+{
+	if ( r->next )
+		r->next->prev = r->prev;
+	if ( r->prev )
+		r->prev->next = r->next;
+	else
+		regions = r->next;
+	mt_free_pages(r);
+}
+
+// Sacar un bloque libre de su lista
+static void
+remove_block(block_t *b)
+{
+	unsigned fl, sl;
+
+	mapping(SIZE(b), &fl, &sl);
+	if ( b->next_free )
+		b->next_free->prev_free = b->prev_free;
+	if ( b->prev_free )
+		b->prev_free->next_free = b->next_free;
+	else if ( !(lists[fl][sl] = b->next_free) && !(sl_map[fl] &= ~(1 << sl)) )
+		fl_map &= ~(1 << fl);
+}
+
+#endif
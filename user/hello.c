@@ -0,0 +1,38 @@
+#include <mtask.h>
+
+/*
+Programa de usuario de ejemplo: crea una tarea hija, se comunica con ella
+mediante un semáforo y espera que termine.
+*/
+
+static Semaphore_t *sem;
+
+static int
+child(void *arg)
+{
+	printk("Tarea hija: %s\n", (char *) arg);
+	SignalSem(sem);
+	return 7;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, status;
+	Task_t *t;
+
+	printk("Hola mundo desde ring 3\n");
+	for ( i = 0 ; i < argc ; i++ )
+		printk("argv[%d] = %s\n", i, argv[i]);
+
+	sem = CreateSem("hello", 0);
+	t = CreateTask(child, 0, "saludos", "hello child", DEFAULT_PRIO);
+	Attach(t);
+	Ready(t);
+	WaitSem(sem);
+	Join(t, &status);
+	printk("La tarea hija terminó con status %d\n", status);
+	DeleteSem(sem);
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+#include <mtask.h>
+#include <syscalls.h>
+
+/*
+Punto de entrada de los programas de usuario. El kernel arma el stack de
+usuario como si _start(argc, argv) hubiera sido llamada (ver elf.c).
+*/
+
+extern unsigned __sys_fast;
+unsigned Features(void);
+int main(int argc, char *argv[]);
+
+void
+_start(int argc, char *argv[])
+{
+	__sys_fast = Features() & SYSFEAT_SYSENTER;
+	Exit(main(argc, argv));
+}
@@ -0,0 +1,83 @@
+#include <mtask.h>
+
+/*
+Funciones de la librería de usuario que no son system calls directas.
+*/
+
+#define BUFSIZE 400
+
+Task_t *__CreateTask(void (*wrapper)(TaskFunc_t, void *), TaskFunc_t func,
+				unsigned stacksize, void *arg, const char *name, unsigned priority);
+void PutString(const char *str);
+int GetChar(void);
+int GetCharCond(void);
+int GetCharTimed(unsigned timeout);
+
+// TLS compartido por todas las tareas del programa
+void *TLS;
+
+// Ejecuta el cuerpo de una tarea creada desde ring 3 y llama a Exit()
+static void
+wrapper(TaskFunc_t func, void *arg)
+{
+	Exit(func(arg));
+}
+
+Task_t *
+CreateTask(TaskFunc_t func, unsigned stacksize, void *arg, const char *name, unsigned priority)
+{
+	return __CreateTask(wrapper, func, stacksize, arg, name, priority);
+}
+
+int 
+vprintk(const char *fmt, va_list args)
+{
+	char buf[BUFSIZE];
+	int n = vsprintf(buf, fmt, args);
+
+	PutString(buf);
+	return n;
+}
+
+int 
+printk(const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	va_start(args, fmt);
+	n = vprintk(fmt, args);
+	va_end(args);
+	return n;
+}
+
+void
+Panic(const char *format, ...)
+{
+	va_list args;
+
+	printk("PANIC: ");
+	va_start(args, format);
+	vprintk(format, args);
+	va_end(args);
+	printk("\n");
+	Exit(-1);
+}
+
+int 
+getch(void)
+{
+	return GetChar();
+}
+
+int 
+getch_cond(void)
+{
+	return GetCharCond();
+}
+
+int 
+getch_timed(unsigned timeout)
+{
+	return GetCharTimed(timeout);
+}
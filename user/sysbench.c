@@ -0,0 +1,54 @@
+#include <mtask.h>
+
+/*
+Mide el costo de una system call con sysenter y con la interrupción, 
+comparado con una llamada directa a una función equivalente.
+*/
+
+#define NCALLS 100000
+
+extern unsigned __sys_fast;
+
+static Task_t *volatile task;
+
+static inline unsigned long long
+rdtsc(void)
+{
+	unsigned long long t;
+	__asm__ __volatile__ ("rdtsc" : "=A" (t));
+	return t;
+}
+
+static Task_t * __attribute__((noinline))
+direct(void)
+{
+	return task;
+}
+
+static unsigned
+measure(Task_t *(*func)(void))
+{
+	unsigned i;
+	unsigned long long start = rdtsc();
+
+	for ( i = 0 ; i < NCALLS ; i++ )
+		task = func();
+	return (unsigned) (rdtsc() - start) / NCALLS;
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned fast = __sys_fast;
+
+	printk("Ciclos por llamada (%u llamadas):\n", NCALLS);
+	printk("    llamada directa:  %u\n", measure(direct));
+	__sys_fast = 0;
+	printk("    int 0x80:         %u\n", measure(CurrentTask));
+	if ( (__sys_fast = fast) )
+		printk("    sysenter:         %u\n", measure(CurrentTask));
+	else
+		printk("    sysenter:         no disponible\n");
+
+	return 0;
+}
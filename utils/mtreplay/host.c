@@ -0,0 +1,74 @@
+// Entorno mínimo para compilar el heap del kernel (heap.c, pages.c y el
+// alocador de bytes) como un programa de Linux, ver mtreplay.c.
+// Se compila con los headers del kernel, sin los de la libc.
+
+#include <kernel.h>
+
+int printf(const char *format, ...);
+int vprintf(const char *format, va_list args);
+void abort(void);
+
+void
+Panic(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	printf("Panic: ");
+	vprintf(format, args);
+	printf("\n");
+	va_end(args);
+	abort();
+}
+
+bool
+SetInts(bool enabled)
+{
+	return true;
+}
+
+void
+Atomic(void)
+{
+}
+
+void
+Unatomic(void)
+{
+}
+
+void *
+Malloc(unsigned size)
+{
+	void *p = malloc(size);
+
+	if ( !p )
+		Panic("Error malloc");
+	return memset(p, 0, size);
+}
+
+void *
+mt_kalloc(unsigned size)
+{
+	return Malloc(size);
+}
+
+void
+Free(void *mem)
+{
+	free(mem);
+}
+
+// Estadísticas del heap para mtreplay.c, que no conoce HeapInfo_t
+void
+host_heap_info(unsigned *in_use, unsigned *peak, unsigned *avail, unsigned *largest, unsigned *pages)
+{
+	HeapInfo_t h;
+
+	GetHeapInfo(&h);
+	*in_use = h.in_use;
+	*peak = h.peak;
+	*avail = h.heap_free;
+	*largest = h.heap_largest;
+	*pages = h.size / PAGE_SIZE - h.free_pages;
+}
@@ -0,0 +1,222 @@
+/*
+	mtreplay - reproduce una traza de malloc() y free() del kernel sobre el
+	heap del kernel compilado como programa de Linux.
+
+	Uso: mtreplay traza [memoria_MB [repeticiones]]
+
+	La traza es el volcado de "mtrace dump" capturado del puerto serie,
+	por ejemplo con qemu -serial file:traza. Se busca la cabecera dentro
+	del archivo, de modo que puede haber otros datos antes.
+
+	Cada malloc() de la traza se repite con el mismo tamaño y cada free()
+	libera el bloque que se obtuvo para la misma dirección original. Los
+	free() de bloques alocados antes de comenzar la traza se ignoran.
+	Al terminar cada repetición se liberan los bloques que quedaron.
+
+	Informa el rendimiento (operaciones por segundo, medido solamente sobre
+	las llamadas al alocador), la memoria máxima ocupada (bytes pedidos y
+	páginas tomadas del alocador de páginas) y la fragmentación externa
+	del heap de bloques chicos, 1 - mayor bloque libre / memoria libre,
+	muestreada durante la traza.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <mtrace.h>
+
+#define SAMPLE			1024					// operaciones entre muestras
+
+// Interfaz con el heap del kernel (host.c)
+void *host_malloc(unsigned nbytes);
+void host_free(void *ap);
+void mt_setup_pages(unsigned end, unsigned reserved_end);
+void host_heap_info(unsigned *in_use, unsigned *peak, unsigned *avail, unsigned *largest, unsigned *pages);
+
+// Tabla de bloques vivos: dirección original -> bloque reproducido
+typedef struct
+{
+	unsigned		addr;
+	void *			block;
+}
+slot_t;
+
+static slot_t *table;
+static unsigned table_size;
+
+static slot_t *lookup(unsigned addr);
+static void delete(slot_t *s);
+static double now(void);
+
+int
+main(int argc, char *argv[])
+{
+	FILE *f;
+	mtrace_header_t hdr;
+	mtrace_rec_t *recs, *r;
+	unsigned mem_mb = argc > 2 ? atoi(argv[2]) : 64;
+	unsigned reps = argc > 3 ? atoi(argv[3]) : 1;
+	unsigned i, k, word = 0, nalloc = 0, nfree = 0, orphans = 0, failed = 0, samples = 0;
+	unsigned in_use, peak, avail, largest, pages, peak_pages = 0;
+	double t, elapsed = 0, frag, frag_sum = 0, frag_max = 0;
+	unsigned long long ops = 0;
+	void *mem;
+	slot_t *s;
+	int c;
+
+	if ( argc < 2 || !(f = fopen(argv[1], "rb")) )
+	{
+		fprintf(stderr, "Uso: %s traza [memoria_MB [repeticiones]]\n", argv[0]);
+		return 1;
+	}
+
+	// Buscar la cabecera y leer los registros
+	while ( word != MTRACE_MAGIC && (c = getc(f)) != EOF )
+		word = (word >> 8) | ((unsigned) c << 24);
+	hdr.magic = word;
+	if ( word != MTRACE_MAGIC || fread(&hdr.version, sizeof hdr - sizeof hdr.magic, 1, f) != 1 )
+	{
+		fprintf(stderr, "%s: no contiene una traza\n", argv[1]);
+		return 1;
+	}
+	if ( hdr.version != MTRACE_VERSION )
+	{
+		fprintf(stderr, "%s: version %u no soportada\n", argv[1], hdr.version);
+		return 1;
+	}
+	recs = malloc(hdr.count * sizeof(mtrace_rec_t));
+	hdr.count = fread(recs, sizeof(mtrace_rec_t), hdr.count, f);
+	fclose(f);
+	printf("Traza: %u registros, %u perdidos", hdr.count, hdr.lost);
+	if ( hdr.count )
+		printf(", %u ciclos", recs[hdr.count - 1].time - recs[0].time);
+	printf("\n");
+
+	// Memoria para el heap, debajo de 4 GB porque el kernel guarda las
+	// direcciones en enteros de 32 bits
+	mem = mmap(NULL, mem_mb << 20, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS
+#ifdef MAP_32BIT
+		| MAP_32BIT
+#endif
+		, -1, 0);
+	if ( mem == MAP_FAILED )
+	{
+		perror("mmap");
+		return 1;
+	}
+	mt_setup_pages((unsigned long) mem + (mem_mb << 20), (unsigned long) mem);
+
+	for ( table_size = 1024 ; table_size < 2 * hdr.count ; table_size *= 2 )
+		;
+	table = calloc(table_size, sizeof(slot_t));
+
+	for ( k = 0 ; k < reps ; k++ )
+	{
+		for ( i = 0, r = recs ; i < hdr.count ; i++, r++ )
+		{
+			if ( i % SAMPLE == 0 )
+			{
+				host_heap_info(&in_use, &peak, &avail, &largest, &pages);
+				frag = avail ? 1 - (double) largest / avail : 0;
+				frag_sum += frag;
+				if ( frag > frag_max )
+					frag_max = frag;
+				if ( pages > peak_pages )
+					peak_pages = pages;
+				samples++;
+				t = now();
+			}
+
+			s = lookup(r->addr);
+			if ( r->size == MTRACE_FREE )
+			{
+				if ( s->addr )
+				{
+					host_free(s->block);
+					delete(s);
+					nfree++;
+				}
+				else
+					orphans++;
+			}
+			else if ( r->addr )
+			{
+				if ( s->addr )					// free() que no quedó en la traza
+					host_free(s->block);
+				if ( (s->block = host_malloc(r->size)) )
+				{
+					s->addr = r->addr;
+					nalloc++;
+				}
+				else
+				{
+					s->addr = 0;
+					failed++;
+				}
+			}
+			ops++;
+
+			if ( i % SAMPLE == SAMPLE - 1 || i == hdr.count - 1 )
+				elapsed += now() - t;
+		}
+
+		// Liberar lo que quedó vivo
+		host_heap_info(&in_use, &peak, &avail, &largest, &pages);
+		if ( pages > peak_pages )
+			peak_pages = pages;
+		for ( i = 0 ; i < table_size ; i++ )
+			if ( table[i].addr )
+			{
+				host_free(table[i].block);
+				table[i].addr = 0;
+			}
+	}
+
+	host_heap_info(&in_use, &peak, &avail, &largest, &pages);
+	printf("Operaciones:     %llu (%u malloc, %u free)\n", ops, nalloc, nfree);
+	printf("Ignoradas:       %u free sin malloc, %u malloc fallidos\n", orphans, failed);
+	printf("Rendimiento:     %.0f ops/s, %.1f ns/op\n", ops / elapsed, elapsed * 1e9 / ops);
+	printf("Memoria maxima:  %u bytes en bloques, %u paginas (%u kB)\n", peak, peak_pages, peak_pages * 4);
+	printf("Fragmentacion:   %.1f%% media, %.1f%% maxima\n", 100 * frag_sum / samples, 100 * frag_max);
+	return 0;
+}
+
+// Buscar una dirección en la tabla, o el lugar libre donde insertarla
+static slot_t *
+lookup(unsigned addr)
+{
+	unsigned i = (addr >> 3) * 2654435761U;
+
+	for ( i &= table_size - 1 ; table[i].addr && table[i].addr != addr ; i = (i + 1) & (table_size - 1) )
+		;
+	return &table[i];
+}
+
+// Borrar una entrada, reubicando las que la siguen en su secuencia
+static void
+delete(slot_t *s)
+{
+	unsigned i = s - table, j, h;
+
+	table[i].addr = 0;
+	for ( j = (i + 1) & (table_size - 1) ; table[j].addr ; j = (j + 1) & (table_size - 1) )
+	{
+		h = ((table[j].addr >> 3) * 2654435761U) & (table_size - 1);
+		if ( (j > i && (h <= i || h > j)) || (j < i && h <= i && h > j) )
+		{
+			table[i] = table[j];
+			table[j].addr = 0;
+			i = j;
+		}
+	}
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}